@@ -0,0 +1,98 @@
+// Microbenchmark of the local kernels in kernels.hpp: elements per second of the scalar reference
+// and of the SIMD version picked for this CPU, plus a check that both give the same result, for each
+// ring width (Z_2^128 has no SIMD version, so both columns are the scalar code). It also checks the
+// PRG's SIMD keystream across the counter carry and exits with 1 if that differs.
+// Usage: ./bench_kernels [n] [k] [reps]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+#include "common.hpp"
+
+static double seconds_per_call(const std::function<void()> &f, int reps) {
+    f(); // warm up
+    auto t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < reps; r++) f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() / reps;
+}
+
+static void report(const char *name, double elems, double t_scalar, double t_simd, bool same) {
+    std::printf("%-14s %10.3g elem/s scalar  %10.3g elem/s simd  (x%.1f)%s\n", name, elems / t_scalar,
+                elems / t_simd, t_scalar / t_simd, same ? "" : "  MISMATCH");
+}
+
+// One pass over all four kernels with elements of R.
+template <RingWord R>
+static void bench_ring(size_t n, size_t k, int reps) {
+    std::printf("Z_2^%zu:\n", 8 * sizeof(R));
+    std::vector<R> e(n), a(n * k), b(n * k), c(n * k), d(n * k), x(n * k);
+    for (auto *v : {&e, &a, &b, &c, &d, &x}) {
+        std::vector<uint32_t> words(v->size() * ring_words<R>);
+        thread_rng().fill(std::span<uint32_t>(words));
+        for (size_t i = 0; i < v->size(); i++) (*v)[i] = ring_from_words<R>(words.data() + i * ring_words<R>);
+    }
+    std::vector<R> out0(k), out1(k), rs0(k), rs1(k);
+
+    {
+        R s0 = 0, s1 = 0;
+        double t0 = seconds_per_call([&] { s0 = kernel_detail::dot_scalar(a.data(), b.data(), n * k); }, reps);
+        double t1 = seconds_per_call([&] { s1 = ring_dot(a.data(), b.data(), n * k); }, reps);
+        report("dot_prod", double(n * k), t0, t1, s0 == s1);
+    }
+    {
+        double t0 = seconds_per_call([&] { kernel_detail::weighted_rows_scalar(e.data(), a.data(), n, k, out0.data()); }, reps);
+        double t1 = seconds_per_call([&] { ring_weighted_rows(e.data(), a.data(), n, k, out1.data()); }, reps);
+        report("compute_v_share", double(n * k), t0, t1, out0 == out1);
+    }
+    {
+        double t0 = seconds_per_call([&] { kernel_detail::colwise_scalar(a.data(), b.data(), n, k, out0.data()); }, reps);
+        double t1 = seconds_per_call([&] { ring_colwise_dot(a.data(), b.data(), n, k, out1.data()); }, reps);
+        report("colwise_dot", double(n * k), t0, t1, out0 == out1);
+    }
+    {
+        FusedRead<R> f0{e.data(), a.data(), b.data(), c.data(), d.data(), x.data(), n, k, out0.data(), rs0.data()};
+        FusedRead<R> f1 = f0;
+        f1.v_j = out1.data();
+        f1.rs = rs1.data();
+        double t0 = seconds_per_call([&] { kernel_detail::fused_read_scalar(f0); }, reps);
+        double t1 = seconds_per_call([&] { ring_fused_read(f1); }, reps);
+        report("fused_read", double(n * k), t0, t1, out0 == out1 && rs0 == rs1);
+    }
+}
+
+// The keystream of prg_detail::generate_blocks on the dispatched SIMD path against the scalar block
+// function, from just below the carry of the low counter word into the high one: a batch that ends
+// exactly on the wrap must still carry, or the next blocks repeat counter (0, hi).
+static bool check_prg_carry() {
+    constexpr size_t blocks = 48;
+    uint32_t start[16] = {0x61707865, 0x3320646e, 0x79622d32, 0x6b206574, 1, 2, 3, 4, 5, 6, 7, 8, 0xfffffff0u, 0, 9, 10};
+    uint32_t simd[16], scalar[16];
+    std::copy(start, start + 16, simd);
+    std::copy(start, start + 16, scalar);
+    std::vector<uint32_t> out_simd(16 * blocks), out_scalar(16 * blocks);
+    prg_detail::generate_blocks(simd, blocks, out_simd.data());
+    for (size_t b = 0; b < blocks; b++) {
+        prg_detail::block_scalar(scalar, out_scalar.data() + 16 * b);
+        if (++scalar[12] == 0) ++scalar[13];
+    }
+    bool same = out_simd == out_scalar && simd[12] == scalar[12] && simd[13] == scalar[13];
+    std::printf("prg counter carry: %s\n", same ? "ok" : "MISMATCH");
+    return same;
+}
+
+int main(int argc, char *argv[]) {
+    size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+    size_t k = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 16;
+    int reps = argc > 3 ? std::atoi(argv[3]) : 20;
+    const char *level[] = {"scalar", "avx2", "avx512"};
+    std::printf("n=%zu k=%zu reps=%d, dispatch: %s\n", n, k, reps, level[static_cast<int>(prg_detail::detect_simd())]);
+
+    bool prg_ok = check_prg_carry();
+    set_rng_seed(1, 0);
+    bench_ring<uint32_t>(n, k, reps);
+    bench_ring<uint64_t>(n, k, reps);
+    bench_ring<u128>(n, k, reps);
+    return prg_ok ? 0 : 1;
+}
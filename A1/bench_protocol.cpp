@@ -0,0 +1,191 @@
+// Benchmark of the whole three-party protocol in one process (inprocess.hpp): P0, P1 and P2 run as
+// threads on the same code as the real binaries, connected by shared memory rings, AF_UNIX socket
+// pairs or loopback TCP. Sweeps m, n, k, Q and the batch size, and prints
+// one JSON document with throughput, per-query latency percentiles, bytes sent per party, rounds and
+// P0's per-phase breakdown (metrics.hpp), all taken from the channels' own counters. Every run also
+// checks P0's rounds on the peer link against the count the protocol flow implies (party.hpp:
+// rounds_per_batch, rounds_per_wave, item_write_final_rounds) and fails if a change added a round; with --sessions the streams'
+// rounds interleave on the link, so the check is skipped there. rounds_test pins the counts themselves.
+// The first run of every configuration (the warm-up, or the first repetition without one) also checks
+// the result: U and V as the two parties leave them must match a plaintext replay of the queries
+// (checker.hpp), and a difference fails the sweep.
+//
+// Usage: ./bench_protocol [--transport shm|unix|tcp] [--m LIST] [--n LIST] [--k LIST] [--q LIST] [--batch LIST]
+//                         [--reps R] [--warmup W] [--out FILE] [protocol options, e.g. --dpf --threads 2]
+// LIST is a comma-separated list of values; every combination is measured.
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "checker.hpp"
+#include "inprocess.hpp"
+
+// A run whose result is checked: the parties work on share files in a scratch directory, and the
+// shares they leave are compared with the checker's replay, which starts from copies taken before the
+// run. Throws on any difference.
+static RunResult run_checked(const std::string &transport, const BenchConfig &c, Options opt, std::stringstream &f1, std::stringstream &f2) {
+    namespace fs = std::filesystem;
+    struct Scratch {
+        fs::path dir;
+        ~Scratch() {
+            std::error_code ignored;
+            fs::remove_all(dir, ignored);
+        }
+    } scratch{fs::temp_directory_path() / ("bench_protocol_" + std::to_string(::getpid()))};
+    fs::create_directories(scratch.dir);
+
+    CheckOptions check;
+    check.update_items = opt.update_items;
+    check.batch = c.batch;
+    std::array<std::string, 2> shares;
+    for (int p = 0; p < 2; p++) {
+        std::string suffix = "_p" + std::to_string(p) + ".bin";
+        shares[p] = (scratch.dir / ("shares" + suffix)).string();
+        ShareStore<Ring>(shares[p], c.m, c.n, c.k, true); // fresh shares, which the run maps as they are
+        check.shares[p] = (scratch.dir / ("before" + suffix)).string();
+        check.shares[2 + p] = shares[p];
+        fs::copy_file(shares[p], check.shares[p]);
+        check.queries[p] = (scratch.dir / ("f" + std::to_string(p + 1) + ".txt")).string();
+        std::ofstream(check.queries[p]) << (p == 0 ? f1 : f2).str();
+    }
+    opt.reset_shares = false;
+    RunResult r = run_in_process(transport, c, opt, f1, f2, shares);
+
+    ShareDump b0(check.shares[0]), b1(check.shares[1]), a0(check.shares[2]), a1(check.shares[3]);
+    ShareDump *const dumps[4] = {&b0, &b1, &a0, &a1};
+    std::ostringstream report;
+    if (Verifier<Ring>(check, dumps, report).run() != 0) {
+        throw std::runtime_error("the result shares differ from the plaintext replay\n" + report.str());
+    }
+    return r;
+}
+
+static RunResult run_once(const std::string &transport, const BenchConfig &c, const Options &opt, bool check) {
+    std::stringstream f1, f2;
+    make_queries(c, f1, f2);
+    RunResult r = check ? run_checked(transport, c, opt, f1, f2) : run_in_process(transport, c, opt, f1, f2);
+    if (opt.sessions <= 1 && r.rounds != r.planned_rounds) {
+        throw std::runtime_error("P0 took " + std::to_string(r.rounds) + " rounds on the peer link, the protocol flow implies " +
+                                 std::to_string(r.planned_rounds));
+    }
+    return r;
+}
+
+static double percentile(std::vector<double> v, double p) {
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    size_t i = static_cast<size_t>(p * (v.size() - 1) + 0.5);
+    return v[std::min(i, v.size() - 1)];
+}
+
+static std::vector<int> parse_list(const std::string &s) {
+    std::vector<int> out;
+    std::stringstream in(s);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        int v = std::stoi(item);
+        if (v < 1) throw std::invalid_argument("sweep values must be >= 1");
+        out.push_back(v);
+    }
+    if (out.empty()) throw std::invalid_argument("empty list");
+    return out;
+}
+
+int main(int argc, char *argv[]) {
+    std::string transport = "shm", out_file;
+    std::vector<int> ms{64}, ns{1024}, ks{16}, qs{64}, batches{1};
+    int reps = 3, warmup = 1;
+    Options opt;
+    try {
+        std::vector<char*> rest{argv[0]};
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            auto next_value = [&]() -> std::string {
+                if (i + 1 >= argc) throw std::invalid_argument("missing value for " + arg);
+                return argv[++i];
+            };
+            if (arg == "--transport") transport = next_value();
+            else if (arg == "--m") ms = parse_list(next_value());
+            else if (arg == "--n") ns = parse_list(next_value());
+            else if (arg == "--k") ks = parse_list(next_value());
+            else if (arg == "--q") qs = parse_list(next_value());
+            else if (arg == "--batch") batches = parse_list(next_value());
+            else if (arg == "--reps") reps = std::max(1, std::stoi(next_value()));
+            else if (arg == "--warmup") warmup = std::max(0, std::stoi(next_value()));
+            else if (arg == "--out") out_file = next_value();
+            else rest.push_back(argv[i]);
+        }
+        if (transport != "shm" && transport != "unix" && transport != "tcp") throw std::invalid_argument("--transport must be shm, unix or tcp");
+        opt = parse_options(static_cast<int>(rest.size()), rest.data());
+        if (opt.rng_seed >= 0) set_rng_seed(opt.rng_seed, 4);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << "\n"
+                  << "Usage: " << argv[0] << " [--transport shm|unix|tcp] [--m LIST] [--n LIST] [--k LIST] [--q LIST]\n"
+                  << "       [--batch LIST] [--reps R] [--warmup W] [--out FILE] [protocol options]\n";
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    std::ostringstream json;
+    json << "{\n  \"transport\": \"" << transport << "\",\n  \"ring_bits\": " << ring_bits << ",\n"
+         << "  \"options\": {\"seeded\": " << (opt.seeded ? "true" : "false") << ", \"dpf\": " << (opt.dpf ? "true" : "false")
+         << ", \"threads\": " << opt.threads << ", \"workers\": " << opt.workers << ", \"window\": " << opt.window
+         << ", \"epoch\": " << opt.epoch << ", \"refresh_rows\": " << opt.refresh_rows << ", \"rng_seed\": " << opt.rng_seed
+         << ", \"update_items\": " << (opt.update_items ? "true" : "false") << "},\n"
+         << "  \"reps\": " << reps << ",\n  \"warmup\": " << warmup << ",\n  \"results\": [";
+    bool first = true;
+    try {
+        for (int m : ms) for (int n : ns) for (int k : ks) for (int q : qs) for (int batch : batches) {
+            BenchConfig c{m, n, k, q, batch};
+            int runs = 0;
+            auto run = [&] { return run_once(transport, c, opt, runs++ == 0); };
+            for (int w = 0; w < warmup; w++) run();
+            std::vector<double> qps, latency;
+            RunResult last;
+            for (int r = 0; r < reps; r++) {
+                last = run();
+                qps.push_back(q / last.seconds);
+                latency.insert(latency.end(), last.latency.begin(), last.latency.end());
+            }
+            std::cerr << "m=" << m << " n=" << n << " k=" << k << " q=" << q << " batch=" << batch
+                      << ": " << percentile(qps, 0.5) << " queries/s\n";
+            json << (first ? "\n" : ",\n") << "    {\"m\": " << m << ", \"n\": " << n << ", \"k\": " << k << ", \"q\": " << q
+                 << ", \"batch\": " << batch
+                 << ", \"qps\": {\"median\": " << percentile(qps, 0.5) << ", \"min\": " << percentile(qps, 0) << ", \"max\": " << percentile(qps, 1) << "}"
+                 << ", \"latency_s\": {\"p50\": " << percentile(latency, 0.5) << ", \"p90\": " << percentile(latency, 0.9)
+                 << ", \"p99\": " << percentile(latency, 0.99) << ", \"max\": " << percentile(latency, 1) << "}"
+                 << ", \"bytes_sent\": {\"p0\": " << last.sent[0] << ", \"p1\": " << last.sent[1] << ", \"p2\": " << last.sent[2] << "}"
+                 << ", \"rounds\": " << last.rounds << ", \"rounds_per_query\": " << double(last.rounds) / q << ", \"phases_p0\": {";
+            bool first_phase = true;
+            for (const auto &[name, t] : last.phases) {
+                json << (first_phase ? "" : ", ") << "\"" << name << "\": {\"wall_s\": " << t.wall_s
+                     << ", \"bytes_sent\": " << t.bytes_sent << ", \"rounds\": " << t.rounds << "}";
+                first_phase = false;
+            }
+            json << "}}";
+            first = false;
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "Benchmark failed: " << e.what() << "\n";
+        return 1;
+    }
+    json << "\n  ]\n}\n";
+
+    if (out_file.empty()) {
+        std::cout << json.str();
+    } else {
+        std::ofstream out(out_file);
+        if (!out) {
+            std::cerr << "Error opening file for writing: " << out_file << "\n";
+            return 1;
+        }
+        out << json.str();
+    }
+    return 0;
+}
@@ -0,0 +1,518 @@
+#pragma once
+// Byte-stream channels between the parties, with the backend picked at runtime from an endpoint string:
+//   tcp:HOST:PORT  TCP with TCP_NODELAY; the listening side binds PORT on all interfaces
+//   unix:PATH      AF_UNIX stream socket
+//   shm:NAME       two single-producer single-consumer byte rings in POSIX shared memory, for parties
+//                  on the same host: the data path is a memcpy into the ring, no system call and no
+//                  kernel copy. A waiting side polls: it yields the CPU for a short while, then backs
+//                  off on a timer, so a blocked party does not burn a core.
+// The same endpoint string is given to both ends of a link. A Channel is an asio AsyncReadStream /
+// AsyncWriteStream, so async_read / async_write and the helpers in common.hpp work on it unchanged,
+// and it counts the bytes and rounds that go over it (LinkCounters).
+//
+// Shared memory rendezvous: the listening side creates the region NAME.i for its i-th accept and waits
+// until the other side has attached, then unlinks the name (the mapping stays). connect_channel(ep, ..., i)
+// attaches to NAME.i, so P2 serves P0 on slot 0 and P1 on slot 1.
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+
+struct Endpoint {
+    enum class Kind { Tcp, Unix, Shm };
+    Kind kind;
+    std::string host, port; // tcp
+    std::string path;       // unix socket path, or shm region name
+
+    static Endpoint parse(const std::string &spec) {
+        auto colon = spec.find(':');
+        if (colon == std::string::npos) throw std::invalid_argument("endpoint must be tcp:HOST:PORT, unix:PATH or shm:NAME: " + spec);
+        std::string kind = spec.substr(0, colon), rest = spec.substr(colon + 1);
+        Endpoint ep;
+        if (kind == "tcp") {
+            auto c = rest.rfind(':');
+            if (c == std::string::npos || c + 1 == rest.size()) throw std::invalid_argument("tcp endpoint needs HOST:PORT: " + spec);
+            ep.kind = Kind::Tcp;
+            ep.host = rest.substr(0, c);
+            ep.port = rest.substr(c + 1);
+        } else if (kind == "unix" || kind == "shm") {
+            if (rest.empty()) throw std::invalid_argument("empty path in endpoint: " + spec);
+            ep.kind = kind == "unix" ? Kind::Unix : Kind::Shm;
+            ep.path = rest;
+        } else {
+            throw std::invalid_argument("unknown transport '" + kind + "' in endpoint " + spec);
+        }
+        return ep;
+    }
+};
+
+// What went over one end of a link. A round is counted when a read starts after a write that was
+// issued while no read was pending, so an exchange() (write and read in flight together) is one round
+// however many partial transfers it takes, and a send followed by a receive is one round too.
+struct LinkCounters {
+    uint64_t bytes_sent = 0, bytes_received = 0;
+    uint64_t rounds = 0;
+};
+
+namespace channel_detail {
+
+using Handler = std::function<void(boost::system::error_code, size_t)>;
+// buffer sequences of one transfer: a write gathers from several buffers, a read scatters into several
+using MutableBuffers = std::vector<boost::asio::mutable_buffer>;
+using ConstBuffers = std::vector<boost::asio::const_buffer>;
+
+// Backend interface. Handlers are invoked through the channel's executor, never inline.
+class Impl {
+    public:
+        virtual ~Impl() = default;
+        virtual void read_some(MutableBuffers bufs, Handler h) = 0;
+        virtual void write_some(ConstBuffers bufs, Handler h) = 0;
+        virtual void cancel() = 0;
+        // socket backends: the descriptor (switched to non-blocking) and a wait until it can take more data
+        virtual int native_socket() { return -1; }
+        virtual void wait_writable(Handler h) { h(boost::asio::error::operation_not_supported, 0); }
+
+        LinkCounters counters;
+        bool reading = false, sent_since_wait = false; // round tracking, see LinkCounters
+};
+
+template <typename Socket>
+class SocketImpl : public Impl {
+    public:
+        explicit SocketImpl(Socket s) : sock_(std::move(s)) {}
+        // (readv / writev over the whole sequence)
+        void read_some(MutableBuffers bufs, Handler h) override { sock_.async_read_some(bufs, std::move(h)); }
+        void write_some(ConstBuffers bufs, Handler h) override { sock_.async_write_some(bufs, std::move(h)); }
+        void cancel() override { sock_.cancel(); }
+        int native_socket() override {
+            sock_.native_non_blocking(true);
+            return sock_.native_handle();
+        }
+        void wait_writable(Handler h) override {
+            sock_.async_wait(Socket::wait_write, [h = std::move(h)](boost::system::error_code ec) { h(ec, 0); });
+        }
+    private:
+        Socket sock_;
+};
+
+constexpr char shm_magic[8] = {'C', 'S', '6', '7', '0', 'S', 'H', 'M'};
+constexpr size_t shm_default_capacity = size_t(4) << 20;
+
+struct RegionHeader {
+    char magic[8];
+    uint32_t capacity;             // bytes per ring
+    std::atomic<uint32_t> ready;   // creator has initialised the region
+    std::atomic<uint32_t> attached; // the other side has mapped it
+};
+
+struct alignas(64) RingHeader {
+    alignas(64) std::atomic<uint64_t> head{0}; // bytes written so far (producer)
+    alignas(64) std::atomic<uint64_t> tail{0}; // bytes read so far (consumer)
+    alignas(64) std::atomic<uint32_t> writer_closed{0};
+    std::atomic<uint32_t> reader_closed{0};
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory rings need lock-free 64-bit atomics");
+
+// A mapped region: header, ring 0 (creator -> attacher), ring 1 (attacher -> creator), then the data
+// of both rings.
+class Region {
+    public:
+        static size_t bytes(size_t capacity) { return 64 + 2 * sizeof(RingHeader) + 2 * capacity; }
+
+        Region(void *base, size_t size) : base_(base), size_(size) {}
+        ~Region() { if (base_) munmap(base_, size_); }
+        Region(const Region&) = delete;
+        Region& operator=(const Region&) = delete;
+
+        RegionHeader &header() { return *static_cast<RegionHeader*>(base_); }
+        size_t capacity() { return header().capacity; }
+        RingHeader &ring(int i) { return reinterpret_cast<RingHeader*>(static_cast<char*>(base_) + 64)[i]; }
+        char *data(int i) { return static_cast<char*>(base_) + 64 + 2 * sizeof(RingHeader) + i * capacity(); }
+
+        void init(size_t capacity) {
+            auto &h = *new (base_) RegionHeader{};
+            std::memcpy(h.magic, shm_magic, sizeof(shm_magic));
+            h.capacity = static_cast<uint32_t>(capacity);
+            new (&ring(0)) RingHeader();
+            new (&ring(1)) RingHeader();
+            h.ready.store(1, std::memory_order_release);
+        }
+
+        // map a fresh anonymous region (both ends in one process)
+        static std::shared_ptr<Region> anonymous(size_t capacity) {
+            void *p = mmap(nullptr, bytes(capacity), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED) throw std::runtime_error(std::string("mmap: ") + std::strerror(errno));
+            auto r = std::make_shared<Region>(p, bytes(capacity));
+            r->init(capacity);
+            return r;
+        }
+
+    private:
+        void *base_;
+        size_t size_;
+};
+
+// One direction of the shared memory link per ring; side 0 writes ring 0 and reads ring 1.
+class ShmImpl : public Impl, public std::enable_shared_from_this<ShmImpl> {
+    public:
+        ShmImpl(boost::asio::any_io_executor ex, std::shared_ptr<Region> region, int side)
+            : ex_(std::move(ex)), region_(std::move(region)), out_(side), in_(1 - side) {}
+
+        ~ShmImpl() override {
+            region_->ring(out_).writer_closed.store(1, std::memory_order_release);
+            region_->ring(in_).reader_closed.store(1, std::memory_order_release);
+        }
+
+        void read_some(MutableBuffers bufs, Handler h) override {
+            start(std::make_shared<Op>(ex_, true, std::move(bufs), std::move(h)));
+        }
+        void write_some(ConstBuffers bufs, Handler h) override {
+            MutableBuffers parts;
+            for (const auto &b : bufs) parts.emplace_back(const_cast<void*>(b.data()), b.size()); // only read from
+            start(std::make_shared<Op>(ex_, false, std::move(parts), std::move(h)));
+        }
+        void cancel() override {
+            for (auto &w : pending_) {
+                if (auto op = w.lock()) {
+                    op->cancelled = true;
+                    op->timer.cancel();
+                }
+            }
+        }
+
+    private:
+        static constexpr auto spin_time = std::chrono::microseconds(200);
+        static constexpr auto min_delay = std::chrono::microseconds(20);
+        static constexpr auto max_delay = std::chrono::microseconds(500);
+
+        struct Op {
+            Op(const boost::asio::any_io_executor &ex, bool read, MutableBuffers bufs, Handler h)
+                : read(read), bufs(std::move(bufs)), size(boost::asio::buffer_size(this->bufs)), handler(std::move(h)), timer(ex),
+                  since(std::chrono::steady_clock::now()) {}
+            bool read;
+            MutableBuffers bufs;
+            size_t size;
+            Handler handler;
+            boost::asio::steady_timer timer;
+            std::chrono::steady_clock::time_point since;
+            std::chrono::microseconds delay = min_delay;
+            bool cancelled = false;
+        };
+
+        void start(std::shared_ptr<Op> op) {
+            pending_[op->read ? 0 : 1] = op;
+            attempt(std::move(op));
+        }
+
+        void finish(const std::shared_ptr<Op> &op, boost::system::error_code ec, size_t n) {
+            boost::asio::post(ex_, [op, ec, n] { op->handler(ec, n); });
+        }
+
+        void attempt(std::shared_ptr<Op> op) {
+            if (op->cancelled) return finish(op, boost::asio::error::operation_aborted, 0);
+            if (op->size == 0) return finish(op, {}, 0);
+            size_t n = transfer(*op);
+            if (n > 0) return finish(op, {}, n);
+            if (op->read && region_->ring(in_).writer_closed.load(std::memory_order_acquire) && transfer(*op) == 0)
+                return finish(op, boost::asio::error::eof, 0);
+            if (!op->read && region_->ring(out_).reader_closed.load(std::memory_order_acquire))
+                return finish(op, boost::asio::error::broken_pipe, 0);
+            auto self = shared_from_this();
+            if (std::chrono::steady_clock::now() - op->since < spin_time) {
+                std::this_thread::yield(); // let the other side run if it shares this core
+                boost::asio::post(ex_, [self, op] { self->attempt(op); });
+                return;
+            }
+            op->timer.expires_after(op->delay);
+            op->delay = std::min(op->delay * 2, std::chrono::duration_cast<std::chrono::microseconds>(max_delay));
+            op->timer.async_wait([self, op](boost::system::error_code) { self->attempt(op); });
+        }
+
+        // as much of the op's buffers, in order, as the ring allows
+        size_t transfer(Op &op) {
+            size_t total = 0;
+            for (const auto &b : op.bufs) {
+                size_t n = op.read ? pull(static_cast<char*>(b.data()), b.size()) : push(static_cast<const char*>(b.data()), b.size());
+                total += n;
+                if (n < b.size()) break;
+            }
+            return total;
+        }
+
+        size_t push(const char *src, size_t len) {
+            RingHeader &r = region_->ring(out_);
+            size_t cap = region_->capacity();
+            uint64_t head = r.head.load(std::memory_order_relaxed), tail = r.tail.load(std::memory_order_acquire);
+            size_t n = std::min<size_t>(len, cap - (head - tail));
+            if (n == 0) return 0;
+            size_t off = head % cap, first = std::min(n, cap - off);
+            char *data = region_->data(out_);
+            std::memcpy(data + off, src, first);
+            std::memcpy(data, src + first, n - first);
+            r.head.store(head + n, std::memory_order_release);
+            return n;
+        }
+
+        size_t pull(char *dst, size_t len) {
+            RingHeader &r = region_->ring(in_);
+            size_t cap = region_->capacity();
+            uint64_t tail = r.tail.load(std::memory_order_relaxed), head = r.head.load(std::memory_order_acquire);
+            size_t n = std::min<size_t>(len, head - tail);
+            if (n == 0) return 0;
+            size_t off = tail % cap, first = std::min(n, cap - off);
+            const char *data = region_->data(in_);
+            std::memcpy(dst, data + off, first);
+            std::memcpy(dst + first, data, n - first);
+            r.tail.store(tail + n, std::memory_order_release);
+            return n;
+        }
+
+        boost::asio::any_io_executor ex_;
+        std::shared_ptr<Region> region_;
+        int out_, in_;
+        std::weak_ptr<Op> pending_[2]; // read, write
+};
+
+inline std::string shm_name(const std::string &name, int slot) {
+    return (name.front() == '/' ? "" : "/") + name + "." + std::to_string(slot);
+}
+
+} // namespace channel_detail
+
+class Channel {
+    public:
+        using executor_type = boost::asio::any_io_executor;
+
+        Channel() = default;
+        Channel(executor_type ex, std::shared_ptr<channel_detail::Impl> impl) : ex_(std::move(ex)), impl_(std::move(impl)) {}
+
+        executor_type get_executor() { return ex_; }
+        bool is_open() const { return impl_ != nullptr; }
+        void cancel() { impl_->cancel(); }
+        const LinkCounters &counters() const { return impl_->counters; }
+
+        template <typename Buffers, typename Token>
+        auto async_read_some(const Buffers &buffers, Token &&token) {
+            if (impl_->sent_since_wait) {
+                ++impl_->counters.rounds;
+                impl_->sent_since_wait = false;
+            }
+            impl_->reading = true;
+            return boost::asio::async_initiate<Token, void(boost::system::error_code, size_t)>(
+                [this](auto handler, const Buffers &buffers) {
+                    auto h = std::make_shared<decltype(handler)>(std::move(handler));
+                    impl_->read_some(channel_detail::MutableBuffers(boost::asio::buffer_sequence_begin(buffers), boost::asio::buffer_sequence_end(buffers)),
+                                     [h, impl = impl_](boost::system::error_code ec, size_t n) {
+                                         impl->counters.bytes_received += n;
+                                         impl->reading = false;
+                                         std::move(*h)(ec, n);
+                                     });
+                }, token, buffers);
+        }
+
+        template <typename Buffers, typename Token>
+        auto async_write_some(const Buffers &buffers, Token &&token) {
+            if (!impl_->reading) impl_->sent_since_wait = true;
+            return boost::asio::async_initiate<Token, void(boost::system::error_code, size_t)>(
+                [this](auto handler, const Buffers &buffers) {
+                    auto h = std::make_shared<decltype(handler)>(std::move(handler));
+                    impl_->write_some(channel_detail::ConstBuffers(boost::asio::buffer_sequence_begin(buffers), boost::asio::buffer_sequence_end(buffers)),
+                                      [h, impl = impl_](boost::system::error_code ec, size_t n) {
+                                          impl->counters.bytes_sent += n;
+                                          std::move(*h)(ec, n);
+                                      });
+                }, token, buffers);
+        }
+
+        // Send len bytes of file fd from offset with sendfile(2): from the page cache to the socket with
+        // no copy through user space. Returns false, having sent nothing, on a channel without a socket
+        // (shared memory), where the caller writes the bytes itself.
+        boost::asio::awaitable<bool> send_file(int fd, uint64_t offset, size_t len) {
+            int s = impl_->native_socket();
+            if (s < 0) co_return false;
+            if (!impl_->reading) impl_->sent_since_wait = true;
+            off_t off = static_cast<off_t>(offset);
+            while (len > 0) {
+                ssize_t n = ::sendfile(s, fd, &off, len);
+                if (n > 0) {
+                    len -= static_cast<size_t>(n);
+                    impl_->counters.bytes_sent += static_cast<size_t>(n);
+                } else if (n < 0 && errno == EINTR) {
+                    continue;
+                } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    // (named locals: temporaries in a co_await expression are not safe with GCC 12)
+                    boost::system::error_code ec;
+                    auto token = boost::asio::redirect_error(boost::asio::use_awaitable, ec);
+                    channel_detail::Impl *impl = impl_.get();
+                    auto wait = [impl](auto handler) {
+                        auto h = std::make_shared<decltype(handler)>(std::move(handler));
+                        impl->wait_writable([h](boost::system::error_code ec, size_t n) { std::move(*h)(ec, n); });
+                    };
+                    co_await boost::asio::async_initiate<decltype(token), void(boost::system::error_code, size_t)>(wait, token);
+                    if (ec) throw boost::system::system_error(ec, "send_file");
+                } else {
+                    throw boost::system::system_error(n < 0 ? errno : EIO, boost::system::system_category(), "sendfile");
+                }
+            }
+            co_return true;
+        }
+
+        // Wrap a connected socket (TCP gets TCP_NODELAY; buffer > 0 sets the socket buffer sizes)
+        template <typename Socket>
+        static Channel from_socket(Socket sock, size_t buffer = 0) {
+            if constexpr (std::is_same_v<typename Socket::protocol_type, boost::asio::ip::tcp>)
+                sock.set_option(boost::asio::ip::tcp::no_delay(true));
+            if (buffer > 0) {
+                sock.set_option(boost::asio::socket_base::send_buffer_size(static_cast<int>(buffer)));
+                sock.set_option(boost::asio::socket_base::receive_buffer_size(static_cast<int>(buffer)));
+            }
+            executor_type ex = sock.get_executor();
+            return Channel(ex, std::make_shared<channel_detail::SocketImpl<Socket>>(std::move(sock)));
+        }
+
+        // Both ends of a shared memory link inside one process (e.g. the benchmark harness).
+        static std::pair<Channel, Channel> shm_pair(executor_type a, executor_type b, size_t capacity = 0) {
+            auto region = channel_detail::Region::anonymous(capacity ? capacity : channel_detail::shm_default_capacity);
+            return {Channel(a, std::make_shared<channel_detail::ShmImpl>(a, region, 0)),
+                    Channel(b, std::make_shared<channel_detail::ShmImpl>(b, region, 1))};
+        }
+
+    private:
+        executor_type ex_;
+        std::shared_ptr<channel_detail::Impl> impl_;
+};
+
+// Connect to a listening endpoint, retrying for up to `patience` while the other side is not up yet.
+// slot selects the shared memory region NAME.slot (ignored by the socket transports).
+inline boost::asio::awaitable<Channel> connect_channel(const Endpoint &ep, size_t buffer = 0, int slot = 0,
+                                                       std::chrono::seconds patience = std::chrono::seconds(30)) {
+    namespace asio = boost::asio;
+    auto ex = co_await asio::this_coro::executor;
+    auto deadline = std::chrono::steady_clock::now() + patience;
+    asio::steady_timer retry(ex);
+    for (;;) {
+        boost::system::error_code ec;
+        if (ep.kind == Endpoint::Kind::Tcp) {
+            asio::ip::tcp::resolver resolver(ex);
+            auto endpoints = co_await resolver.async_resolve(ep.host, ep.port, asio::use_awaitable);
+            asio::ip::tcp::socket sock(ex);
+            co_await asio::async_connect(sock, endpoints, asio::redirect_error(asio::use_awaitable, ec));
+            if (!ec) co_return Channel::from_socket(std::move(sock), buffer);
+        } else if (ep.kind == Endpoint::Kind::Unix) {
+            asio::local::stream_protocol::socket sock(ex);
+            co_await sock.async_connect(asio::local::stream_protocol::endpoint(ep.path), asio::redirect_error(asio::use_awaitable, ec));
+            if (!ec) co_return Channel::from_socket(std::move(sock), buffer);
+        } else {
+            std::string name = channel_detail::shm_name(ep.path, slot);
+            int fd = shm_open(name.c_str(), O_RDWR, 0600);
+            if (fd >= 0) {
+                struct stat st;
+                void *p = MAP_FAILED;
+                if (fstat(fd, &st) == 0 && st.st_size > 0)
+                    p = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                close(fd);
+                if (p != MAP_FAILED) {
+                    auto region = std::make_shared<channel_detail::Region>(p, st.st_size);
+                    auto &h = region->header();
+                    uint32_t expected = 0;
+                    if (h.ready.load(std::memory_order_acquire) && std::memcmp(h.magic, channel_detail::shm_magic, 8) == 0 &&
+                        h.attached.compare_exchange_strong(expected, 1, std::memory_order_acq_rel)) {
+                        co_return Channel(ex, std::make_shared<channel_detail::ShmImpl>(ex, region, 1));
+                    }
+                }
+            }
+            ec = asio::error::connection_refused;
+        }
+        if (std::chrono::steady_clock::now() >= deadline) throw boost::system::system_error(ec, "connect_channel");
+        retry.expires_after(std::chrono::milliseconds(50));
+        co_await retry.async_wait(asio::use_awaitable);
+    }
+}
+
+// Listening side of an endpoint.
+class ChannelListener {
+    public:
+        ChannelListener(boost::asio::any_io_executor ex, Endpoint ep, size_t buffer = 0)
+            : ex_(ex), ep_(std::move(ep)), buffer_(buffer), tcp_(ex), unix_(ex) {
+            namespace asio = boost::asio;
+            if (ep_.kind == Endpoint::Kind::Tcp) {
+                asio::ip::tcp::endpoint bind_ep(asio::ip::tcp::v4(), static_cast<unsigned short>(std::stoi(ep_.port)));
+                tcp_.open(bind_ep.protocol());
+                tcp_.set_option(asio::socket_base::reuse_address(true));
+                tcp_.bind(bind_ep);
+                tcp_.listen();
+            } else if (ep_.kind == Endpoint::Kind::Unix) {
+                ::unlink(ep_.path.c_str()); // stale socket of an earlier run
+                asio::local::stream_protocol::endpoint bind_ep(ep_.path);
+                unix_.open(bind_ep.protocol());
+                unix_.bind(bind_ep);
+                unix_.listen();
+            }
+        }
+
+        ~ChannelListener() {
+            if (ep_.kind == Endpoint::Kind::Unix) ::unlink(ep_.path.c_str());
+        }
+
+        boost::asio::awaitable<Channel> accept() {
+            namespace asio = boost::asio;
+            int slot = accepted_++;
+            if (ep_.kind == Endpoint::Kind::Tcp) {
+                auto sock = co_await tcp_.async_accept(asio::use_awaitable);
+                co_return Channel::from_socket(std::move(sock), buffer_);
+            }
+            if (ep_.kind == Endpoint::Kind::Unix) {
+                auto sock = co_await unix_.async_accept(asio::use_awaitable);
+                co_return Channel::from_socket(std::move(sock), buffer_);
+            }
+            // shared memory: create NAME.slot and wait for the other side to attach
+            std::string name = channel_detail::shm_name(ep_.path, slot);
+            size_t capacity = buffer_ ? buffer_ : channel_detail::shm_default_capacity;
+            size_t size = channel_detail::Region::bytes(capacity);
+            shm_unlink(name.c_str()); // stale region of an earlier run
+            int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+            if (fd < 0) throw std::runtime_error("shm_open " + name + ": " + std::strerror(errno));
+            if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+                close(fd);
+                shm_unlink(name.c_str());
+                throw std::runtime_error("ftruncate " + name + ": " + std::strerror(errno));
+            }
+            void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            close(fd);
+            if (p == MAP_FAILED) {
+                shm_unlink(name.c_str());
+                throw std::runtime_error("mmap " + name + ": " + std::strerror(errno));
+            }
+            auto region = std::make_shared<channel_detail::Region>(p, size);
+            region->init(capacity);
+            asio::steady_timer poll(ex_);
+            while (!region->header().attached.load(std::memory_order_acquire)) {
+                poll.expires_after(std::chrono::milliseconds(1));
+                co_await poll.async_wait(asio::use_awaitable);
+            }
+            shm_unlink(name.c_str());
+            co_return Channel(ex_, std::make_shared<channel_detail::ShmImpl>(ex_, region, 0));
+        }
+
+    private:
+        boost::asio::any_io_executor ex_;
+        Endpoint ep_;
+        size_t buffer_;
+        boost::asio::ip::tcp::acceptor tcp_;
+        boost::asio::local::stream_protocol::acceptor unix_;
+        int accepted_ = 0;
+};
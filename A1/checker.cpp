@@ -1,118 +1,77 @@
-#include <bits/stdc++.h>
-#include <fstream>
-using namespace std;
+// Command line front end of the batch verifier (checker.hpp): replays every query of the query files
+// in plaintext ring arithmetic and checks both parties' share files, and optionally their traces, against it.
+// Usage: ./checker [options] BEFORE_P0 BEFORE_P1 AFTER_P0 AFTER_P1
+//   e.g. cp shares_p0.bin before_p0.bin; cp shares_p1.bin before_p1.bin; (run); ./checker before_p0.bin
+//        before_p1.bin shares_p0.bin shares_p1.bin --trace o1.trace o2.trace
+// Exit status: 0 if everything matches, 1 on a divergence, 2 on bad input.
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "checker.hpp"
 
-// Read matrix from file with dimensions
-vector<vector<double>> read_matrix(ifstream &fin) {
-    int m, n;
-    fin >> m >> n;
-    vector<vector<double>> mat(m, vector<double>(n));
-    for (int i = 0; i < m; i++) {
-        for (int j = 0; j < n; j++) {
-            fin >> mat[i][j];
-        }
-    }
-    return mat;
-}
-
-// Reconstruct matrix: A = A0 + A1
-vector<vector<double>> reconstruct(const vector<vector<double>> &a0,
-                                   const vector<vector<double>> &a1) {
-    int m = a0.size(), n = a0[0].size();
-    vector<vector<double>> res(m, vector<double>(n));
-    for (int i = 0; i < m; i++)
-        for (int j = 0; j < n; j++)
-            res[i][j] = a0[i][j] + a1[i][j];
-    return res;
-}
-
-// Update rule: u_i <- u_i + v_j * (1 - <u_i, v_j>)
-void update_row(vector<vector<double>> &U, const vector<vector<double>> &V, int i, int j) {
-    int n = U[0].size();
-    double dot = 0.0;
-    for (int k = 0; k < n; k++) dot += U[i][k] * V[j][k];
-    double delta = 1.0 - dot;
-    for (int k = 0; k < n; k++) {
-        U[i][k] = U[i][k] + V[j][k] * delta;
-    }
-}
-
-// Compare two matrices with tolerance
-bool equal_matrix(const vector<vector<double>> &A,
-                  const vector<vector<double>> &B,
-                  double eps = 1e-6) {
-    if (A.size() != B.size() || A[0].size() != B[0].size()) return false;
-    bool flag = true;
-    for (int i = 0; i < (int)A.size(); i++)
-        for (int j = 0; j < (int)A[0].size(); j++)
-            if (fabs(A[i][j] - B[i][j]) > eps) return flag;
-    return true;
-}
-
-// Print matrix to stdout
-void print_matrix(const vector<vector<double>> &mat, std::ofstream &ofs, string name) {
-    ofs << "=== " << name << " ===\n";
-    for (const auto &row : mat) {
-        for (double val : row) {
-            ofs << val << " ";
-        }
-        ofs << "\n";
-    }
-    ofs << "\n";
-    ofs << std::flush;
+static void usage(const char *prog) {
+    std::cerr << "Usage: " << prog << " [options] BEFORE_P0 BEFORE_P1 AFTER_P0 AFTER_P1\n"
+              << "  BEFORE_Px / AFTER_Px  party x's share file (shares_px.bin) before and after the run\n"
+              << "  --queries F1 F2  the run's query files, text or binary (default f1.txt f2.txt)\n"
+              << "  --trace T1 T2    also check every query's read, inner product and item update against\n"
+              << "                   the parties' traces (o1.trace o2.trace, MPC_TRACE_LEVEL >= 1)\n"
+              << "  --update-items   the run updated the item rows too (needs the run's --batch)\n"
+              << "  --batch B        the run's batch size (only matters with --update-items)\n"
+              << "  --threads N      threads for the replay and the comparison (default: all cores)\n"
+              << "  --chunk Q        queries read per replay step (default 65536)\n";
 }
 
-
 int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        cerr << "Usage: " << argv[0] << " <input_file>\n";
-        return 1;
-    }
-
-    ifstream fin(argv[1]);
-    if (!fin) {
-        cerr << "Error: cannot open file " << argv[1] << endl;
-        return 1;
+    CheckOptions opt;
+    try {
+        std::vector<std::string> files;
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            auto next_value = [&]() -> std::string {
+                if (i + 1 >= argc) throw std::invalid_argument("missing value for " + arg);
+                return argv[++i];
+            };
+            if (arg == "--queries") { opt.queries[0] = next_value(); opt.queries[1] = next_value(); }
+            else if (arg == "--trace") { opt.traces[0] = next_value(); opt.traces[1] = next_value(); }
+            else if (arg == "--update-items") opt.update_items = true;
+            else if (arg == "--batch") opt.batch = std::max(1, std::stoi(next_value()));
+            else if (arg == "--threads") opt.threads = std::max(1, std::stoi(next_value()));
+            else if (arg == "--chunk") opt.chunk = std::max(1, std::stoi(next_value()));
+            else if (arg == "--help" || arg == "-h") { usage(argv[0]); return 0; }
+            else if (arg.rfind("--", 0) == 0) throw std::invalid_argument("unknown option: " + arg);
+            else files.push_back(arg);
+        }
+        if (files.size() != 4) {
+            usage(argv[0]);
+            return 2;
+        }
+        for (int f = 0; f < 4; f++) opt.shares[f] = files[f];
+    } catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        usage(argv[0]);
+        return 2;
     }
-    string file = "check.txt";
-    std::ofstream ofs(file);
-
-    int i, j0, j1;
-    fin >> i >> j0;
-    fin >> i >> j1;
-    int j = j0 + j1;
-
-    auto u0 = read_matrix(fin);
-    auto v0 = read_matrix(fin);
-    auto u1 = read_matrix(fin);
-    auto v1 = read_matrix(fin);
-    auto u0_new = read_matrix(fin);
-    auto u1_new = read_matrix(fin);
 
-    // Reconstruct U, V, U'
-    auto U = reconstruct(u0, u1);
-    auto V = reconstruct(v0, v1);
-    auto U_new = reconstruct(u0_new, u1_new);
-
-    print_matrix(U, ofs, "U");
-    print_matrix(U_new, ofs, "U_new");
-
-    // Compute expected update
-    auto U_expected = U;
-    update_row(U_expected, V, i, j);
-    print_matrix(U_expected, ofs, "U_expected");
-
-    // Compare
-    if (equal_matrix(U_expected, U_new)) {
-        cout << "✅ Update is correct for user " << i << " and item " << j << endl;
-    } else {
-        cout << "❌ Update is incorrect\n";
-        cout << "Expected row " << i << ": ";
-        for (auto x : U_expected[i]) cout << x << " ";
-        cout << "\nGot row " << i << ": ";
-        for (auto x : U_new[i]) cout << x << " ";
-        cout << "\n";
+    try {
+        std::unique_ptr<ShareDump> owned[4];
+        ShareDump *dumps[4];
+        for (int f = 0; f < 4; f++) dumps[f] = (owned[f] = std::make_unique<ShareDump>(opt.shares[f])).get();
+        const auto &h = dumps[0]->header();
+        for (int f = 1; f < 4; f++) {
+            const auto &o = dumps[f]->header();
+            if (o.m != h.m || o.n != h.n || o.k != h.k || o.ring_bytes != h.ring_bytes) {
+                throw std::runtime_error(dumps[f]->path() + " has other dimensions or another ring width than " + dumps[0]->path());
+            }
+        }
+        switch (h.ring_bytes) {
+            case 4: return Verifier<uint32_t>(opt, dumps, std::cout).run();
+            case 8: return Verifier<uint64_t>(opt, dumps, std::cout).run();
+            case 16: return Verifier<u128>(opt, dumps, std::cout).run();
+            default: throw std::runtime_error("unsupported ring element size " + std::to_string(h.ring_bytes));
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 2;
     }
-
-    return 0;
 }
@@ -0,0 +1,461 @@
+#pragma once
+// Batch verifier for a whole run. It replays every query of the query files in plaintext ring
+// arithmetic and checks the parties' shares against the replay:
+//   - U and V before the run: the share files of both parties, copied before the run;
+//   - U and V after the run: the share files as the run left them;
+//   - optionally the parties' binary traces (trace.hpp, MPC_TRACE_LEVEL >= 1), which let it check
+//     every query's read of v_j, <u_i, v_j> and, with --update-items, the item update.
+// It reports the first divergent query and the first divergent row of U and of V.
+//
+// Every input is streamed. The share files are mapped read-only, and the query files and traces are
+// read front to back. The only state is the rows the replay has changed (at most one per query for
+// each of U and V) plus one chunk of queries, so m and n can run into the millions. Without
+// --update-items V does not change and the users are independent, so the users are split over the
+// threads by index. With it V changes after every batch, and the replay runs on one thread. The final
+// comparison of all m + n rows always runs on every thread, over whole runs of rows at a time.
+//
+// The replay lives here so that bench_protocol can run it on its own runs; checker.cpp is the command
+// line tool around it. Verifier::run() writes its report to the given stream.
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "common.hpp"
+#include "query_file.hpp"
+#include "share_store.hpp"
+#include "trace.hpp"
+
+struct CheckOptions {
+    std::string shares[4];                       // before P0, before P1, after P0, after P1
+    std::string queries[2] = {"f1.txt", "f2.txt"};
+    std::string traces[2];                       // "" = no trace check
+    bool update_items = false;
+    int batch = 1;
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    int chunk = 1 << 16;                         // queries per replay chunk
+};
+
+// A party's share file (share_store.hpp), mapped read-only.
+class ShareDump {
+    public:
+        using Header = ShareStore<uint32_t>::Header; // the same layout for every ring width
+
+        explicit ShareDump(const std::string &path) : path_(path) {
+            fd_ = ::open(path.c_str(), O_RDONLY);
+            if (fd_ < 0) throw std::runtime_error("cannot open share file " + path + ": " + std::strerror(errno));
+            struct stat st{};
+            fstat(fd_, &st);
+            bytes_ = static_cast<size_t>(st.st_size);
+            if (bytes_ < sizeof(Header)) throw std::runtime_error("share file " + path + " is truncated");
+            base_ = mmap(nullptr, bytes_, PROT_READ, MAP_SHARED, fd_, 0);
+            if (base_ == MAP_FAILED) throw std::runtime_error("cannot map share file " + path + ": " + std::strerror(errno));
+            madvise(base_, bytes_, MADV_SEQUENTIAL);
+            std::memcpy(&h_, base_, sizeof(h_));
+            if (std::memcmp(h_.magic, ShareStore<uint32_t>::magic, sizeof(h_.magic)) != 0 || h_.version != ShareStore<uint32_t>::version) {
+                throw std::runtime_error(path + " is not a share file of this version");
+            }
+            if (bytes_ != sizeof(Header) + (size_t(h_.m) + 2 * size_t(h_.n)) * h_.k * h_.ring_bytes) {
+                throw std::runtime_error("share file " + path + " is truncated");
+            }
+        }
+
+        ~ShareDump() {
+            if (base_ != MAP_FAILED) munmap(base_, bytes_);
+            if (fd_ >= 0) ::close(fd_);
+        }
+
+        ShareDump(const ShareDump&) = delete;
+        ShareDump& operator=(const ShareDump&) = delete;
+
+        const Header &header() const { return h_; }
+        const std::string &path() const { return path_; }
+
+        template <RingWord R>
+        const R *u(size_t row) const { return matrices<R>() + row * h_.k; }
+        template <RingWord R>
+        const R *v(size_t row) const { return matrices<R>() + (size_t(h_.m) + row) * h_.k; }
+
+    private:
+        template <RingWord R>
+        const R *matrices() const { return reinterpret_cast<const R*>(static_cast<const char*>(base_) + sizeof(Header)); }
+
+        std::string path_;
+        int fd_ = -1;
+        void *base_ = MAP_FAILED;
+        size_t bytes_ = 0;
+        Header h_{};
+};
+
+// The plaintext rows the replay has changed, reconstructed from the two before-shares on first use,
+// with the first and last query that touched each.
+template <RingWord R>
+class RowCache {
+    public:
+        explicit RowCache(size_t k) : k_(k) {}
+
+        const R *find(uint32_t row) const {
+            auto it = slot_.find(row);
+            return it == slot_.end() ? nullptr : data_.data() + size_t(it->second) * k_;
+        }
+
+        // the row, for query q; valid until the next get()
+        R *get(uint32_t row, const R *s0, const R *s1, int q) {
+            auto [it, fresh] = slot_.try_emplace(row, static_cast<uint32_t>(rows_.size()));
+            if (fresh) {
+                for (size_t c = 0; c < k_; c++) data_.push_back(s0[c] + s1[c]);
+                rows_.push_back({row, q, q});
+            }
+            rows_[it->second].last = q;
+            return data_.data() + size_t(it->second) * k_;
+        }
+
+        struct Touch { uint32_t row; int first, last; };
+        const std::vector<Touch> &rows() const { return rows_; }
+        const R *data(size_t i) const { return data_.data() + i * k_; }
+
+    private:
+        size_t k_;
+        std::unordered_map<uint32_t, uint32_t> slot_;
+        std::vector<R> data_;
+        std::vector<Touch> rows_;
+};
+
+// The values one party traced for one query (trace.hpp), as far as the check uses them.
+template <RingWord R>
+struct TracedQuery {
+    std::vector<R> read, item_update; // "v_j_share (unmasked)", "Item update share"
+    R inner = 0;                      // "Inner product share"
+    bool has_inner = false;
+};
+
+// One party's trace, read as a stream. The blocks come in completion order (with --sessions that is not
+// query order), so blocks ahead of the replay are kept until it asks for them.
+template <RingWord R>
+class TraceStream {
+    public:
+        TraceStream(const std::string &path, int role) : path_(path), role_(role), buf_(1 << 20) {
+            in_.rdbuf()->pubsetbuf(buf_.data(), static_cast<std::streamsize>(buf_.size()));
+            in_.open(path, std::ios::binary);
+            if (!in_) throw std::runtime_error("cannot open trace " + path);
+            char magic[sizeof(trace_magic)];
+            read(magic, sizeof(magic));
+            if (std::memcmp(magic, trace_magic, sizeof(magic)) != 0 || u32() != trace_version) throw std::runtime_error(path + " is not a trace of this version");
+            if (u32() != sizeof(R)) throw std::runtime_error("trace " + path + " was written by a build with another ring width");
+        }
+
+        TracedQuery<R> take(int q) {
+            while (!ahead_.contains(q) || cur_ == q) { // q's block is complete once the next one has begun
+                if (!next_block()) throw std::runtime_error("trace " + path_ + " has no block for query " + std::to_string(q) + " (was it written with MPC_TRACE_LEVEL >= 1?)");
+            }
+            auto node = ahead_.extract(q);
+            return std::move(node.mapped());
+        }
+
+    private:
+        // Reads up to the end of the next query's block; false at the end of the file.
+        bool next_block() {
+            int index = cur_;
+            for (;;) {
+                int tag = in_.get();
+                if (tag == EOF) {
+                    cur_ = -1;
+                    return index >= 0;
+                }
+                std::string name(static_cast<size_t>(in_.get()), '\0');
+                read(name.data(), name.size());
+                switch (static_cast<TraceTag>(tag)) {
+                    case TraceTag::Query: {
+                        int32_t role = i32(), next = i32();
+                        if (role != role_) throw std::runtime_error("trace " + path_ + " is P" + std::to_string(role) + "'s");
+                        ahead_[next];
+                        cur_ = next;
+                        if (index >= 0) return true;
+                        index = next;
+                        break;
+                    }
+                    case TraceTag::Scalar: {
+                        R v = elem();
+                        if (index >= 0 && name == "Inner product share") { ahead_[index].inner = v; ahead_[index].has_inner = true; }
+                        break;
+                    }
+                    case TraceTag::Vector: {
+                        uint32_t len = u32();
+                        std::vector<R> *dst = index < 0 ? nullptr : name == "v_j_share (unmasked)" ? &ahead_[index].read
+                                              : name == "Item update share" ? &ahead_[index].item_update : nullptr;
+                        if (!dst) { skip(size_t(len) * sizeof(R)); break; }
+                        dst->resize(len);
+                        read(dst->data(), size_t(len) * sizeof(R));
+                        break;
+                    }
+                    case TraceTag::Matrix: {
+                        uint32_t rows = u32(), cols = u32();
+                        skip(size_t(rows) * cols * sizeof(R));
+                        break;
+                    }
+                    case TraceTag::Broadcast: {
+                        uint32_t rows = u32();
+                        u32();
+                        skip(size_t(rows) * sizeof(R));
+                        break;
+                    }
+                    default:
+                        throw std::runtime_error("trace " + path_ + ": unknown record tag " + std::to_string(tag));
+                }
+            }
+        }
+
+        void read(void *p, size_t bytes) {
+            if (!in_.read(static_cast<char*>(p), static_cast<std::streamsize>(bytes))) throw std::runtime_error("trace " + path_ + " is truncated");
+        }
+        void skip(size_t bytes) {
+            if (!in_.ignore(static_cast<std::streamsize>(bytes)) || static_cast<size_t>(in_.gcount()) != bytes) throw std::runtime_error("trace " + path_ + " is truncated");
+        }
+        uint32_t u32() { uint32_t v; read(&v, sizeof(v)); return v; }
+        int32_t i32() { int32_t v; read(&v, sizeof(v)); return v; }
+        R elem() { R v; read(&v, sizeof(v)); return v; }
+
+        std::string path_;
+        int role_;
+        std::vector<char> buf_;
+        std::ifstream in_;
+        std::map<int, TracedQuery<R>> ahead_;
+        int cur_ = -1; // query of the block being read
+};
+
+// The first query at which the replay and a trace disagree.
+struct Divergence {
+    int query = INT_MAX;
+    std::string what;
+
+    void note(int q, const std::string &w) {
+        if (q < query) { query = q; what = w; }
+    }
+};
+
+template <RingWord R>
+std::string row_text(const R *row, size_t k) {
+    std::string s;
+    for (size_t c = 0; c < k; c++) s += (c ? " " : "") + ring_to_string(row[c]);
+    return s;
+}
+
+template <RingWord R>
+class Verifier {
+    public:
+        Verifier(const CheckOptions &opt, ShareDump *const (&dumps)[4], std::ostream &report)
+            : opt_(opt), report_(report), b0_(*dumps[0]), b1_(*dumps[1]), a0_(*dumps[2]), a1_(*dumps[3]), pool_(opt.threads),
+              m_(b0_.header().m), n_(b0_.header().n), k_(b0_.header().k), parts_(opt.update_items ? 1 : opt.threads), items_(k_) {
+            for (int p = 0; p < parts_; p++) users_.emplace_back(k_);
+        }
+
+        int run() {
+            replay();
+            size_t bad_u = compare(true), bad_v = compare(false);
+
+            if (first_.query != INT_MAX) {
+                report_ << "first divergent query: " << first_.query << ": " << first_.what << "\n";
+            } else if (suspect_ != INT_MAX) {
+                report_ << "first divergent query: " << suspect_ << " or later (the first to touch a divergent row; "
+                          << "--trace finds the exact one)\n";
+            }
+            bool ok = bad_u == 0 && bad_v == 0 && first_.query == INT_MAX;
+            report_ << (ok ? "OK" : "FAIL") << ": " << queries_ << " queries replayed, m=" << m_ << " n=" << n_ << " k=" << k_
+                      << ", " << 8 * sizeof(R) << "-bit ring, " << opt_.threads << " threads\n";
+            return ok ? 0 : 1;
+        }
+
+    private:
+        struct Query { int index; uint32_t user, item; };
+
+        void replay() {
+            QueryReader q0(opt_.queries[0]), q1(opt_.queries[1]);
+            for (QueryReader *q : {&q0, &q1}) {
+                if (q->m() != int(m_) || q->n() != int(n_) || q->k() != int(k_)) throw std::runtime_error("the query files and the share files have different m, n, k");
+            }
+            if (q0.queries() != q1.queries()) throw std::runtime_error("the two query files hold different numbers of queries");
+            queries_ = q0.queries();
+            std::unique_ptr<TraceStream<R>> t0, t1;
+            if (!opt_.traces[0].empty()) {
+                t0 = std::make_unique<TraceStream<R>>(opt_.traces[0], 0);
+                t1 = std::make_unique<TraceStream<R>>(opt_.traces[1], 1);
+            }
+
+            std::vector<Query> chunk;
+            std::vector<TracedQuery<R>> traced0, traced1;
+            std::vector<Divergence> seen(parts_);
+            for (int start = 0; start < queries_; start += opt_.chunk) {
+                int count = std::min(opt_.chunk, queries_ - start);
+                chunk.resize(count);
+                for (int c = 0; c < count; c++) {
+                    QueryRecord r0 = q0.next(), r1 = q1.next();
+                    if (r0.user != r1.user || r0.user >= m_) throw std::runtime_error("query " + std::to_string(start + c) + ": the query files disagree on the user, or it is out of range");
+                    int64_t j = (int64_t(r0.item_share) + r1.item_share) % int64_t(n_);
+                    chunk[c] = {start + c, r0.user, static_cast<uint32_t>(j < 0 ? j + n_ : j)};
+                }
+                if (t0) {
+                    traced0.resize(count);
+                    traced1.resize(count);
+                    for (int c = 0; c < count; c++) {
+                        traced0[c] = t0->take(start + c);
+                        traced1[c] = t1->take(start + c);
+                    }
+                }
+                const TracedQuery<R> *tr0 = t0 ? traced0.data() : nullptr, *tr1 = t1 ? traced1.data() : nullptr;
+                if (opt_.update_items) {
+                    for (const Query &q : chunk) {
+                        if (q.index % opt_.batch == 0) apply_item_writes();
+                        step(q, users_[0], tr0 ? &tr0[q.index - start] : nullptr, tr1 ? &tr1[q.index - start] : nullptr, seen[0]);
+                    }
+                } else {
+                    // users are independent: partition p replays the users u with u % parts == p, in query order
+                    pool_.parallel_for(0, parts_, 1, [&](size_t lo, size_t hi) {
+                        for (size_t p = lo; p < hi; p++) {
+                            for (const Query &q : chunk) {
+                                if (q.user % parts_ != p) continue;
+                                step(q, users_[p], tr0 ? &tr0[q.index - start] : nullptr, tr1 ? &tr1[q.index - start] : nullptr, seen[p]);
+                            }
+                        }
+                    });
+                }
+            }
+            apply_item_writes();
+            for (const auto &d : seen) first_.note(d.query, d.what);
+        }
+
+        // One query: the read of v_j, delta = 1 - <u_i, v_j>, the item update u_i * delta (applied after the
+        // batch) and u_i += v_j * delta, checked against the traces where given.
+        void step(const Query &q, RowCache<R> &users, const TracedQuery<R> *tr0, const TracedQuery<R> *tr1, Divergence &seen) {
+            const size_t k = k_;
+            std::vector<R> v(k);
+            if (opt_.update_items) {
+                const R *row = items_.get(q.item, b0_.template v<R>(q.item), b1_.template v<R>(q.item), q.index);
+                std::copy(row, row + k, v.begin());
+            } else {
+                const R *s0 = b0_.template v<R>(q.item), *s1 = b1_.template v<R>(q.item);
+                for (size_t c = 0; c < k; c++) v[c] = s0[c] + s1[c];
+            }
+            R *u = users.get(q.user, b0_.template u<R>(q.user), b1_.template u<R>(q.user), q.index);
+            R inner = ring_dot(u, v.data(), k), delta = R(1) - inner;
+
+            if (tr0 && seen.query == INT_MAX) {
+                auto sum_is = [&](const std::vector<R> &x, const std::vector<R> &y, const std::vector<R> &want) {
+                    if (x.size() != k || y.size() != k) return false;
+                    for (size_t c = 0; c < k; c++) if (R(x[c] + y[c]) != want[c]) return false;
+                    return true;
+                };
+                std::vector<R> item_update(k);
+                for (size_t c = 0; c < k; c++) item_update[c] = u[c] * delta;
+                if (!tr0->read.empty() && !sum_is(tr0->read, tr1->read, v)) {
+                    seen.note(q.index, "the read of v_" + std::to_string(q.item) + " differs: expected " + row_text(v.data(), k));
+                } else if (tr0->has_inner && R(tr0->inner + tr1->inner) != inner) {
+                    seen.note(q.index, "<u_" + std::to_string(q.user) + ", v_" + std::to_string(q.item) + "> differs: expected " + ring_to_string(inner));
+                } else if (!tr0->item_update.empty() && !sum_is(tr0->item_update, tr1->item_update, item_update)) {
+                    seen.note(q.index, "the update of v_" + std::to_string(q.item) + " differs: expected " + row_text(item_update.data(), k));
+                }
+            }
+            if (opt_.update_items) {
+                pending_.push_back({q.item, q.index});
+                for (size_t c = 0; c < k; c++) pending_delta_.push_back(u[c] * delta);
+            }
+            for (size_t c = 0; c < k; c++) u[c] += v[c] * delta;
+        }
+
+        // --update-items: a batch's reads all see V as it was before the batch, so its writes land after it
+        void apply_item_writes() {
+            for (size_t w = 0; w < pending_.size(); w++) {
+                auto [j, q] = pending_[w];
+                R *row = items_.get(j, b0_.template v<R>(j), b1_.template v<R>(j), q);
+                for (size_t c = 0; c < k_; c++) row[c] += pending_delta_[w * k_ + c];
+            }
+            pending_.clear();
+            pending_delta_.clear();
+        }
+
+        // All rows of one matrix: a row the replay touched must equal its replayed value, every other row
+        // the sum of its before-shares. One pass over the four mappings, row runs in parallel; a run whose
+        // after- and before-sums agree everywhere is settled with one vectorized loop.
+        size_t compare(bool users) {
+            const char *name = users ? "U" : "V";
+            const size_t k = k_, rows = users ? m_ : n_, grain = row_grain(k);
+            auto row = [&](const ShareDump &d, size_t r) { return users ? d.template u<R>(r) : d.template v<R>(r); };
+            auto cache_of = [&](size_t r) -> const RowCache<R>& { return users ? users_[r % parts_] : items_; };
+            struct Found { size_t count = 0; size_t first = SIZE_MAX; };
+            std::vector<Found> found(ThreadPool::chunk_count(0, rows, grain));
+            pool_.parallel_for_chunks(0, rows, grain, [&](size_t chunk, size_t lo, size_t hi) {
+                const R *s0 = row(b0_, lo), *s1 = row(b1_, lo), *t0 = row(a0_, lo), *t1 = row(a1_, lo);
+                R changed = 0;
+                for (size_t i = 0, end = (hi - lo) * k; i < end; i++) changed |= R(t0[i] + t1[i]) ^ R(s0[i] + s1[i]);
+                Found &f = found[chunk];
+                for (size_t r = lo; r < hi; r++) {
+                    // an unchanged row can only be wrong where the replay changed it
+                    const R *e = cache_of(r).find(static_cast<uint32_t>(r));
+                    if (changed == 0 && !e) continue;
+                    size_t o = (r - lo) * k;
+                    R diff = 0;
+                    for (size_t c = 0; c < k; c++) diff |= R(t0[o + c] + t1[o + c]) ^ (e ? e[c] : R(s0[o + c] + s1[o + c]));
+                    if (diff != 0) {
+                        f.count++;
+                        f.first = std::min(f.first, r);
+                    }
+                }
+            });
+            Found all;
+            for (const Found &f : found) { all.count += f.count; all.first = std::min(all.first, f.first); }
+            if (all.count == 0) return 0;
+
+            size_t r = all.first;
+            const RowCache<R> &rc = cache_of(r);
+            const R *e = rc.find(static_cast<uint32_t>(r));
+            std::vector<R> expected(k), actual(k);
+            for (size_t c = 0; c < k; c++) {
+                expected[c] = e ? e[c] : R(row(b0_, r)[c] + row(b1_, r)[c]);
+                actual[c] = row(a0_, r)[c] + row(a1_, r)[c];
+            }
+            report_ << name << ": " << all.count << " of " << rows << " rows differ; the first is row " << r;
+            for (const auto &t : rc.rows()) {
+                if (t.row == r) report_ << " (touched by queries " << t.first << " .. " << t.last << ")";
+            }
+            report_ << "\n  expected " << row_text(expected.data(), k) << "\n  got      " << row_text(actual.data(), k) << "\n";
+
+            // the earliest query that touched a divergent row
+            for (int p = 0; p < (users ? parts_ : 1); p++) {
+                const RowCache<R> &c = users ? users_[p] : items_;
+                for (size_t i = 0; i < c.rows().size(); i++) {
+                    const auto &t = c.rows()[i];
+                    if (t.first >= suspect_) continue;
+                    const R *d = c.data(i), *x0 = row(a0_, t.row), *x1 = row(a1_, t.row);
+                    for (size_t col = 0; col < k; col++) {
+                        if (R(x0[col] + x1[col]) != d[col]) { suspect_ = t.first; break; }
+                    }
+                }
+            }
+            return all.count;
+        }
+
+        const CheckOptions &opt_;
+        std::ostream &report_;
+        const ShareDump &b0_, &b1_, &a0_, &a1_;
+        ThreadPool pool_;
+        uint32_t m_, n_, k_;
+        int parts_;
+        std::vector<RowCache<R>> users_; // one per partition
+        RowCache<R> items_;              // --update-items only
+        std::vector<std::pair<uint32_t, int>> pending_; // item writes of the current batch: row and query,
+        std::vector<R> pending_delta_;                   // and the updates, k each
+        int queries_ = 0;
+        Divergence first_;
+        int suspect_ = INT_MAX;
+};
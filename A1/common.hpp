@@ -3,12 +3,25 @@
 #include <boost/asio.hpp>
 #include <boost/asio/awaitable.hpp>
 #include <boost/asio/use_awaitable.hpp>
+#include <boost/version.hpp>
+#if BOOST_VERSION >= 107700
+#include <boost/asio/experimental/awaitable_operators.hpp>
+#endif
+#include <atomic>
+#include <exception>
+#include <memory>
 #include <iostream>
 #include <random>
 #include <cstdint>
 #include <vector>
 #include <string>
 #include <fstream>
+#include <span>
+#include "matrix.hpp"
+#include "prg.hpp"
+#include "kernels.hpp"
+#include "ring.hpp"
+#include "thread_pool.hpp"
 
 using boost::asio::awaitable;
 using boost::asio::co_spawn;
@@ -31,173 +44,346 @@ namespace this_coro = boost::asio::this_coro;
 
 // ---------------------- Random utilities ----------------------
 
-// Random int in [lo, hi]
+// Random int in [lo, hi] from the calling thread's PRG stream (see prg.hpp)
 inline int32_t rand_int(int32_t lo = 0, int32_t hi = 10) {
     if (lo > hi) std::swap(lo, hi);
-    static std::random_device rd;
-    static std::mt19937 mt(rd());
-    std::uniform_int_distribution<int32_t> d(lo, hi);
-    return d(mt);
+    return thread_rng().uniform(lo, hi);
 }
 
-// Fill a 2D int32_t matrix with random small ints (for testing)
-inline void fill_random(std::vector<std::vector<int32_t>>& mat, int32_t lo = 0, int32_t hi = 5) {
-    for (auto &row : mat) {
-        for (auto &x : row) x = rand_int(lo, hi);
-    }
+// Fill a flat run of ring elements with random small ints, in bulk. Only for plaintext test values
+// (the initial U and V); anything that masks or splits a value is drawn with random_ring.
+template <RingWord R>
+inline void fill_random(std::span<R> vals, int32_t lo = 0, int32_t hi = 5) {
+    if (lo > hi) std::swap(lo, hi);
+    thread_rng().fill_range(vals, lo, hi);
+}
+
+template <RingWord R>
+inline void fill_random(std::vector<R>& vals, int32_t lo = 0, int32_t hi = 5) {
+    fill_random(std::span<R>(vals), lo, hi);
+}
+
+// Fill a whole matrix with random small ints (for testing)
+template <RingWord R>
+inline void fill_random(Matrix<R>& mat, int32_t lo = 0, int32_t hi = 5) {
+    fill_random(mat.flat(), lo, hi);
+}
+
+// Uniform ring elements over all of Z_2^w, from the calling thread's PRG stream: masks, blinds,
+// correction terms and share splits.
+template <RingWord R>
+inline void random_ring(std::span<R> vals) {
+    thread_rng().fill_ring(vals);
+}
+
+template <RingWord R>
+inline void random_ring(std::vector<R>& vals) {
+    random_ring(std::span<R>(vals));
+}
+
+template <RingWord R>
+inline void random_ring(Matrix<R>& mat) {
+    random_ring(mat.flat());
 }
 
 // ---------------------- Linear algebra helpers ----------------------
+// Shares live in Z_2^w (ring.hpp): the products and sums below wrap, and the heavy ones run on the
+// SIMD kernels of kernels.hpp. The ring is not deduced from vectors, so call them as dot_prod<R>(...).
 
-// dot product (returns int64_t to reduce overflow chance)
-inline int64_t dot_prod(const std::vector<int32_t>& a, const std::vector<int32_t>& b) {
+// dot product in the ring
+template <RingWord R>
+inline R dot_prod(std::span<const R> a, std::span<const R> b) {
     if (a.size() != b.size()) throw std::invalid_argument("dot_prod: size mismatch");
-    int64_t s = 0;
-    for (size_t i=0;i<a.size();++i) s += static_cast<int64_t>(a[i]) * b[i];
-    return s;
+    return ring_dot(a.data(), b.data(), a.size());
 }
 
 // elementwise add two vectors -> new vector
-inline std::vector<int32_t> vec_add(const std::vector<int32_t>& a, const std::vector<int32_t>& b) {
+template <RingWord R>
+inline std::vector<R> vec_add(std::span<const R> a, std::span<const R> b) {
     if (a.size() != b.size()) throw std::invalid_argument("vec_add: size mismatch");
-    std::vector<int32_t> out(a.size());
+    std::vector<R> out(a.size());
     for (size_t i=0;i<a.size();++i) out[i] = a[i] + b[i];
     return out;
 }
 
-inline std::vector<int32_t> vec_sub(const std::vector<int32_t>& a, const std::vector<int32_t>& b) {
+template <RingWord R>
+inline std::vector<R> vec_sub(std::span<const R> a, std::span<const R> b) {
     if (a.size() != b.size()) throw std::invalid_argument("vec_add: size mismatch");
-    std::vector<int32_t> out(a.size());
+    std::vector<R> out(a.size());
     for (size_t i=0;i<a.size();++i) out[i] = a[i] - b[i];
     return out;
 }
 
 // rotate right for positive shift, left for negative shift
-inline std::vector<int32_t> rotate_cyclic(const std::vector<int32_t>& v, int shift) {
+template <typename T>
+inline std::vector<T> rotate_cyclic(const std::vector<T>& v, int shift) {
     int n = static_cast<int>(v.size());
     if (n == 0) return {};
     // normalize shift to [0, n-1]
     shift = ((shift % n) + n) % n;
-    std::vector<int32_t> out(n);
+    std::vector<T> out(n);
     for (int i = 0; i < n; ++i) out[(i + shift) % n] = v[i];
     return out;
 }
 
 // get column from matrix (copy)
-inline std::vector<int32_t> column_of(const std::vector<std::vector<int32_t>>& mat, size_t col) {
+template <typename T>
+inline std::vector<T> column_of(const Matrix<T>& mat, size_t col) {
     if (mat.empty()) return {};
-    if (col >= mat[0].size()) throw std::out_of_range("column_of: col out of range");
-    std::vector<int32_t> c(mat.size());
-    for (size_t i=0;i<mat.size();++i) c[i] = mat[i][col];
-    return c;
+    return mat.col(col).to_vector();
 }
 
 // get row from matrix (copy)
-inline std::vector<int32_t> row_of(const std::vector<std::vector<int32_t>>& mat, size_t row) {
-    if (row >= mat.size()) throw std::out_of_range("row_of: row out of range");
-    return mat[row];
+template <typename T>
+inline std::vector<T> row_of(const Matrix<T>& mat, size_t row) {
+    auto r = mat.row(row);
+    return std::vector<T>(r.begin(), r.end());
 }
 
-// produce additive shares of integer v (two shares s0,s1 with s0+s1 = v)
+// Index shares (alpha, the item index, the rotation) are 32-bit and add mod 2^32: a share is uniform
+// over all of int32, and a sum or difference of shares that fits in an int32 (e.g. j - alpha) comes
+// out exact. index_add / index_sub wrap instead of overflowing.
+inline int32_t index_add(int32_t a, int32_t b) { return static_cast<int32_t>(static_cast<uint32_t>(a) + static_cast<uint32_t>(b)); }
+inline int32_t index_sub(int32_t a, int32_t b) { return static_cast<int32_t>(static_cast<uint32_t>(a) - static_cast<uint32_t>(b)); }
+
+// produce additive shares of integer v (two shares s0,s1 with s0+s1 = v mod 2^32); used for index shares
 inline std::pair<int32_t,int32_t> make_additive_shares_int(int32_t v) {
-    int32_t s0 = static_cast<int32_t>(rand_int());
-    int32_t s1 = v - s0;
-    return {s0, s1};
+    int32_t s0 = static_cast<int32_t>(thread_rng().next_u32());
+    return {s0, index_sub(v, s0)};
 }
 
 // produce additive shares of standard basis vector e_k of length n
-inline std::pair<std::vector<int32_t>, std::vector<int32_t>> make_basis_vector_shares(size_t n, size_t k) {
-    std::vector<int32_t> a(n), b(n);
-    for (size_t i=0;i<n;++i) {
-        if (i == k) {
-            auto p = make_additive_shares_int(1);
-            a[i] = p.first; b[i] = p.second;
-        } else {
-            auto p = make_additive_shares_int(0);
-            a[i] = p.first; b[i] = p.second;
-        }
-    }
+template <RingWord R>
+inline std::pair<std::vector<R>, std::vector<R>> make_basis_vector_shares(size_t n, size_t k) {
+    std::vector<R> a(n), b(n);
+    random_ring(a);
+    for (size_t i=0;i<n;++i) b[i] = R(i == k ? 1 : 0) - a[i];
     return {a,b};
 }
 
 // compute v_masked dot e_i-like share retrieval (sum over rows)
-inline std::vector<int32_t> compute_v_share(const std::vector<int32_t>& e_i, const std::vector<std::vector<int32_t>>& V_masked) {
-    size_t n = V_masked.size();
+template <RingWord R>
+inline std::vector<R> compute_v_share(std::span<const R> e_i, MatrixView<const R> V_masked) {
+    size_t n = V_masked.rows();
     if (e_i.size() != n) throw std::invalid_argument("vector_lookup_by_indicator: size mismatch");
     if (n == 0) return {};
-    size_t k = V_masked[0].size();
-    std::vector<int32_t> out(k, 0);
-    for (size_t i=0;i<n;++i) {
-        for (size_t j=0;j<k;++j) out[j] += e_i[i] * V_masked[i][j];
+    std::vector<R> out(V_masked.cols(), 0);
+    ring_weighted_rows(e_i.data(), V_masked.data(), n, V_masked.cols(), out.data());
+    return out;
+}
+
+// column-wise dot product of two n x k matrices: out[c] = sum_r A[r][c] * B[r][c]
+template <RingWord R>
+inline std::vector<R> colwise_dot(MatrixView<const R> A, MatrixView<const R> B) {
+    if (A.rows() != B.rows() || A.empty() || A.cols() != B.cols()) {
+        throw std::invalid_argument("Matrix dimensions must match for column-wise dot product.");
     }
+    std::vector<R> out(A.cols(), 0);
+    ring_colwise_dot(A.data(), B.data(), A.rows(), A.cols(), out.data());
     return out;
 }
 
+// rows per parallel chunk for an n x k pass (about 16K elements per chunk)
+inline size_t row_grain(size_t k) { return std::max<size_t>(1, 16384 / std::max<size_t>(k, 1)); }
+
+// The local side of one read in a single pass over the rows (see FusedRead in kernels.hpp):
+// v_j_masked = <e_j, V_masked> (skipped when v_j_masked is null) and
+// r_share = colwise_dot(e_j matrix, y_dash' + r) - colwise_dot(y_n, x_dash'), before adding gamma.
+// With a pool the rows are split into fixed chunks whose partial sums are added in chunk order.
+template <RingWord R>
+inline void fused_read(std::span<const R> e_j, MatrixView<const R> v_masked,
+                       MatrixView<const R> y_dash, MatrixView<const R> r,
+                       MatrixView<const R> y_n, MatrixView<const R> x_dash,
+                       std::vector<R>* v_j_masked, std::vector<R>& r_share,
+                       ThreadPool* pool = nullptr) {
+    size_t n = y_dash.rows(), k = y_dash.cols();
+    if (e_j.size() != n || r.rows() != n || y_n.rows() != n || x_dash.rows() != n) {
+        throw std::invalid_argument("fused_read: size mismatch");
+    }
+    r_share.assign(k, 0);
+    if (v_j_masked) v_j_masked->assign(k, 0);
+    auto rows = [&](size_t lo, size_t hi, R* v_j, R* rs) {
+        size_t o = lo * k;
+        FusedRead<R> f{e_j.data() + lo, v_j_masked ? v_masked.data() + o : nullptr,
+                       y_dash.data() + o, r.data() + o, y_n.data() + o, x_dash.data() + o,
+                       hi - lo, k, v_j, rs};
+        ring_fused_read(f);
+    };
+    size_t grain = row_grain(k);
+    size_t chunks = ThreadPool::chunk_count(0, n, grain);
+    if (!pool || pool->size() == 1 || chunks <= 1) {
+        rows(0, n, v_j_masked ? v_j_masked->data() : nullptr, r_share.data());
+        return;
+    }
+    std::vector<R> partial(chunks * 2 * k);
+    pool->parallel_for_chunks(0, n, grain, [&](size_t c, size_t lo, size_t hi) {
+        rows(lo, hi, partial.data() + c * 2 * k, partial.data() + c * 2 * k + k);
+    });
+    for (size_t c = 0; c < chunks; ++c) {
+        const R* p = partial.data() + c * 2 * k;
+        for (size_t i = 0; i < k; ++i) {
+            if (v_j_masked) (*v_j_masked)[i] += p[i];
+            r_share[i] += p[k + i];
+        }
+    }
+}
+
 // ---------------------- Networking helpers (send/recv) ----------------------
+// Elements go over the wire as their raw bytes, so a ring element takes sizeof(R) bytes.
 
 // Send a single 32-bit integer
-awaitable<void> send_int32(tcp::socket& sock, int32_t v) {
+template <typename Stream>
+awaitable<void> send_int32(Stream& sock, int32_t v) {
     co_await boost::asio::async_write(sock, boost::asio::buffer(&v, sizeof(v)), use_awaitable);
     co_return;
 }
 
 // Receive a single 32-bit integer
-awaitable<void> recv_int32(tcp::socket& sock, int32_t& out) {
+template <typename Stream>
+awaitable<void> recv_int32(Stream& sock, int32_t& out) {
     co_await boost::asio::async_read(sock, boost::asio::buffer(&out, sizeof(out)), use_awaitable);
     co_return;
 }
 
-// Send a 1D vector<int32_t> as raw bytes (caller must ensure size is known by receiver)
-awaitable<void> send_vector1d(tcp::socket& sock, const std::vector<int32_t>& v) {
+// Send a 1D vector as raw bytes (caller must ensure size is known by receiver)
+template <typename Stream, typename T>
+awaitable<void> send_vector1d(Stream& sock, const std::vector<T>& v) {
     if (!v.empty()) {
-        co_await boost::asio::async_write(sock, boost::asio::buffer(v.data(), v.size() * sizeof(int32_t)), use_awaitable);
+        co_await boost::asio::async_write(sock, boost::asio::buffer(v.data(), v.size() * sizeof(T)), use_awaitable);
     }
     co_return;
 }
 
-// Receive a 1D vector<int32_t> into pre-sized buffer
-awaitable<void> recv_vector1d(tcp::socket& sock, std::vector<int32_t>& v) {
+// Receive a 1D vector into pre-sized buffer
+template <typename Stream, typename T>
+awaitable<void> recv_vector1d(Stream& sock, std::vector<T>& v) {
     if (!v.empty()) {
-        co_await boost::asio::async_read(sock, boost::asio::buffer(v.data(), v.size() * sizeof(int32_t)), use_awaitable);
+        co_await boost::asio::async_read(sock, boost::asio::buffer(v.data(), v.size() * sizeof(T)), use_awaitable);
     }
     co_return;
 }
 
-// Send 2D matrix row-by-row (assumes rows are contiguous)
-awaitable<void> send_vector2d(tcp::socket& sock, const std::vector<std::vector<int32_t>>& mat) {
-    for (const auto &row : mat) {
-        if (!row.empty()) {
-            co_await boost::asio::async_write(sock, boost::asio::buffer(row.data(), row.size() * sizeof(int32_t)), use_awaitable);
-        }
+// Send a whole matrix as one contiguous block (receiver must know the shape)
+template <typename Stream, typename T>
+awaitable<void> send_matrix(Stream& sock, MatrixView<const T> mat) {
+    if (!mat.empty()) {
+        co_await boost::asio::async_write(sock, boost::asio::buffer(mat.data(), mat.size_bytes()), use_awaitable);
     }
     co_return;
 }
 
-// Receive 2D matrix row-by-row into pre-sized matrix
-awaitable<void> recv_vector2d(tcp::socket& sock, std::vector<std::vector<int32_t>>& mat) {
-    for (auto &row : mat) {
-        if (!row.empty()) {
-            co_await boost::asio::async_read(sock, boost::asio::buffer(row.data(), row.size() * sizeof(int32_t)), use_awaitable);
-        }
+// Receive a whole matrix into a pre-sized matrix with one read
+template <typename Stream, typename T>
+awaitable<void> recv_matrix(Stream& sock, MatrixView<T> mat) {
+    if (!mat.empty()) {
+        co_await boost::asio::async_read(sock, boost::asio::buffer(mat.data(), mat.size_bytes()), use_awaitable);
     }
     co_return;
 }
 
+// Full-duplex exchange with the peer: the write of `out` and the read into `in` are in flight at the
+// same time, so the two directions overlap and neither side depends on socket buffers to hold a whole
+// message while it waits to start reading. Both parties must call it with mirrored sizes.
+// The general form gathers `out` from a buffer sequence and runs `read`, a coroutine doing this side's
+// reads (Round reads a header, checks it, then scatters the rest), alongside the write.
+// With Boost >= 1.77 the two are a parallel awaitable group (awaitable_operators: a failure of one
+// cancels the other). Older Boost has no operators, so the two completions meet in a join whose atomic
+// count lets them finish on any thread; the coroutine resumes on its own executor once both are done.
+#if BOOST_VERSION < 107700
+namespace exchange_detail {
+template <typename Handler>
+struct Join {
+    explicit Join(Handler h) : handler(std::move(h)) {}
+
+    void done() {
+        if (pending.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+        std::exception_ptr e = read_error;
+        if (!e && write_ec) e = std::make_exception_ptr(boost::system::system_error(write_ec));
+        auto ex = boost::asio::get_associated_executor(handler);
+        boost::asio::dispatch(ex, [h = std::move(handler), e]() mutable { h(e); });
+    }
+
+    Handler handler;
+    std::atomic<int> pending{2};
+    std::exception_ptr read_error;
+    boost::system::error_code write_ec;
+};
+} // namespace exchange_detail
+#endif
+
+template <typename Stream, typename ConstBuffers>
+awaitable<void> exchange(Stream& sock, const ConstBuffers& out, awaitable<void> read) {
+#if BOOST_VERSION >= 107700
+    using namespace boost::asio::experimental::awaitable_operators;
+    co_await (boost::asio::async_write(sock, out, use_awaitable) && std::move(read));
+#else
+    auto start = [&sock, &out, &read](auto handler) {
+        auto join = std::make_shared<exchange_detail::Join<decltype(handler)>>(std::move(handler));
+        boost::asio::async_write(sock, out, [join](boost::system::error_code ec, size_t) {
+            join->write_ec = ec;
+            join->done();
+        });
+        co_spawn(sock.get_executor(), std::move(read), [join, &sock](std::exception_ptr e) {
+            if (e) {
+                join->read_error = e;
+                try {
+                    sock.cancel(); // a write still in flight would wait for a reader that is gone
+                } catch (const boost::system::system_error&) {
+                }
+            }
+            join->done();
+        });
+    };
+    co_await boost::asio::async_initiate<decltype(use_awaitable), void(std::exception_ptr)>(start, use_awaitable);
+#endif
+    co_return;
+}
+
+template <typename Stream>
+awaitable<void> read_all(Stream& sock, boost::asio::mutable_buffer in) {
+    co_await boost::asio::async_read(sock, in, use_awaitable);
+    co_return;
+}
+
+template <typename Stream, typename T>
+awaitable<void> exchange(Stream& sock, std::span<const T> out, std::span<T> in) {
+    auto out_buf = boost::asio::buffer(out.data(), out.size_bytes());
+    co_await exchange(sock, out_buf, read_all(sock, boost::asio::buffer(in.data(), in.size_bytes())));
+    co_return;
+}
+
+template <typename Stream, typename T>
+awaitable<void> exchange(Stream& sock, const std::vector<T>& out, std::vector<T>& in) {
+    co_await exchange(sock, std::span<const T>(out), std::span<T>(in));
+    co_return;
+}
+
+template <typename Stream, typename T>
+awaitable<void> exchange(Stream& sock, MatrixView<const T> out, MatrixView<T> in) {
+    co_await exchange(sock, std::span<const T>(out.flat()), in.flat());
+    co_return;
+}
+
+template <typename Stream, typename T>
+awaitable<void> exchange(Stream& sock, const Matrix<T>& out, Matrix<T>& in) {
+    co_await exchange(sock, out.flat(), in.flat());
+    co_return;
+}
+
 // ---------------------- Debug helpers ----------------------
 
-inline void print_vector(const std::vector<int32_t>& v, const std::string& name="") {
+template <RingWord R>
+inline void print_vector(const std::vector<R>& v, const std::string& name="") {
     if (!name.empty()) std::cout << name << " : ";
-    for (auto x : v) std::cout << x << " ";
+    for (auto x : v) std::cout << ring_to_string(x) << " ";
     std::cout << std::endl;
 }
 
-inline void print_matrix(const std::vector<std::vector<int32_t>>& mat, const std::string& name="") {
-    if (!name.empty()) std::cout << name << " (" << mat.size() << "x" << (mat.empty()?0:mat[0].size()) << ")\n";
-    for (const auto& row : mat) {
-        for (auto x : row) std::cout << x << " ";
+template <RingWord R>
+inline void print_matrix(const Matrix<R>& mat, const std::string& name="") {
+    if (!name.empty()) std::cout << name << " (" << mat.rows() << "x" << mat.cols() << ")\n";
+    for (size_t i = 0; i < mat.rows(); ++i) {
+        for (auto x : mat[i]) std::cout << ring_to_string(x) << " ";
         std::cout << "\n";
     }
 }
-
-
-
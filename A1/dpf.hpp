@@ -0,0 +1,208 @@
+#pragma once
+// Two-party distributed point function (Boyle-Gilboa-Ishai tree construction) for the oblivious read.
+//
+// dpf_gen(n, alpha) gives two keys of O(log n) words; each party expands its key over the whole domain
+// into an additive share of the standard basis vector e_alpha (length n). This replaces the length-n
+// e_alpha share that P2 used to send with every query.
+//
+// The tree stops early: every leaf is converted into a block of dpf_leaf_width outputs, so the
+// depth is ceil(log2(n / 16)) and the last correction word is a whole output block. Tree nodes
+// are expanded level by level through prg_detail::keyed_blocks, which hashes 8/16 node seeds per
+// SIMD call, and the leaves are handed to the caller in chunks as they are converted.
+//
+// Outputs are elements of the ring R (ring.hpp). A leaf is converted with one keyed block per 32-bit
+// word of R (block j gives word j of all 16 outputs), so Z_2^32 keys are exactly as before.
+//
+// Key layout (uint32 words): root seed (4), then per level the seed correction (4) and the two
+// control-bit corrections (1 word, bit 0 = left, bit 1 = right), then the output correction
+// (16 ring elements, ring_words<R> words each, least significant first).
+// The control bit of the root is the party id, so it is not stored.
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <vector>
+#include "prg.hpp"
+#include "ring.hpp"
+
+constexpr size_t dpf_leaf_width = 16; // outputs per leaf = words of one ChaCha block
+
+// number of tree levels for a domain of n outputs
+inline int dpf_depth(size_t n) {
+    int depth = 0;
+    while ((dpf_leaf_width << depth) < n) ++depth;
+    return depth;
+}
+
+// number of uint32 words of one key with outputs of out_words words (ring_words<R>)
+inline size_t dpf_key_words(size_t n, size_t out_words = 1) {
+    return 4 + 5 * static_cast<size_t>(dpf_depth(n)) + dpf_leaf_width * out_words;
+}
+
+using DpfSeed = std::array<uint32_t, 4>;
+
+namespace dpf_detail {
+constexpr uint32_t node_domain = 0; // keyed_blocks stream for the seed/control-bit expansion
+constexpr uint32_t leaf_domain = 1; // keyed_blocks streams leaf_domain + j for word j of the outputs
+
+// G(s) = (s_L, t_L, s_R, t_R) from one block: words 0-3 / 4-7 are the child seeds, bit 0 of
+// words 8 / 9 the child control bits.
+inline void expand_node(const DpfSeed& s, DpfSeed& left, uint32_t& t_left, DpfSeed& right, uint32_t& t_right) {
+    uint32_t block[16];
+    prg_detail::keyed_blocks(s.data(), 1, node_domain, block);
+    std::copy(block, block + 4, left.begin());
+    std::copy(block + 4, block + 8, right.begin());
+    t_left = block[8] & 1;
+    t_right = block[9] & 1;
+}
+
+// the dpf_leaf_width outputs of `count` leaves with seeds back to back
+template <RingWord R>
+inline void convert_leaves(const uint32_t* seeds, size_t count, R* out, std::vector<uint32_t>& blocks) {
+    constexpr size_t words = ring_words<R>;
+    blocks.resize(16 * count * words);
+    for (size_t j = 0; j < words; ++j) prg_detail::keyed_blocks(seeds, count, leaf_domain + j, blocks.data() + 16 * count * j);
+    for (size_t i = 0; i < 16 * count; ++i) {
+        uint32_t w[words];
+        for (size_t j = 0; j < words; ++j) w[j] = blocks[16 * count * j + i];
+        out[i] = ring_from_words<R>(w);
+    }
+}
+} // namespace dpf_detail
+
+// One party's key; both keys of a pair share everything except the root seed.
+class DpfKey {
+    public:
+        DpfKey() = default;
+        explicit DpfKey(size_t n, size_t out_words = 1)
+            : n_(n), depth_(dpf_depth(n)), out_words_(out_words), words_(dpf_key_words(n, out_words)) {}
+
+        size_t domain() const { return n_; }
+        size_t out_words() const { return out_words_; }
+        int depth() const { return depth_; }
+        std::span<uint32_t> words() { return words_; }
+        std::span<const uint32_t> words() const { return words_; }
+
+        uint32_t* root() { return words_.data(); }
+        const uint32_t* root() const { return words_.data(); }
+        uint32_t* seed_cw(int level) { return words_.data() + 4 + 5 * level; }
+        const uint32_t* seed_cw(int level) const { return words_.data() + 4 + 5 * level; }
+        uint32_t& t_cw(int level) { return words_[4 + 5 * level + 4]; }
+        uint32_t t_cw(int level) const { return words_[4 + 5 * level + 4]; }
+        uint32_t* leaf_cw() { return words_.data() + 4 + 5 * depth_; }
+        const uint32_t* leaf_cw() const { return words_.data() + 4 + 5 * depth_; }
+
+    private:
+        size_t n_ = 0;
+        int depth_ = 0;
+        size_t out_words_ = 1;
+        std::vector<uint32_t> words_;
+};
+
+// Keys for the point function that is 1 at alpha and 0 elsewhere on [0, n).
+// Root seeds are drawn from the calling thread's generator.
+template <RingWord R>
+inline std::pair<DpfKey, DpfKey> dpf_gen(size_t n, size_t alpha) {
+    if (alpha >= n) throw std::invalid_argument("dpf_gen: alpha out of range");
+    DpfKey k0(n, ring_words<R>), k1(n, ring_words<R>);
+    DpfSeed s[2];
+    uint32_t t[2] = {0, 1};
+    for (auto& seed : s) thread_rng().fill(std::span<uint32_t>(seed.data(), seed.size()));
+    std::copy(s[0].begin(), s[0].end(), k0.root());
+    std::copy(s[1].begin(), s[1].end(), k1.root());
+
+    const int depth = k0.depth();
+    const size_t leaf = alpha / dpf_leaf_width;
+    for (int level = 0; level < depth; ++level) {
+        const uint32_t bit = (leaf >> (depth - 1 - level)) & 1; // path to alpha, most significant bit first
+        DpfSeed child[2][2];
+        uint32_t tc[2][2];
+        for (int b = 0; b < 2; ++b) dpf_detail::expand_node(s[b], child[b][0], tc[b][0], child[b][1], tc[b][1]);
+        // the "lose" children of both parties get equal seeds and control bits after correction
+        uint32_t* scw = k0.seed_cw(level);
+        for (int w = 0; w < 4; ++w) scw[w] = child[0][1 - bit][w] ^ child[1][1 - bit][w];
+        uint32_t tcw[2] = {tc[0][0] ^ tc[1][0] ^ bit ^ 1, tc[0][1] ^ tc[1][1] ^ bit};
+        k0.t_cw(level) = tcw[0] | (tcw[1] << 1);
+        for (int b = 0; b < 2; ++b) {
+            for (int w = 0; w < 4; ++w) s[b][w] = child[b][bit][w] ^ (t[b] ? scw[w] : 0);
+            t[b] = tc[b][bit] ^ (t[b] & tcw[bit]);
+        }
+        std::copy(scw, scw + 4, k1.seed_cw(level));
+        k1.t_cw(level) = k0.t_cw(level);
+    }
+
+    // output correction: conv(s0) - conv(s1) + cw = e_(alpha mod 16) up to the sign of t1
+    R c0[dpf_leaf_width], c1[dpf_leaf_width];
+    std::vector<uint32_t> blocks;
+    dpf_detail::convert_leaves(s[0].data(), 1, c0, blocks);
+    dpf_detail::convert_leaves(s[1].data(), 1, c1, blocks);
+    R cw[dpf_leaf_width];
+    for (size_t i = 0; i < dpf_leaf_width; ++i) {
+        R beta = (i == alpha % dpf_leaf_width) ? 1 : 0;
+        R v = beta - c0[i] + c1[i];
+        cw[i] = t[1] ? R(0) - v : v;
+    }
+    std::memcpy(k0.leaf_cw(), cw, sizeof(cw));
+    std::memcpy(k1.leaf_cw(), cw, sizeof(cw));
+    return {std::move(k0), std::move(k1)};
+}
+
+// Full-domain evaluation of `party`'s key. The shares of positions [0, n) are passed to
+// visit(first, values) in increasing runs, so the caller can consume them without a full-length buffer.
+template <RingWord R, typename Visit>
+void dpf_eval_full(const DpfKey& key, int party, Visit&& visit) {
+    if (key.out_words() != ring_words<R>) throw std::invalid_argument("dpf_eval_full: key is for another ring width");
+    const int depth = key.depth();
+    const size_t n = key.domain();
+    // level-by-level expansion: seeds of the current level back to back, control bits alongside
+    std::vector<uint32_t> seeds(4), next;
+    std::vector<uint8_t> ts(1, static_cast<uint8_t>(party)), next_t;
+    std::copy(key.root(), key.root() + 4, seeds.begin());
+    std::vector<uint32_t> blocks;
+    for (int level = 0; level < depth; ++level) {
+        const size_t count = ts.size();
+        blocks.resize(16 * count);
+        prg_detail::keyed_blocks(seeds.data(), count, dpf_detail::node_domain, blocks.data());
+        const uint32_t* scw = key.seed_cw(level);
+        const uint32_t tcw = key.t_cw(level);
+        next.resize(8 * count);
+        next_t.resize(2 * count);
+        for (size_t i = 0; i < count; ++i) {
+            const uint32_t* blk = blocks.data() + 16 * i;
+            const uint32_t mask = ts[i] ? ~0u : 0u;
+            uint32_t* out = next.data() + 8 * i; // left child then right child
+            for (int w = 0; w < 8; ++w) out[w] = blk[w] ^ (scw[w & 3] & mask);
+            next_t[2 * i] = static_cast<uint8_t>((blk[8] & 1) ^ (ts[i] & tcw & 1));
+            next_t[2 * i + 1] = static_cast<uint8_t>((blk[9] & 1) ^ (ts[i] & (tcw >> 1)));
+        }
+        // only the subtrees that cover [0, n) are expanded further
+        const size_t span = dpf_leaf_width << (depth - 1 - level); // outputs under one node of the new level
+        size_t keep = std::min(next_t.size(), (n + span - 1) / span);
+        next.resize(4 * keep);
+        next_t.resize(keep);
+        seeds.swap(next);
+        ts.swap(next_t);
+    }
+
+    // convert the leaves in chunks and hand them out
+    constexpr size_t chunk = 256; // leaves per chunk (16 KiB of outputs)
+    R cw[dpf_leaf_width];
+    std::memcpy(cw, key.leaf_cw(), sizeof(cw));
+    std::vector<R> values(chunk * dpf_leaf_width);
+    for (size_t first = 0; first < ts.size(); first += chunk) {
+        size_t count = std::min(chunk, ts.size() - first);
+        dpf_detail::convert_leaves(seeds.data() + 4 * first, count, values.data(), blocks);
+        for (size_t i = 0; i < count; ++i) {
+            const R mask = ts[first + i] ? ~R(0) : R(0);
+            for (size_t w = 0; w < dpf_leaf_width; ++w) {
+                R v = values[i * dpf_leaf_width + w] + (cw[w] & mask);
+                values[i * dpf_leaf_width + w] = party ? R(0) - v : v;
+            }
+        }
+        size_t begin = first * dpf_leaf_width;
+        size_t len = std::min(count * dpf_leaf_width, n - begin);
+        visit(begin, std::span<const R>(values.data(), len));
+    }
+}
@@ -0,0 +1,253 @@
+#pragma once
+// Batched Du-Atallah secure multiplication: any number of products of additively shared operands in
+// one round. Every instance multiplies the shared factors u and v with P2's masks (x, y) and correction
+// gamma, where gamma0 + gamma1 = P(x0, y1) + P(x1, y0). Each party sends u + x and v + y, receives the
+// peer's, and computes its share of P(u, v) as P(u, v + y') - P(y, x') + gamma.
+//
+// P is one of
+//   Dot       <u, v>                                  (1 output)
+//   Hadamard  u[i] * v[i]                             (len outputs)
+//   Colwise   out[c] = sum_i u[i][c] * v[i][c] over n x cols row-major matrices (cols outputs)
+// and an operand may be broadcast: element i is data[i / repeat], so a length-n vector spread along
+// the rows of an n x k matrix (repeat = k) or a scalar times a vector (repeat = len) is never built.
+//
+// MultBatch collects the instances of one round. run() sends all masked u's followed by all masked v's,
+// in instance order, as a single message per direction (one exchange), so adding instances adds bytes
+// but no rounds or system calls. post_u() / post_v() queue the halves on a caller's Round instead, so
+// a half whose operands are ready early can share an earlier round with unrelated messages. With a pool the O(len) masking and the local products run on it; a
+// Colwise instance whose u is row-broadcast goes through the fused kernel (kernels.hpp), which can
+// also accumulate <u, side> over a side matrix in the same pass (the read of v_j).
+//
+// P2 draws the masks and derives the corrections with mult_correlation() / mult_product().
+
+#include <algorithm>
+#include <span>
+#include <stdexcept>
+#include <vector>
+#include "common.hpp"
+#include "round.hpp"
+
+enum class MultKind { Dot, Hadamard, Colwise };
+
+// One factor of a product: element i is data[i / repeat], len = data.size() * repeat elements.
+template <RingWord R>
+struct Operand {
+    std::span<const R> data;
+    size_t repeat = 1;
+
+    Operand() = default;
+    Operand(std::span<const R> d, size_t rep = 1) : data(d), repeat(rep) {}
+    Operand(const std::vector<R>& d, size_t rep = 1) : data(d), repeat(rep) {}
+
+    size_t size() const { return data.size() * repeat; }
+    R operator[](size_t i) const { return repeat == 1 ? data[i] : data[i / repeat]; }
+};
+
+// P(a, b) in the clear, for plain operands (P2's side of the correlation).
+template <RingWord R>
+inline std::vector<R> mult_product(MultKind kind, std::span<const R> a, std::span<const R> b, size_t cols = 1) {
+    if (a.size() != b.size()) throw std::invalid_argument("mult_product: size mismatch");
+    switch (kind) {
+        case MultKind::Dot: return {ring_dot(a.data(), b.data(), a.size())};
+        case MultKind::Hadamard: {
+            std::vector<R> out(a.size());
+            for (size_t i = 0; i < a.size(); i++) out[i] = a[i] * b[i];
+            return out;
+        }
+        case MultKind::Colwise: {
+            std::vector<R> out(cols, 0);
+            if (!a.empty()) ring_colwise_dot(a.data(), b.data(), a.size() / cols, cols, out.data());
+            return out;
+        }
+    }
+    return {};
+}
+
+// Corrections for masks (x0, y0) of party 0 and (x1, y1) of party 1: gamma0 = P(x0, y1) + m and
+// gamma1 = P(x1, y0) - m for a fresh m uniform over the ring, from the calling thread's generator.
+template <RingWord R>
+inline void mult_correlation(MultKind kind, std::span<const R> x0, std::span<const R> y0, std::span<const R> x1,
+                             std::span<const R> y1, std::span<R> gamma0, std::span<R> gamma1, size_t cols = 1) {
+    std::vector<R> c01 = mult_product<R>(kind, x0, y1, cols);
+    std::vector<R> c10 = mult_product<R>(kind, x1, y0, cols);
+    if (gamma0.size() != c01.size() || gamma1.size() != c10.size()) throw std::invalid_argument("mult_correlation: size mismatch");
+    std::vector<R> mask(c01.size());
+    random_ring(mask);
+    for (size_t i = 0; i < mask.size(); i++) {
+        gamma0[i] = c01[i] + mask[i];
+        gamma1[i] = c10[i] - mask[i];
+    }
+}
+
+template <RingWord R>
+class MultBatch {
+    public:
+        // Each adder returns the instance's index, for result() and the peer's masked operands.
+        size_t dot(Operand<R> u, Operand<R> v, std::span<const R> x, std::span<const R> y, std::span<const R> gamma) {
+            return add(Instance(MultKind::Dot, u, v, x, y, gamma, 1));
+        }
+        size_t hadamard(Operand<R> u, Operand<R> v, std::span<const R> x, std::span<const R> y, std::span<const R> gamma) {
+            return add(Instance(MultKind::Hadamard, u, v, x, y, gamma, 1));
+        }
+        // n x cols matrices; side (optional, n x cols): also side_out[c] = sum_i u[i][c] * side[i][c]
+        size_t colwise(Operand<R> u, Operand<R> v, std::span<const R> x, std::span<const R> y, std::span<const R> gamma,
+                       size_t cols, MatrixView<const R> side = {}, std::vector<R>* side_out = nullptr) {
+            return add(Instance(MultKind::Colwise, u, v, x, y, gamma, cols, side, side_out));
+        }
+
+        size_t size() const { return inst_.size(); }
+
+        // The round: one exchange with the peer, then every instance's local product.
+        template <typename Stream>
+        awaitable<void> run(Stream& peer_sock, ThreadPool* pool = nullptr) {
+            Round round;
+            co_await post_u(round, pool);
+            co_await post_v(round, pool);
+            co_await round.flush(peer_sock);
+            co_await finish(pool);
+            co_return;
+        }
+
+        // The two halves of the message can also ride different rounds (round.hpp) when one side is
+        // known earlier: queue each half once its operands are final, flush, then finish() after both.
+        // The operand spans given to the adders must stay valid (and keep their storage) until finish().
+        awaitable<void> post_u(Round& round, ThreadPool* pool = nullptr) {
+            layout();
+            co_await local(pool, [&] { pack(pool, true); });
+            round.add(std::span<const R>(out_.data(), v_begin_), std::span<R>(peer_.data(), v_begin_));
+            co_return;
+        }
+        awaitable<void> post_v(Round& round, ThreadPool* pool = nullptr) {
+            layout();
+            co_await local(pool, [&] { pack(pool, false); });
+            round.add(std::span<const R>(out_.data() + v_begin_, out_.size() - v_begin_), std::span<R>(peer_.data() + v_begin_, peer_.size() - v_begin_));
+            co_return;
+        }
+        // every instance's local product, once the peer's halves are in
+        awaitable<void> finish(ThreadPool* pool = nullptr) {
+            co_await local(pool, [&] { finish_all(pool); });
+            co_return;
+        }
+
+        // this party's share of instance i's product
+        std::vector<R>& result(size_t i) { return inst_[i].result; }
+        // the peer's u + x and v + y of instance i (after run)
+        std::span<const R> peer_masked_u(size_t i) const { return {peer_.data() + inst_[i].u_off, inst_[i].u.size()}; }
+        std::span<const R> peer_masked_v(size_t i) const { return {peer_.data() + inst_[i].v_off, inst_[i].u.size()}; }
+
+    private:
+        struct Instance {
+            Instance(MultKind k, Operand<R> a, Operand<R> b, std::span<const R> mx, std::span<const R> my, std::span<const R> g,
+                     size_t c, MatrixView<const R> s = {}, std::vector<R>* so = nullptr)
+                : kind(k), u(a), v(b), x(mx), y(my), gamma(g), cols(c), side(s), side_out(so) {}
+
+            MultKind kind;
+            Operand<R> u, v;
+            std::span<const R> x, y, gamma;
+            size_t cols;
+            MatrixView<const R> side{};
+            std::vector<R>* side_out = nullptr;
+            size_t u_off = 0, v_off = 0; // positions in the message
+            std::vector<R> result;
+        };
+
+        size_t add(Instance in) {
+            size_t len = in.u.size();
+            size_t outputs = in.kind == MultKind::Dot ? 1 : in.kind == MultKind::Hadamard ? len : in.cols;
+            if (in.v.size() != len || in.x.size() != len || in.y.size() != len || in.gamma.size() != outputs ||
+                (in.kind == MultKind::Colwise && (in.cols == 0 || len % in.cols != 0))) {
+                throw std::invalid_argument("MultBatch: operand sizes do not match");
+            }
+            inst_.push_back(std::move(in));
+            return inst_.size() - 1;
+        }
+
+        template <typename F>
+        static awaitable<void> local(ThreadPool* pool, F f) {
+            if (pool) co_await offload(*pool, f);
+            else f();
+            co_return;
+        }
+
+        // message layout: all u + x in instance order, then all v + y
+        void layout() {
+            if (!out_.empty() || inst_.empty()) return;
+            size_t off = 0;
+            for (auto& in : inst_) { in.u_off = off; off += in.u.size(); }
+            v_begin_ = off;
+            for (auto& in : inst_) { in.v_off = off; off += in.u.size(); }
+            out_.resize(off);
+            peer_.resize(off);
+        }
+
+        void pack(ThreadPool* pool, bool u_side) {
+            for (const auto& in : inst_) {
+                auto mask = [&](size_t lo, size_t hi) {
+                    if (u_side) mask_range(in.u, in.x.data(), out_.data() + in.u_off, lo, hi);
+                    else mask_range(in.v, in.y.data(), out_.data() + in.v_off, lo, hi);
+                };
+                if (pool) pool->parallel_for(0, in.u.size(), grain, mask);
+                else mask(0, in.u.size());
+            }
+        }
+
+        // out[i] = a[i] + m[i] for i in [lo, hi), one broadcast value per run of a.repeat elements
+        static void mask_range(const Operand<R>& a, const R* m, R* out, size_t lo, size_t hi) {
+            if (a.repeat == 1) {
+                for (size_t i = lo; i < hi; i++) out[i] = a.data[i] + m[i];
+                return;
+            }
+            for (size_t i = lo; i < hi;) {
+                size_t b = i / a.repeat, end = std::min(hi, (b + 1) * a.repeat);
+                R val = a.data[b];
+                for (; i < end; i++) out[i] = val + m[i];
+            }
+        }
+
+        // z = P(u, v + y') - P(y, x') + gamma
+        void finish_all(ThreadPool* pool) {
+            for (auto& in : inst_) {
+                const R* xp = peer_.data() + in.u_off;
+                const R* yp = peer_.data() + in.v_off;
+                size_t len = in.u.size();
+                switch (in.kind) {
+                    case MultKind::Dot: {
+                        R z = 0;
+                        for (size_t i = 0; i < len; i++) z += in.u[i] * (in.v[i] + yp[i]) - in.y[i] * xp[i];
+                        in.result.assign(1, z + in.gamma[0]);
+                        break;
+                    }
+                    case MultKind::Hadamard:
+                        in.result.resize(len);
+                        for (size_t i = 0; i < len; i++) in.result[i] = in.u[i] * (in.v[i] + yp[i]) - in.y[i] * xp[i] + in.gamma[i];
+                        break;
+                    case MultKind::Colwise:
+                        colwise_finish(in, xp, yp, pool);
+                        break;
+                }
+            }
+        }
+
+        void colwise_finish(Instance& in, const R* xp, const R* yp, ThreadPool* pool) {
+            size_t k = in.cols, n = in.u.size() / k;
+            if (in.u.repeat == k && in.v.repeat == 1) {
+                // fused pass: v is the matrix, y' the peer's v + y and x' its u + x
+                MatrixView<const R> v(in.v.data.data(), n, k), y(in.y.data(), n, k), ypv(yp, n, k), xpv(xp, n, k);
+                fused_read<R>(in.u.data, in.side, ypv, v, y, xpv, in.side_out, in.result, pool);
+            } else {
+                in.result.assign(k, 0);
+                if (in.side_out) in.side_out->assign(k, 0);
+                for (size_t i = 0; i < n * k; i++) {
+                    in.result[i % k] += in.u[i] * (in.v[i] + yp[i]) - in.y[i] * xp[i];
+                    if (in.side_out) (*in.side_out)[i % k] += in.u[i] * in.side.data()[i];
+                }
+            }
+            for (size_t c = 0; c < k; c++) in.result[c] += in.gamma[c];
+        }
+
+        static constexpr size_t grain = 16384; // elements per parallel masking chunk
+
+        std::vector<Instance> inst_;
+        std::vector<R> out_, peer_;
+        size_t v_begin_ = 0;
+};
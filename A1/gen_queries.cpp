@@ -1,58 +1,426 @@
 #include <bits/stdc++.h>
 #include <random>
 #include <cstdint>
+#include "prg.hpp"
+#include "query_file.hpp"
 using namespace std;
 
+// Workloads. Without options users and items are uniform, drawn from one sequential stream, so a seed
+// gives the same files as it always has. --users / --items pick a skewed distribution over the ids:
+//   uniform
+//   zipf:S       the id of popularity rank r with probability proportional to r^-S
+//   hot:F:P      a hot set of F * N ids takes a share P of the accesses; the rest are uniform
+//   burst:L:W:P  the stream is cut into windows of L queries; in each window W ids drawn afresh take a
+//                share P of the accesses; the rest are uniform
+// Ranks and the hot set go through a random affine permutation of the ids, so the popular ids are spread
+// over the index range. --ratings R lets every drawn user rate R items in a row.
+//
+// Those workloads are generated in parallel. Block b of the query stream is drawn from ChaCha stream b
+// (prg.hpp) of one key, so the files depend on the seed alone and not on --threads. Worker threads draw
+// and encode whole blocks while the main thread writes the previous ones out.
 
-// Returns a non-deterministic random 32-bit unsigned integer
+
+// Returns a random 32-bit unsigned integer (OS-seeded, or derived from the optional seed argument)
 uint32_t random_uint32() {
-    static std::random_device rd;            // True random seed
-    static std::mt19937 gen(rd());           // Mersenne Twister engine
-    static std::uniform_int_distribution<uint32_t> dist(
-        0, std::numeric_limits<uint32_t>::max()
-    );
-    return dist(gen);
+    return thread_rng().next_u32();
 }
 
+// Uniform double in (0, 1) from 53 random bits
+static double unit(Prg &rng) {
+    uint64_t bits = (uint64_t(rng.next_u32()) << 21) ^ (rng.next_u32() >> 11);
+    return (double(bits) + 0.5) * 0x1p-53;
+}
 
-int main(int argc, char* argv[]) {
-    if (argc < 5) {
-        cerr << "Usage: " << argv[0] << " m n k Q\n";
-        return 1;
+struct Dist {
+    enum Kind { uniform, zipf, hot, burst } kind = uniform;
+    string spec = "uniform";
+    double exponent = 0;   // zipf
+    double fraction = 0;   // hot: size of the hot set, as a fraction of the ids
+    double share = 0;      // hot, burst: share of the accesses
+    uint64_t window = 0;   // burst: queries per window
+    uint32_t width = 0;    // burst: ids per window
+};
+
+static Dist parse_dist(const string &spec) {
+    vector<string> f;
+    stringstream ss(spec);
+    for (string part; getline(ss, part, ':');) f.push_back(part);
+    auto bad = [&]() { return invalid_argument("bad distribution '" + spec + "' (uniform, zipf:S, hot:F:P or burst:L:W:P)"); };
+    auto num = [&](size_t i) {
+        if (i >= f.size()) throw bad();
+        return stod(f[i]);
+    };
+    Dist d;
+    d.spec = spec;
+    if (f.empty()) throw bad();
+    if (f[0] == "uniform" && f.size() == 1) {
+        d.kind = Dist::uniform;
+    } else if (f[0] == "zipf" && f.size() == 2) {
+        d.kind = Dist::zipf;
+        d.exponent = num(1);
+        if (!(d.exponent > 0)) throw bad();
+    } else if (f[0] == "hot" && f.size() == 3) {
+        d.kind = Dist::hot;
+        d.fraction = num(1);
+        d.share = num(2);
+        if (!(d.fraction > 0 && d.fraction <= 1 && d.share >= 0 && d.share <= 1)) throw bad();
+    } else if (f[0] == "burst" && f.size() == 4) {
+        d.kind = Dist::burst;
+        d.window = static_cast<uint64_t>(num(1));
+        d.width = static_cast<uint32_t>(num(2));
+        d.share = num(3);
+        if (d.window < 1 || d.width < 1 || !(d.share >= 0 && d.share <= 1)) throw bad();
+    } else {
+        throw bad();
     }
+    return d;
+}
 
-    int m = stoi(argv[1]);
-    int n = stoi(argv[2]);
-    int k = stoi(argv[3]);
-    int Q = stoi(argv[4]);
+// Zipf ranks 1..N with P(r) ~ r^-s, by rejection-inversion (Hoermann and Derflinger, 1996): O(1) per
+// draw and no table, so N in the millions costs nothing to set up.
+class Zipf {
+    public:
+        Zipf(uint32_t N, double s) : n_(N), s_(s) {
+            hx1_ = H(1.5) - 1.0;
+            hn_ = H(N + 0.5);
+            cut_ = 2.0 - Hinv(H(2.5) - h(2.0));
+        }
 
-    ofstream f1("f1.txt");
-    ofstream f2("f2.txt");
-    if (!f1 || !f2) {
-        cerr << "Error opening output files.\n";
-        return 1;
+        uint64_t draw(Prg &rng) const {
+            for (;;) {
+                double u = hn_ + unit(rng) * (hx1_ - hn_);
+                double x = Hinv(u);
+                double r = std::clamp(std::floor(x + 0.5), 1.0, double(n_));
+                if (r - x <= cut_ || u >= H(r + 0.5) - h(r)) return static_cast<uint64_t>(r);
+            }
+        }
+
+    private:
+        double h(double x) const { return std::exp(-s_ * std::log(x)); }
+        double H(double x) const {
+            double lx = std::log(x);
+            return expm1_over((1.0 - s_) * lx) * lx;
+        }
+        double Hinv(double x) const {
+            double t = std::max(-1.0, x * (1.0 - s_));
+            return std::exp(log1p_over(t) * x);
+        }
+        // expm1(x) / x and log1p(x) / x, with their series near 0 (s close to 1)
+        static double expm1_over(double x) { return std::abs(x) > 1e-8 ? std::expm1(x) / x : 1.0 + x * 0.5 * (1.0 + x / 3.0 * (1.0 + 0.25 * x)); }
+        static double log1p_over(double x) { return std::abs(x) > 1e-8 ? std::log1p(x) / x : 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x)); }
+
+        uint32_t n_;
+        double s_, hx1_, hn_, cut_;
+};
+
+// The ids of one burst window, cached by the thread that draws from it
+struct BurstSet {
+    uint64_t window = UINT64_MAX;
+    vector<uint32_t> ids;
+};
+
+// Draws ids in [0, N) from one distribution. `domain` keeps the users' and the items' streams apart.
+class IdSampler {
+    public:
+        IdSampler(const Dist &d, uint32_t N, const PrgSeed &key, uint64_t domain)
+            : d_(d), n_(N), key_(key), domain_(domain), zipf_(N, d.kind == Dist::zipf ? d.exponent : 1.0) {
+            Prg rng(key, burst_stream | (domain << 56) | ((1ULL << 56) - 1));
+            a_ = 1 + rng.next_u32() % max<uint32_t>(N - 1, 1);
+            while (gcd(a_, uint64_t(N)) != 1) a_++;
+            c_ = rng.next_u32() % N;
+            hot_ = max<uint64_t>(1, min<uint64_t>(N, uint64_t(d.fraction * N)));
+        }
+
+        uint32_t draw(Prg &rng, uint64_t q, BurstSet &burst) const {
+            switch (d_.kind) {
+                case Dist::zipf:
+                    return permute(zipf_.draw(rng) - 1);
+                case Dist::hot:
+                    if (unit(rng) < d_.share || hot_ == n_) return permute(rng.uniform(0, int32_t(hot_ - 1)));
+                    return permute(rng.uniform(int32_t(hot_), int32_t(n_ - 1)));
+                case Dist::burst:
+                    if (unit(rng) < d_.share) {
+                        load(q / d_.window, burst);
+                        return burst.ids[rng.next_u32() % burst.ids.size()];
+                    }
+                    return static_cast<uint32_t>(rng.uniform(0, int32_t(n_ - 1)));
+                default:
+                    return static_cast<uint32_t>(rng.uniform(0, int32_t(n_ - 1)));
+            }
+        }
+
+        // streams with this bit hold the burst sets; the blocks' streams stay below it
+        static constexpr uint64_t burst_stream = 1ULL << 62;
+
+    private:
+        uint32_t permute(uint64_t rank) const { return static_cast<uint32_t>((a_ * rank + c_) % n_); }
+
+        void load(uint64_t window, BurstSet &burst) const {
+            if (burst.window == window) return;
+            Prg rng(key_, burst_stream | (domain_ << 56) | window);
+            burst.ids.resize(d_.width);
+            for (auto &id : burst.ids) id = static_cast<uint32_t>(rng.uniform(0, int32_t(n_ - 1)));
+            burst.window = window;
+        }
+
+        Dist d_;
+        uint64_t n_;
+        PrgSeed key_;
+        uint64_t domain_;
+        Zipf zipf_;
+        uint64_t a_ = 1, c_ = 0, hot_ = 1;
+};
+
+// Largest multiplicity of a value in ids
+static uint32_t max_repeat(vector<uint32_t> ids) {
+    sort(ids.begin(), ids.end());
+    uint32_t best = 0;
+    for (size_t i = 0, j; i < ids.size(); i = j) {
+        for (j = i; j < ids.size() && ids[j] == ids[i]; j++) {}
+        best = max(best, static_cast<uint32_t>(j - i));
     }
+    return best;
+}
 
-    // Headers
-    f1 << m << " " << n << " " << k << " " << Q << "\n";
-    f2 << m << " " << n << " " << k << " " << Q << "\n";
+// Repeats within batches (--stats B): a user that appears w times in a batch splits it into w waves
+struct BatchStats {
+    uint64_t batches = 0, user_waves = 0, item_repeats = 0;
+    uint32_t max_user_waves = 0, max_item_repeats = 0;
 
-    for (int q = 0; q < Q; q++) {
-        // i in [0, m-1], j in [0, n-1]
-        uint32_t i = random_uint32() % m;
-        uint32_t j = random_uint32() % n;
+    void add(const vector<uint32_t> &users, const vector<uint32_t> &items) {
+        uint32_t w = max_repeat(users), r = max_repeat(items);
+        batches++;
+        user_waves += w;
+        item_repeats += r;
+        max_user_waves = max(max_user_waves, w);
+        max_item_repeats = max(max_item_repeats, r);
+    }
 
-        // Make additive shares: j = j0 + j1
-        int j0 = static_cast<int>(random_uint32() % (2 * n)); // spread more
-        int j1 = static_cast<int>(j) - j0;
+    void merge(const BatchStats &o) {
+        batches += o.batches;
+        user_waves += o.user_waves;
+        item_repeats += o.item_repeats;
+        max_user_waves = max(max_user_waves, o.max_user_waves);
+        max_item_repeats = max(max_item_repeats, o.max_item_repeats);
+    }
+};
 
-        f1 << i << " " << j0 << "\n";
-        f2 << i << " " << j1 << "\n";
+// One block of queries: both parties' records, encoded, and what --stats needs of them. Batches can
+// straddle blocks, so the users and items before the block's first batch boundary (head) and after its
+// last (tail) are kept for the main thread to join up.
+struct Block {
+    string bytes[2];
+    size_t count = 0;
+    BatchStats stats;
+    vector<uint32_t> head_users, head_items, tail_users, tail_items;
+    bool head_closes = false; // the head ends at a batch boundary
+};
+
+// Add the ids' multiplicities into counts (shared by the threads). Sorting first turns a hot id's many
+// accesses into one atomic add per block.
+static void count_ids(vector<uint32_t> &ids, vector<uint32_t> &counts) {
+    sort(ids.begin(), ids.end());
+    for (size_t i = 0, j; i < ids.size(); i = j) {
+        for (j = i; j < ids.size() && ids[j] == ids[i]; j++) {}
+        atomic_ref<uint32_t>(counts[ids[i]]).fetch_add(static_cast<uint32_t>(j - i), memory_order_relaxed);
     }
+}
 
-    f1.close();
-    f2.close();
+static void report(const char *what, vector<uint32_t> &counts, uint64_t Q) {
+    uint64_t distinct = 0;
+    for (uint32_t c : counts) distinct += c != 0;
+    size_t hottest = max_element(counts.begin(), counts.end()) - counts.begin();
+    size_t top = max<size_t>(1, counts.size() / 100);
+    vector<uint32_t> sorted = counts;
+    nth_element(sorted.begin(), sorted.begin() + (top - 1), sorted.end(), greater<uint32_t>());
+    uint64_t top_queries = accumulate(sorted.begin(), sorted.begin() + top, uint64_t(0));
+    cout << fixed << setprecision(2) << "  " << what << ": " << distinct << " of " << counts.size() << " ids used; hottest id "
+         << hottest << " in " << counts[hottest] << " queries (" << 100.0 * counts[hottest] / max<uint64_t>(Q, 1)
+         << "%); the top 1% of ids take " << 100.0 * top_queries / max<uint64_t>(Q, 1) << "% of the queries\n";
+}
+
+int main(int argc, char* argv[]) {
+    // --binary writes the binary query files f1.qry / f2.qry (query_file.hpp) instead of f1.txt / f2.txt
+    bool binary = false;
+    Dist user_dist, item_dist;
+    uint64_t ratings = 1, stats_batch = 0;
+    int threads = 0;
+    bool legacy = true; // no workload option: the sequential uniform stream of earlier versions
+    vector<string> args;
+    try {
+        for (int a = 1; a < argc; a++) {
+            string arg = argv[a];
+            auto next_value = [&]() -> string {
+                if (a + 1 >= argc) throw invalid_argument("missing value for " + arg);
+                return argv[++a];
+            };
+            if (arg == "--binary") binary = true;
+            else if (arg == "--users") { user_dist = parse_dist(next_value()); legacy = false; }
+            else if (arg == "--items") { item_dist = parse_dist(next_value()); legacy = false; }
+            else if (arg == "--ratings") { ratings = max(1LL, stoll(next_value())); legacy = false; }
+            else if (arg == "--threads") { threads = max(1, stoi(next_value())); legacy = false; }
+            else if (arg == "--stats") stats_batch = max(1LL, stoll(next_value()));
+            else args.push_back(arg);
+        }
+    } catch (const exception &e) {
+        cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    if (args.size() < 4) {
+        cerr << "Usage: " << argv[0] << " m n k Q [seed] [--binary] [--users DIST] [--items DIST] [--ratings R] [--threads T] [--stats B]\n"
+             << "  DIST: uniform, zipf:S, hot:F:P (hot set of F*N ids, share P of the accesses) or\n"
+             << "        burst:L:W:P (every L queries W fresh ids take a share P of the accesses)\n"
+             << "  --ratings R  every drawn user rates R items in a row\n"
+             << "  --threads T  generator threads (default: all cores); the files do not depend on T\n"
+             << "  --stats B    print the workload's statistics, with the user and item repeats in batches of B\n";
+        return 1;
+    }
+    if (args.size() > 4) set_rng_seed(stoull(args[4]), 3); // reproducible query files
+
+    int m = stoi(args[0]);
+    int n = stoi(args[1]);
+    int k = stoi(args[2]);
+    int Q = stoi(args[3]);
+    if (legacy) threads = 1;
+    else if (threads == 0) threads = max(1u, thread::hardware_concurrency());
+
+    // Blocks hold whole rating runs
+    uint64_t block_q = ratings * max<uint64_t>(1, (65536 + ratings - 1) / ratings);
+    uint64_t blocks = (uint64_t(Q) + block_q - 1) / block_q;
+
+    PrgSeed key{};
+    if (!legacy) key = random_seed();
+    IdSampler users(user_dist, m, key, 0), items(item_dist, n, key, 1);
+    vector<uint32_t> user_counts(stats_batch ? m : 0), item_counts(stats_batch ? n : 0);
+
+    auto draw_block = [&](uint64_t b, Block &out) {
+        uint64_t lo = b * block_q, hi = min<uint64_t>(Q, lo + block_q);
+        thread_local vector<QueryRecord> rec[2];
+        thread_local vector<uint32_t> user_ids, item_ids;
+        rec[0].clear();
+        rec[1].clear();
+        if (legacy) {
+            for (uint64_t q = lo; q < hi; q++) {
+                // i in [0, m-1], j in [0, n-1]
+                uint32_t i = random_uint32() % m;
+                uint32_t j = random_uint32() % n;
 
-    cout << "Files f1.txt and f2.txt generated successfully.\n";
+                // Make additive shares: j = j0 + j1
+                int j0 = static_cast<int>(random_uint32() % (2 * n)); // spread more
+                int j1 = static_cast<int>(j) - j0;
+
+                rec[0].push_back({i, j0});
+                rec[1].push_back({i, j1});
+            }
+        } else {
+            Prg rng(key, b);
+            BurstSet user_burst, item_burst;
+            uint32_t i = 0;
+            for (uint64_t q = lo; q < hi; q++) {
+                if (q % ratings == 0) i = users.draw(rng, q, user_burst);
+                uint32_t j = items.draw(rng, q, item_burst);
+                int j0 = rng.uniform(0, 2 * n - 1);
+                rec[0].push_back({i, j0});
+                rec[1].push_back({i, static_cast<int>(j) - j0});
+            }
+        }
+        out.count = hi - lo;
+        for (int p = 0; p < 2; p++) {
+            out.bytes[p].clear();
+            QueryWriter::encode(rec[p], binary, out.bytes[p]);
+        }
+        if (!stats_batch) return;
+
+        user_ids.clear();
+        item_ids.clear();
+        for (size_t q = 0; q < out.count; q++) {
+            int64_t j = (int64_t(rec[0][q].item_share) + rec[1][q].item_share) % n;
+            user_ids.push_back(rec[0][q].user);
+            item_ids.push_back(static_cast<uint32_t>(j < 0 ? j + n : j));
+        }
+        // full batches [first, last) here; the rest go to the main thread
+        uint64_t first = min(hi, (lo + stats_batch - 1) / stats_batch * stats_batch);
+        uint64_t last = max(first, hi / stats_batch * stats_batch);
+        out.stats = BatchStats();
+        thread_local vector<uint32_t> batch_users, batch_items;
+        for (uint64_t at = first; at < last; at += stats_batch) {
+            batch_users.assign(user_ids.begin() + (at - lo), user_ids.begin() + (at + stats_batch - lo));
+            batch_items.assign(item_ids.begin() + (at - lo), item_ids.begin() + (at + stats_batch - lo));
+            out.stats.add(batch_users, batch_items);
+        }
+        out.head_users.assign(user_ids.begin(), user_ids.begin() + (first - lo));
+        out.head_items.assign(item_ids.begin(), item_ids.begin() + (first - lo));
+        out.tail_users.assign(user_ids.begin() + (last - lo), user_ids.end());
+        out.tail_items.assign(item_ids.begin() + (last - lo), item_ids.end());
+        out.head_closes = first % stats_batch == 0;
+        count_ids(user_ids, user_counts);
+        count_ids(item_ids, item_counts);
+    };
+
+    auto start = chrono::steady_clock::now();
+    BatchStats totals;
+    vector<uint32_t> carry_users, carry_items; // the batch that straddles blocks
+    try {
+        // Headers
+        QueryWriter f1(query_file_path(0, binary), binary, m, n, k, Q);
+        QueryWriter f2(query_file_path(1, binary), binary, m, n, k, Q);
+
+        // waves of blocks: the threads draw one wave while the previous one is written
+        size_t wave = static_cast<size_t>(threads) * 4;
+        vector<Block> drawing(wave), writing(wave);
+        future<void> written;
+        for (uint64_t first = 0; first < blocks; first += wave) {
+            size_t count = static_cast<size_t>(min<uint64_t>(wave, blocks - first));
+            atomic<size_t> next{0};
+            auto work = [&]() {
+                for (size_t b; (b = next.fetch_add(1)) < count;) draw_block(first + b, drawing[b]);
+            };
+            vector<thread> workers;
+            for (int t = 1; t < threads && size_t(t) < count; t++) workers.emplace_back(work);
+            work();
+            for (auto &w : workers) w.join();
+            for (size_t b = 0; stats_batch && b < count; b++) {
+                Block &blk = drawing[b];
+                carry_users.insert(carry_users.end(), blk.head_users.begin(), blk.head_users.end());
+                carry_items.insert(carry_items.end(), blk.head_items.begin(), blk.head_items.end());
+                if (blk.head_closes) {
+                    if (!carry_users.empty()) totals.add(carry_users, carry_items);
+                    carry_users.swap(blk.tail_users);
+                    carry_items.swap(blk.tail_items);
+                }
+                totals.merge(blk.stats);
+            }
+
+            if (written.valid()) written.get();
+            swap(drawing, writing);
+            written = async(launch::async, [&f1, &f2, &writing, count]() {
+                for (size_t b = 0; b < count; b++) {
+                    f1.append_encoded(writing[b].bytes[0], writing[b].count);
+                    f2.append_encoded(writing[b].bytes[1], writing[b].count);
+                }
+            });
+        }
+        if (written.valid()) written.get();
+        if (!carry_users.empty()) totals.add(carry_users, carry_items);
+
+        f1.finish();
+        f2.finish();
+    } catch (const exception &e) {
+        cerr << "Error writing query files: " << e.what() << "\n";
+        return 1;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "Files " << query_file_path(0, binary) << " and " << query_file_path(1, binary) << " generated successfully.\n";
+    if (stats_batch) {
+        cout << "Workload: " << Q << " queries, users " << user_dist.spec << ", items " << item_dist.spec << ", " << ratings
+             << " rating(s) per user visit, " << threads << " thread(s), " << fixed << setprecision(2) << seconds << " s\n";
+        report("users", user_counts, Q);
+        report("items", item_counts, Q);
+        double batches = max<double>(1, totals.batches);
+        cout << "  batches of " << stats_batch << ": " << totals.user_waves / batches << " waves on average (max "
+             << totals.max_user_waves << ") from repeated users; the most frequent item appears " << totals.item_repeats / batches
+             << " times on average (max " << totals.max_item_repeats << ")\n";
+    }
     return 0;
 }
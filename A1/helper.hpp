@@ -0,0 +1,192 @@
+#pragma once
+// The P2 side of the protocol, shared by p2.cpp and bench_protocol.cpp: generation of the correlated
+// randomness and the coroutine that streams it to one client over any connected asio byte stream.
+
+#include <string>
+#include <utility>
+#include "common.hpp"
+#include "du_atallah.hpp"
+#include "preproc_ring.hpp"
+#include "preproc_file.hpp"
+#include "options.hpp"
+#include "metrics.hpp"
+
+// Send every query's preprocessing to a client, opt.batch bundles per write (the byte stream does not
+// depend on the batch size, so the parties read it back in whatever batch size they run with).
+// Bundles are pulled from the ring as the generator threads produce them. The order is always the query
+// order, also when the parties run concurrent sessions (--sessions): their dispatchers read it in that order. With metrics, the wait for the
+// generators ("p2_generate") and the write ("p2_delivery") are recorded per batch, on timeline row `party`.
+template <typename Stream, RingWord R>
+boost::asio::awaitable<void> handle_client(Stream &socket, const std::string &name, PreprocRing<R> &ring, int party,
+                                           int n, int k, int Q, int batch, bool seeded, Metrics *metrics = nullptr)
+{
+    try {
+        for (int q = 0; q < Q; q += batch) {
+            int B = std::min(batch, Q - q);
+            std::vector<Preproc<R>> pre;
+            {
+                PhaseSpan span(metrics, "p2_generate", q, B, {}, party);
+                for (int b = 0; b < B; ++b) {
+                    Preproc<R> p = co_await ring.take(q + b, party);
+                    pre.push_back(std::move(p));
+                }
+            }
+            PhaseSpan span(metrics, "p2_delivery", q, B, {&socket.counters()}, party);
+            co_await send_preproc_batch(socket, std::span<const Preproc<R>>(pre), n, k, seeded, party);
+            // std::cout<<"Sent queries "<<q<<".."<<q+B-1<<" to "<<name<<"\n";
+        }
+    } catch (const std::exception &ex) {
+        std::cerr << "Exception in handle_client for " << name << ": " << ex.what() << "\n";
+    }
+}
+
+// Serve a client from its offline preprocessing file (--preproc-file): opt.batch queries per sendfile,
+// the same byte stream as handle_client with nothing generated or packed.
+template <typename Stream>
+boost::asio::awaitable<void> handle_client_file(Stream &socket, const std::string &name, const PreprocFile &file, int party,
+                                                int Q, int batch, Metrics *metrics = nullptr)
+{
+    try {
+        for (int q = 0; q < Q; q += batch) {
+            int B = std::min(batch, Q - q);
+            PhaseSpan span(metrics, "p2_delivery", q, B, {&socket.counters()}, party);
+            co_await send_preproc_file(socket, file, q, B);
+        }
+    } catch (const std::exception &ex) {
+        std::cerr << "Exception in handle_client_file for " << name << ": " << ex.what() << "\n";
+    }
+}
+
+// The scaled point function of the item write (--update-items, item_write.hpp):
+// write_cross0 + write_cross1 = e_alpha x (write_mask0 + write_mask1), i.e. the mask that hides u_i * delta
+// when it is opened, placed in row alpha. write_cross0 is already drawn (from P0's seed in seeded mode).
+template <RingWord R>
+inline void generate_write_cross(Preproc<R> &p0, Preproc<R> &p1, int alpha, int k)
+{
+    std::vector<R> y(k);
+    for (int c = 0; c < k; c++) y[c] = p0.write_mask[c] + p1.write_mask[c];
+    for (size_t i = 0; i < p1.write_cross.rows(); i++) {
+        for (int c = 0; c < k; c++) p1.write_cross(i, c) = (static_cast<int>(i) == alpha ? y[c] : R(0)) - p0.write_cross(i, c);
+    }
+}
+
+// Generate the correlated randomness of one query for both parties.
+// In DPF mode e_alpha is handed out as a pair of DPF keys (O(log n) words each) instead of a length-n vector.
+template <RingWord R>
+inline std::pair<Preproc<R>, Preproc<R>> generate_preproc(int n, int k, bool dpf, bool write = false)
+{
+    Preproc<R> p0(n, k, dpf, write), p1(n, k, dpf, write);
+    // Firstly, let us get alpha shares(int) and e_alpha shares (1d vector).
+    int alpha = rand_int(0, n - 1);
+    std::tie(p0.alpha, p1.alpha) = make_additive_shares_int(alpha);
+    if (dpf) std::tie(p0.dpf_key, p1.dpf_key) = dpf_gen<R>(n, alpha);
+    else std::tie(p0.e_alpha, p1.e_alpha) = make_basis_vector_shares<R>(n, alpha);
+
+    // Now is the time for creating random matrices.
+    random_ring(p0.x_n);
+    random_ring(p1.x_n);
+    random_ring(p0.y_n);
+    random_ring(p1.y_n);
+
+    // Now get gamma --> i.e., colwise dot product of x_n and y_n, masked (du_atallah.hpp)
+    mult_correlation<R>(MultKind::Colwise, p0.x_n.flat(), p0.y_n.flat(), p1.x_n.flat(), p1.y_n.flat(), p0.gamma_n, p1.gamma_n, k);
+
+    // Now let us make vectors for MPC dotprouct.
+    random_ring(p0.x_k);
+    random_ring(p1.x_k);
+    random_ring(p0.y_k);
+    random_ring(p1.y_k);
+    // Now get vec_gamma_k.
+    mult_correlation<R>(MultKind::Dot, p0.x_k, p0.y_k, p1.x_k, p1.y_k, std::span<R>(&p0.gamma_k, 1), std::span<R>(&p1.gamma_k, 1));
+
+    // Now generate shares for mpc scalar multiplication.
+    random_ring(p0.scaler_x);
+    random_ring(p1.scaler_x);
+    random_ring(p0.scaler_y);
+    random_ring(p1.scaler_y);
+    // Now get mpc_gamma shares (elementwise: the parties broadcast delta over scaler_y themselves).
+    mult_correlation<R>(MultKind::Hadamard, p0.scaler_x, p0.scaler_y, p1.scaler_x, p1.scaler_y, p0.scaler_gamma, p1.scaler_gamma);
+
+    // And with item writes, the masks of u_i * delta and the scaled point function.
+    if (write) {
+        random_ring(p0.item_x);
+        random_ring(p1.item_x);
+        random_ring(p0.item_y);
+        random_ring(p1.item_y);
+        mult_correlation<R>(MultKind::Hadamard, p0.item_x, p0.item_y, p1.item_x, p1.item_y, p0.item_gamma, p1.item_gamma);
+        random_ring(p0.write_mask);
+        random_ring(p1.write_mask);
+        random_ring(p0.write_cross);
+        generate_write_cross(p0, p1, alpha, k);
+    }
+    return {std::move(p0), std::move(p1)};
+}
+
+// Seed-compressed variant: both bundles are expanded from fresh seeds exactly as the parties will expand
+// them, then party 1's correlated terms are fixed up so that the same relations hold as in generate_preproc.
+template <RingWord R>
+inline std::pair<Preproc<R>, Preproc<R>> generate_preproc_seeded(int n, int k, bool dpf, bool write = false)
+{
+    Preproc<R> p0(n, k, dpf, write), p1(n, k, dpf, write);
+    p0.seed = random_seed();
+    p1.seed = random_seed();
+    expand_preproc(p0, 0);
+    expand_preproc(p1, 1);
+
+    int alpha = rand_int(0, n - 1);
+    p1.alpha = index_sub(alpha, p0.alpha);
+    if (dpf) std::tie(p0.dpf_key, p1.dpf_key) = dpf_gen<R>(n, alpha);
+    else for (int i = 0; i < n; i++) p1.e_alpha[i] = R(i == alpha ? 1 : 0) - p0.e_alpha[i];
+
+    // gamma0 + gamma1 = P(x0, y1) + P(x1, y0) for each of the three products
+    auto fix_up = [](MultKind kind, const auto &x0, const auto &y0, const auto &x1, const auto &y1,
+                     std::span<const R> gamma0, std::span<R> gamma1, size_t cols) {
+        std::vector<R> c01 = mult_product<R>(kind, x0, y1, cols), c10 = mult_product<R>(kind, x1, y0, cols);
+        for (size_t i = 0; i < gamma1.size(); i++) gamma1[i] = c01[i] + c10[i] - gamma0[i];
+    };
+    fix_up(MultKind::Colwise, p0.x_n.flat(), p0.y_n.flat(), p1.x_n.flat(), p1.y_n.flat(), p0.gamma_n, p1.gamma_n, k);
+    fix_up(MultKind::Dot, p0.x_k, p0.y_k, p1.x_k, p1.y_k, std::span<const R>(&p0.gamma_k, 1), std::span<R>(&p1.gamma_k, 1), 1);
+    fix_up(MultKind::Hadamard, p0.scaler_x, p0.scaler_y, p1.scaler_x, p1.scaler_y, p0.scaler_gamma, p1.scaler_gamma, 1);
+    if (write) {
+        fix_up(MultKind::Hadamard, p0.item_x, p0.item_y, p1.item_x, p1.item_y, p0.item_gamma, p1.item_gamma, 1);
+        generate_write_cross(p0, p1, alpha, k);
+    }
+    return {std::move(p0), std::move(p1)};
+}
+
+// P2's preprocessing ring for Q queries: generation runs at most opt.window queries ahead of the slower
+// client, so memory stays bounded and the first query is served right away. The ring must hold a whole
+// batch, or a handler would wait for a query that cannot be produced yet. With --rng-seed every query is
+// generated from its own stream, whichever worker picks it up. Call start() on it to begin.
+template <RingWord R = Ring>
+inline PreprocRing<R> make_preproc_ring(int n, int k, int Q, const Options &opt)
+{
+    return PreprocRing<R>(std::max(opt.window, opt.batch), Q, [n, k, seeded = opt.seeded, dpf = opt.dpf, write = opt.update_items](int q) {
+        reseed_thread_rng(q);
+        return seeded ? generate_preproc_seeded<R>(n, k, dpf, write) : generate_preproc<R>(n, k, dpf, write);
+    });
+}
+
+// Offline mode (--preproc-out PREFIX): generate the preprocessing of all Q queries exactly as the live
+// ring would (same generators, same per-query streams with --rng-seed) and write each party's half to
+// PREFIX_p<party>.pre (preproc_file.hpp), one write per batch of opt.batch queries.
+template <RingWord R = Ring>
+inline void write_preproc_files(const std::string &prefix, int n, int k, int Q, const Options &opt)
+{
+    PreprocRing<R> ring = make_preproc_ring<R>(n, k, Q, opt);
+    ring.start(opt.workers);
+    PreprocFileWriter<R> out0(preproc_file_path(prefix, 0), 0, n, k, Q, opt.seeded, opt.dpf, opt.update_items);
+    PreprocFileWriter<R> out1(preproc_file_path(prefix, 1), 1, n, k, Q, opt.seeded, opt.dpf, opt.update_items);
+    for (int q = 0; q < Q; q += opt.batch) {
+        int B = std::min(opt.batch, Q - q);
+        std::vector<Preproc<R>> p0, p1;
+        for (int b = 0; b < B; ++b) {
+            p0.push_back(ring.take_blocking(q + b, 0));
+            p1.push_back(ring.take_blocking(q + b, 1));
+        }
+        out0.append(std::span<const Preproc<R>>(p0));
+        out1.append(std::span<const Preproc<R>>(p1));
+    }
+    out0.finish();
+    out1.finish();
+}
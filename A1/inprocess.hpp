@@ -0,0 +1,117 @@
+#pragma once
+// The three parties in one process: P0, P1 and P2 run as threads on the same code as the real binaries
+// (party.hpp, helper.hpp), connected by channels (channel.hpp): shared memory rings, AF_UNIX socket
+// pairs or loopback TCP, so no docker, hostnames or files are involved. Used by bench_protocol and
+// rounds_test.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <exception>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/asio/local/connect_pair.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include "channel.hpp"
+#include "common.hpp"
+#include "helper.hpp"
+#include "metrics.hpp"
+#include "options.hpp"
+#include "party.hpp"
+
+struct BenchConfig {
+    int m, n, k, q, batch;
+};
+
+struct RunResult {
+    double seconds = 0;
+    std::vector<double> latency; // P0's per-query latencies
+    uint64_t sent[3] = {0, 0, 0}; // bytes sent by P0, P1, P2
+    uint64_t rounds = 0;          // P0's rounds on the peer link
+    uint64_t planned_rounds = 0;  // the rounds P0's protocol flow implies (PartyStats)
+    std::map<std::string, Metrics::Totals> phases; // P0's per-phase breakdown
+};
+
+// Query files as gen_queries writes them, in memory. With distinct_users query t is on user t % m, so
+// a batch of at most m queries is a single wave (party.hpp); otherwise the users are random.
+inline void make_queries(const BenchConfig &c, std::stringstream &f1, std::stringstream &f2, bool distinct_users = false) {
+    f1 << c.m << " " << c.n << " " << c.k << " " << c.q << "\n";
+    f2 << c.m << " " << c.n << " " << c.k << " " << c.q << "\n";
+    for (int t = 0; t < c.q; t++) {
+        uint32_t i = distinct_users ? t % c.m : thread_rng().next_u32() % c.m;
+        uint32_t j = thread_rng().next_u32() % c.n;
+        int j0 = static_cast<int>(thread_rng().next_u32() % (2 * c.n));
+        f1 << i << " " << j0 << "\n";
+        f2 << i << " " << static_cast<int>(j) - j0 << "\n";
+    }
+}
+
+// Connected channel pairs, one end on each io_context.
+inline std::pair<Channel, Channel> connect_pair(const std::string &transport, boost::asio::io_context &a, boost::asio::io_context &b, size_t buffer) {
+    namespace asio = boost::asio;
+    if (transport == "shm") return Channel::shm_pair(a.get_executor(), b.get_executor(), buffer);
+    if (transport == "unix") {
+        asio::local::stream_protocol::socket x(a), y(b);
+        asio::local::connect_pair(x, y);
+        return {Channel::from_socket(std::move(x), buffer), Channel::from_socket(std::move(y), buffer)};
+    }
+    tcp::acceptor acceptor(b, tcp::endpoint(asio::ip::address_v4::loopback(), 0));
+    tcp::socket x(a), y(b);
+    x.connect(acceptor.local_endpoint());
+    acceptor.accept(y);
+    return {Channel::from_socket(std::move(x), buffer), Channel::from_socket(std::move(y), buffer)};
+}
+
+// One run of the queries in f1 / f2 (c.q of them, in batches of c.batch), with fresh shares in memory or,
+// with share_files, on the parties' share files (share_store.hpp) as they are.
+inline RunResult run_in_process(const std::string &transport, const BenchConfig &c, Options opt, std::istream &f1, std::istream &f2,
+                                const std::array<std::string, 2> &share_files = {}) {
+    namespace asio = boost::asio;
+    opt.batch = c.batch;
+
+    asio::io_context io0(1), io1(1), io2(1);
+    auto [s0, c0] = connect_pair(transport, io0, io2, opt.buffer);
+    auto [s1, c1] = connect_pair(transport, io1, io2, opt.buffer);
+    auto [peer0, peer1] = connect_pair(transport, io0, io1, opt.buffer);
+
+    // (with --local-preproc P2 has nothing to do and its threads return at once)
+    PreprocRing ring = make_preproc_ring(c.n, c.k, c.q, opt);
+    auto serve0 = [&]() -> awaitable<void> { co_await handle_client(c0, "P0", ring, 0, c.n, c.k, c.q, opt.batch, opt.seeded); };
+    auto serve1 = [&]() -> awaitable<void> { co_await handle_client(c1, "P1", ring, 1, c.n, c.k, c.q, opt.batch, opt.seeded); };
+    if (!opt.local_preproc) {
+        ring.start(opt.workers);
+        asio::co_spawn(io2, serve0, asio::detached);
+        asio::co_spawn(io2, serve1, asio::detached);
+    }
+
+    QueryReader q0(f1), q1(f2);
+    Metrics metrics0(0);
+    PartyIO io_p0{0, &q0, share_files[0], "", nullptr, &metrics0}, io_p1{1, &q1, share_files[1], "", nullptr};
+    PartyStats st0, st1;
+    std::exception_ptr err0, err1;
+    asio::co_spawn(io0, run_party(s0, peer0, opt, io_p0, &st0), [&](std::exception_ptr e) { err0 = e; });
+    asio::co_spawn(io1, run_party(s1, peer1, opt, io_p1, &st1), [&](std::exception_ptr e) { err1 = e; });
+
+    // one io thread per party, as in the real binaries
+    std::vector<std::thread> threads;
+    threads.emplace_back([&] { io2.run(); });
+    threads.emplace_back([&] { io1.run(); });
+    io0.run();
+    for (auto &t : threads) t.join();
+    if (err0) std::rethrow_exception(err0);
+    if (err1) std::rethrow_exception(err1);
+
+    RunResult r;
+    r.seconds = std::chrono::duration<double>(std::max(st0.end, st1.end) - std::min(st0.begin, st1.begin)).count();
+    r.latency = std::move(st0.query_latency);
+    r.sent[0] = s0.counters().bytes_sent + peer0.counters().bytes_sent;
+    r.sent[1] = s1.counters().bytes_sent + peer1.counters().bytes_sent;
+    r.sent[2] = c0.counters().bytes_sent + c1.counters().bytes_sent;
+    r.rounds = peer0.counters().rounds;
+    r.planned_rounds = st0.planned_rounds;
+    r.phases = metrics0.totals();
+    return r;
+}
@@ -0,0 +1,84 @@
+#pragma once
+// Oblivious writes into the item matrix V (--update-items), in the style of Duoram's write-only memory.
+// A query ends with v_j <- v_j + w for w = u_i * delta, with j hidden from both parties. The update is
+// the point function e_j scaled by the shared vector w, e_j x w, added into both shares of V.
+//
+// P2 gives each party a mask Y_b (k elements) and a share M_b (n x k) of e_alpha x Y, where
+// Y = Y_0 + Y_1 (helper.hpp: generate_write_cross). The parties open D = w + Y, which is k ring
+// elements per direction, and then
+//   e_alpha_b x D - M_b
+// are shares of e_alpha x w. Rotating the rows by the public shift of the read (j - alpha) turns them
+// into shares of e_j x w. Each party adds its share into its V share. All the writes of a batch go in
+// one pass over the rows.
+//
+// The blinded database is left alone. A party subtracts the same share from its blinds r, so v + r is
+// unchanged, and so are v_dash and v_masked = V + r0 + r1. A later read of row j, v_masked[j] -
+// (r0 + r1)[j], sees the write anyway. Rebuilds and row refreshes re-blind from the updated v as before.
+// Online a write costs O(k): the opening of D here and the product u_i * delta in the user update's rounds.
+
+#include <span>
+#include <vector>
+#include "common.hpp"
+#include "round.hpp"
+#include "shares.hpp"
+
+template <RingWord R>
+class ItemWrites {
+    public:
+        explicit ItemWrites(int k) : k_(k) {}
+
+        bool empty() const { return pending_.empty(); }
+
+        // Queue a write. w is this party's share of the row update and mask its Y_b; the query's e_alpha
+        // share and M_b are taken over.
+        void add(int shift, std::vector<R> e_alpha, Matrix<R> cross, std::span<const R> w, std::span<const R> mask) {
+            const int n = static_cast<int>(e_alpha.size());
+            for (int c = 0; c < k_; c++) masked_.push_back(w[c] + mask[c]);
+            pending_.push_back({((shift % n) + n) % n, std::move(e_alpha), std::move(cross)});
+        }
+
+        // D_b = w + Y_b of every queued write, for the peer
+        void post(Round& round) {
+            peer_.assign(masked_.size(), 0);
+            round.add(masked_, peer_);
+        }
+
+        // After the round: the queued writes go into v, and out of r again.
+        awaitable<void> apply(Share<R>& share, ThreadPool& pool) {
+            const int n = share.n;
+            std::vector<R> open(masked_.size());
+            for (size_t i = 0; i < open.size(); i++) open[i] = masked_[i] + peer_[i];
+            co_await offload(pool, [&] {
+                pool.parallel_for(0, n, row_grain(k_), [&](size_t lo, size_t hi) {
+                    for (size_t row = lo; row < hi; row++) {
+                        R *v = share.v[row].data(), *r = share.r[row].data();
+                        for (size_t w = 0; w < pending_.size(); w++) {
+                            const Write &wr = pending_[w];
+                            size_t src = (row + n - wr.shift) % n; // e_j[row] = e_alpha[row - shift]
+                            R e = wr.e_alpha[src];
+                            const R *d = open.data() + w * k_, *m = wr.cross[src].data();
+                            for (int c = 0; c < k_; c++) {
+                                R delta = e * d[c] - m[c];
+                                v[c] += delta;
+                                r[c] -= delta;
+                            }
+                        }
+                    }
+                });
+            });
+            pending_.clear();
+            masked_.clear();
+            co_return;
+        }
+
+    private:
+        struct Write {
+            int shift;              // j - alpha, in [0, n)
+            std::vector<R> e_alpha; // this party's share of e_alpha
+            Matrix<R> cross;        // M_b
+        };
+
+        int k_;
+        std::vector<Write> pending_;
+        std::vector<R> masked_, peer_; // D_b of the queued writes, k each, and the peer's
+};
@@ -0,0 +1,481 @@
+#pragma once
+// Vectorized local kernels of the read path, in ring arithmetic (all sums and products wrap mod 2^w,
+// for the ring word types of ring.hpp).
+//
+// Every kernel has a scalar reference, templated on the ring word, and AVX2 / AVX-512 versions for
+// 32-bit and 64-bit rings, chosen at runtime from the CPU flags (prg_detail::detect_simd). The matrix
+// kernels walk the rows of a row-major n x k matrix once, accumulating every column block of the row
+// (8/16 columns of 32 bits, 4/8 columns of 64 bits) in its own register; a ragged last block is handled
+// with masked loads. 64-bit lanes multiply with three 32 x 32 -> 64 products (vpmuludq), which needs
+// nothing beyond AVX2 / AVX-512F. Z_2^128 has no SIMD multiply worth having and uses the scalar code.
+//
+//   ring_dot            sum_i a[i] * b[i]
+//   ring_weighted_rows  out[c] = sum_i w[i] * M[i][c]                    (<e_j, V_masked>)
+//   ring_colwise_dot    out[c] = sum_i A[i][c] * B[i][c]
+//   ring_fused_read     one pass over the read path's matrices, see FusedRead
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include "prg.hpp"
+#include "ring.hpp"
+
+// Inputs of the fused mask removal of one query (all n x k row-major, e has n entries):
+//   v_j[c] = sum_i e[i] * v_masked[i][c]                                   (skipped if v_masked is null)
+//   rs[c]  = sum_i e[i] * (y_dash[i][c] + r[i][c]) - y_n[i][c] * x_dash[i][c]
+// i.e. <e_j, V_masked> and the two colwise_dot terms of the Du-Atallah unmasking, without
+// materializing the e_j matrix or y_dash + r.
+template <RingWord R>
+struct FusedRead {
+    const R* e;
+    const R* v_masked;
+    const R* y_dash;
+    const R* r;
+    const R* y_n;
+    const R* x_dash;
+    size_t n, k;
+    R* v_j; // k outputs (unused if v_masked is null)
+    R* rs;  // k outputs
+};
+
+namespace kernel_detail {
+
+// ---------------------- scalar reference ----------------------
+
+template <RingWord R>
+inline R dot_scalar(const R* a, const R* b, size_t n) {
+    R s = 0;
+    for (size_t i = 0; i < n; ++i) s += a[i] * b[i];
+    return s;
+}
+
+template <RingWord R>
+inline void weighted_rows_scalar(const R* w, const R* M, size_t n, size_t k, R* out) {
+    for (size_t c = 0; c < k; ++c) out[c] = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const R* row = M + i * k;
+        for (size_t c = 0; c < k; ++c) out[c] += w[i] * row[c];
+    }
+}
+
+template <RingWord R>
+inline void colwise_scalar(const R* A, const R* B, size_t n, size_t k, R* out) {
+    for (size_t c = 0; c < k; ++c) out[c] = 0;
+    for (size_t i = 0; i < n * k; i += k) {
+        for (size_t c = 0; c < k; ++c) out[c] += A[i + c] * B[i + c];
+    }
+}
+
+template <RingWord R>
+inline void fused_read_scalar(const FusedRead<R>& f) {
+    for (size_t c = 0; c < f.k; ++c) {
+        f.rs[c] = 0;
+        if (f.v_masked) f.v_j[c] = 0;
+    }
+    for (size_t i = 0; i < f.n; ++i) {
+        size_t o = i * f.k;
+        for (size_t c = 0; c < f.k; ++c) {
+            if (f.v_masked) f.v_j[c] += f.e[i] * f.v_masked[o + c];
+            f.rs[c] += f.e[i] * (f.y_dash[o + c] + f.r[o + c]) - f.y_n[o + c] * f.x_dash[o + c];
+        }
+    }
+}
+
+#ifdef PRG_HAVE_X86
+
+// The matrix kernels stream the rows once per group of up to group_blocks column blocks (128 columns
+// with AVX-512, 64 with AVX2), keeping one accumulator per block in registers.
+constexpr size_t group_blocks = 8;
+
+// ---------------------- AVX2 (8 lanes) ----------------------
+
+__attribute__((target("avx2"))) inline __m256i tail_mask8(size_t count) {
+    return _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(count)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+}
+
+__attribute__((target("avx2"))) inline __m256i load8(const uint32_t* p, __m256i mask) {
+    return _mm256_maskload_epi32(reinterpret_cast<const int*>(p), mask);
+}
+
+__attribute__((target("avx2"))) inline uint32_t dot_avx2(const uint32_t* a, const uint32_t* b, size_t n) {
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(x, y));
+    }
+    if (i < n) {
+        __m256i m = tail_mask8(n - i);
+        acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(load8(a + i, m), load8(b + i, m)));
+    }
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+    return static_cast<uint32_t>(_mm_cvtsi128_si32(s));
+}
+
+__attribute__((target("avx2"))) inline void weighted_rows_avx2(const uint32_t* w, const uint32_t* M, size_t n, size_t k, uint32_t* out) {
+    for (size_t g0 = 0; g0 < k; g0 += 8 * group_blocks) {
+        size_t nb = std::min(group_blocks, (k - g0 + 7) / 8);
+        __m256i acc[group_blocks], m[group_blocks];
+        for (size_t b = 0; b < nb; ++b) { acc[b] = _mm256_setzero_si256(); m[b] = tail_mask8(k - g0 - 8 * b); }
+        for (size_t i = 0; i < n; ++i) {
+            const uint32_t* row = M + i * k + g0;
+            __m256i wi = _mm256_set1_epi32(static_cast<int>(w[i]));
+            for (size_t b = 0; b < nb; ++b) acc[b] = _mm256_add_epi32(acc[b], _mm256_mullo_epi32(wi, load8(row + 8 * b, m[b])));
+        }
+        for (size_t b = 0; b < nb; ++b) _mm256_maskstore_epi32(reinterpret_cast<int*>(out + g0 + 8 * b), m[b], acc[b]);
+    }
+}
+
+__attribute__((target("avx2"))) inline void colwise_avx2(const uint32_t* A, const uint32_t* B, size_t n, size_t k, uint32_t* out) {
+    for (size_t g0 = 0; g0 < k; g0 += 8 * group_blocks) {
+        size_t nb = std::min(group_blocks, (k - g0 + 7) / 8);
+        __m256i acc[group_blocks], m[group_blocks];
+        for (size_t b = 0; b < nb; ++b) { acc[b] = _mm256_setzero_si256(); m[b] = tail_mask8(k - g0 - 8 * b); }
+        for (size_t o = g0; o < n * k; o += k) {
+            for (size_t b = 0; b < nb; ++b) {
+                acc[b] = _mm256_add_epi32(acc[b], _mm256_mullo_epi32(load8(A + o + 8 * b, m[b]), load8(B + o + 8 * b, m[b])));
+            }
+        }
+        for (size_t b = 0; b < nb; ++b) _mm256_maskstore_epi32(reinterpret_cast<int*>(out + g0 + 8 * b), m[b], acc[b]);
+    }
+}
+
+__attribute__((target("avx2"))) inline void fused_read_avx2(const FusedRead<uint32_t>& f) {
+    for (size_t g0 = 0; g0 < f.k; g0 += 8 * group_blocks) {
+        size_t nb = std::min(group_blocks, (f.k - g0 + 7) / 8);
+        __m256i acc_v[group_blocks], acc_r[group_blocks], m[group_blocks];
+        for (size_t b = 0; b < nb; ++b) {
+            acc_v[b] = acc_r[b] = _mm256_setzero_si256();
+            m[b] = tail_mask8(f.k - g0 - 8 * b);
+        }
+        for (size_t i = 0; i < f.n; ++i) {
+            __m256i ei = _mm256_set1_epi32(static_cast<int>(f.e[i]));
+            for (size_t b = 0; b < nb; ++b) {
+                size_t o = i * f.k + g0 + 8 * b;
+                if (f.v_masked) acc_v[b] = _mm256_add_epi32(acc_v[b], _mm256_mullo_epi32(ei, load8(f.v_masked + o, m[b])));
+                __m256i yr = _mm256_add_epi32(load8(f.y_dash + o, m[b]), load8(f.r + o, m[b]));
+                acc_r[b] = _mm256_add_epi32(acc_r[b], _mm256_mullo_epi32(ei, yr));
+                acc_r[b] = _mm256_sub_epi32(acc_r[b], _mm256_mullo_epi32(load8(f.y_n + o, m[b]), load8(f.x_dash + o, m[b])));
+            }
+        }
+        for (size_t b = 0; b < nb; ++b) {
+            if (f.v_masked) _mm256_maskstore_epi32(reinterpret_cast<int*>(f.v_j + g0 + 8 * b), m[b], acc_v[b]);
+            _mm256_maskstore_epi32(reinterpret_cast<int*>(f.rs + g0 + 8 * b), m[b], acc_r[b]);
+        }
+    }
+}
+
+// ---------------------- AVX-512 (16 lanes) ----------------------
+
+inline __mmask16 tail_mask16(size_t count) {
+    return count >= 16 ? static_cast<__mmask16>(0xffff) : static_cast<__mmask16>((1u << count) - 1);
+}
+
+__attribute__((target("avx512f"))) inline uint32_t dot_avx512(const uint32_t* a, const uint32_t* b, size_t n) {
+    __m512i acc = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        acc = _mm512_add_epi32(acc, _mm512_mullo_epi32(_mm512_loadu_si512(a + i), _mm512_loadu_si512(b + i)));
+    }
+    if (i < n) {
+        __mmask16 m = tail_mask16(n - i);
+        acc = _mm512_add_epi32(acc, _mm512_mullo_epi32(_mm512_maskz_loadu_epi32(m, a + i), _mm512_maskz_loadu_epi32(m, b + i)));
+    }
+    return static_cast<uint32_t>(_mm512_reduce_add_epi32(acc));
+}
+
+__attribute__((target("avx512f"))) inline void weighted_rows_avx512(const uint32_t* w, const uint32_t* M, size_t n, size_t k, uint32_t* out) {
+    for (size_t g0 = 0; g0 < k; g0 += 16 * group_blocks) {
+        size_t nb = std::min(group_blocks, (k - g0 + 15) / 16);
+        __m512i acc[group_blocks];
+        __mmask16 m[group_blocks];
+        for (size_t b = 0; b < nb; ++b) { acc[b] = _mm512_setzero_si512(); m[b] = tail_mask16(k - g0 - 16 * b); }
+        for (size_t i = 0; i < n; ++i) {
+            const uint32_t* row = M + i * k + g0;
+            __m512i wi = _mm512_set1_epi32(static_cast<int>(w[i]));
+            for (size_t b = 0; b < nb; ++b) {
+                acc[b] = _mm512_add_epi32(acc[b], _mm512_mullo_epi32(wi, _mm512_maskz_loadu_epi32(m[b], row + 16 * b)));
+            }
+        }
+        for (size_t b = 0; b < nb; ++b) _mm512_mask_storeu_epi32(out + g0 + 16 * b, m[b], acc[b]);
+    }
+}
+
+__attribute__((target("avx512f"))) inline void colwise_avx512(const uint32_t* A, const uint32_t* B, size_t n, size_t k, uint32_t* out) {
+    for (size_t g0 = 0; g0 < k; g0 += 16 * group_blocks) {
+        size_t nb = std::min(group_blocks, (k - g0 + 15) / 16);
+        __m512i acc[group_blocks];
+        __mmask16 m[group_blocks];
+        for (size_t b = 0; b < nb; ++b) { acc[b] = _mm512_setzero_si512(); m[b] = tail_mask16(k - g0 - 16 * b); }
+        for (size_t o = g0; o < n * k; o += k) {
+            for (size_t b = 0; b < nb; ++b) {
+                __m512i x = _mm512_maskz_loadu_epi32(m[b], A + o + 16 * b), y = _mm512_maskz_loadu_epi32(m[b], B + o + 16 * b);
+                acc[b] = _mm512_add_epi32(acc[b], _mm512_mullo_epi32(x, y));
+            }
+        }
+        for (size_t b = 0; b < nb; ++b) _mm512_mask_storeu_epi32(out + g0 + 16 * b, m[b], acc[b]);
+    }
+}
+
+__attribute__((target("avx512f"))) inline void fused_read_avx512(const FusedRead<uint32_t>& f) {
+    for (size_t g0 = 0; g0 < f.k; g0 += 16 * group_blocks) {
+        size_t nb = std::min(group_blocks, (f.k - g0 + 15) / 16);
+        __m512i acc_v[group_blocks], acc_r[group_blocks];
+        __mmask16 m[group_blocks];
+        for (size_t b = 0; b < nb; ++b) {
+            acc_v[b] = acc_r[b] = _mm512_setzero_si512();
+            m[b] = tail_mask16(f.k - g0 - 16 * b);
+        }
+        for (size_t i = 0; i < f.n; ++i) {
+            __m512i ei = _mm512_set1_epi32(static_cast<int>(f.e[i]));
+            for (size_t b = 0; b < nb; ++b) {
+                size_t o = i * f.k + g0 + 16 * b;
+                if (f.v_masked) acc_v[b] = _mm512_add_epi32(acc_v[b], _mm512_mullo_epi32(ei, _mm512_maskz_loadu_epi32(m[b], f.v_masked + o)));
+                __m512i yr = _mm512_add_epi32(_mm512_maskz_loadu_epi32(m[b], f.y_dash + o), _mm512_maskz_loadu_epi32(m[b], f.r + o));
+                acc_r[b] = _mm512_add_epi32(acc_r[b], _mm512_mullo_epi32(ei, yr));
+                __m512i yx = _mm512_mullo_epi32(_mm512_maskz_loadu_epi32(m[b], f.y_n + o), _mm512_maskz_loadu_epi32(m[b], f.x_dash + o));
+                acc_r[b] = _mm512_sub_epi32(acc_r[b], yx);
+            }
+        }
+        for (size_t b = 0; b < nb; ++b) {
+            if (f.v_masked) _mm512_mask_storeu_epi32(f.v_j + g0 + 16 * b, m[b], acc_v[b]);
+            _mm512_mask_storeu_epi32(f.rs + g0 + 16 * b, m[b], acc_r[b]);
+        }
+    }
+}
+
+// ---------------------- AVX2, 64-bit lanes (4 lanes) ----------------------
+
+__attribute__((target("avx2"))) inline __m256i tail_mask4x64(size_t count) {
+    return _mm256_cmpgt_epi64(_mm256_set1_epi64x(static_cast<long long>(std::min<size_t>(count, 4))), _mm256_setr_epi64x(0, 1, 2, 3));
+}
+
+__attribute__((target("avx2"))) inline __m256i load4x64(const uint64_t* p, __m256i mask) {
+    return _mm256_maskload_epi64(reinterpret_cast<const long long*>(p), mask);
+}
+
+// a * b mod 2^64 per lane: lo*lo + ((hi*lo + lo*hi) << 32)
+__attribute__((target("avx2"))) inline __m256i mullo64_avx2(__m256i a, __m256i b) {
+    __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b), _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+    return _mm256_add_epi64(_mm256_mul_epu32(a, b), _mm256_slli_epi64(cross, 32));
+}
+
+__attribute__((target("avx2"))) inline uint64_t dot_avx2(const uint64_t* a, const uint64_t* b, size_t n) {
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        acc = _mm256_add_epi64(acc, mullo64_avx2(x, y));
+    }
+    if (i < n) {
+        __m256i m = tail_mask4x64(n - i);
+        acc = _mm256_add_epi64(acc, mullo64_avx2(load4x64(a + i, m), load4x64(b + i, m)));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), acc);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+__attribute__((target("avx2"))) inline void weighted_rows_avx2(const uint64_t* w, const uint64_t* M, size_t n, size_t k, uint64_t* out) {
+    for (size_t g0 = 0; g0 < k; g0 += 4 * group_blocks) {
+        size_t nb = std::min(group_blocks, (k - g0 + 3) / 4);
+        __m256i acc[group_blocks], m[group_blocks];
+        for (size_t b = 0; b < nb; ++b) { acc[b] = _mm256_setzero_si256(); m[b] = tail_mask4x64(k - g0 - 4 * b); }
+        for (size_t i = 0; i < n; ++i) {
+            const uint64_t* row = M + i * k + g0;
+            __m256i wi = _mm256_set1_epi64x(static_cast<long long>(w[i]));
+            for (size_t b = 0; b < nb; ++b) acc[b] = _mm256_add_epi64(acc[b], mullo64_avx2(wi, load4x64(row + 4 * b, m[b])));
+        }
+        for (size_t b = 0; b < nb; ++b) _mm256_maskstore_epi64(reinterpret_cast<long long*>(out + g0 + 4 * b), m[b], acc[b]);
+    }
+}
+
+__attribute__((target("avx2"))) inline void colwise_avx2(const uint64_t* A, const uint64_t* B, size_t n, size_t k, uint64_t* out) {
+    for (size_t g0 = 0; g0 < k; g0 += 4 * group_blocks) {
+        size_t nb = std::min(group_blocks, (k - g0 + 3) / 4);
+        __m256i acc[group_blocks], m[group_blocks];
+        for (size_t b = 0; b < nb; ++b) { acc[b] = _mm256_setzero_si256(); m[b] = tail_mask4x64(k - g0 - 4 * b); }
+        for (size_t o = g0; o < n * k; o += k) {
+            for (size_t b = 0; b < nb; ++b) {
+                acc[b] = _mm256_add_epi64(acc[b], mullo64_avx2(load4x64(A + o + 4 * b, m[b]), load4x64(B + o + 4 * b, m[b])));
+            }
+        }
+        for (size_t b = 0; b < nb; ++b) _mm256_maskstore_epi64(reinterpret_cast<long long*>(out + g0 + 4 * b), m[b], acc[b]);
+    }
+}
+
+__attribute__((target("avx2"))) inline void fused_read_avx2(const FusedRead<uint64_t>& f) {
+    for (size_t g0 = 0; g0 < f.k; g0 += 4 * group_blocks) {
+        size_t nb = std::min(group_blocks, (f.k - g0 + 3) / 4);
+        __m256i acc_v[group_blocks], acc_r[group_blocks], m[group_blocks];
+        for (size_t b = 0; b < nb; ++b) {
+            acc_v[b] = acc_r[b] = _mm256_setzero_si256();
+            m[b] = tail_mask4x64(f.k - g0 - 4 * b);
+        }
+        for (size_t i = 0; i < f.n; ++i) {
+            __m256i ei = _mm256_set1_epi64x(static_cast<long long>(f.e[i]));
+            for (size_t b = 0; b < nb; ++b) {
+                size_t o = i * f.k + g0 + 4 * b;
+                if (f.v_masked) acc_v[b] = _mm256_add_epi64(acc_v[b], mullo64_avx2(ei, load4x64(f.v_masked + o, m[b])));
+                __m256i yr = _mm256_add_epi64(load4x64(f.y_dash + o, m[b]), load4x64(f.r + o, m[b]));
+                acc_r[b] = _mm256_add_epi64(acc_r[b], mullo64_avx2(ei, yr));
+                acc_r[b] = _mm256_sub_epi64(acc_r[b], mullo64_avx2(load4x64(f.y_n + o, m[b]), load4x64(f.x_dash + o, m[b])));
+            }
+        }
+        for (size_t b = 0; b < nb; ++b) {
+            if (f.v_masked) _mm256_maskstore_epi64(reinterpret_cast<long long*>(f.v_j + g0 + 4 * b), m[b], acc_v[b]);
+            _mm256_maskstore_epi64(reinterpret_cast<long long*>(f.rs + g0 + 4 * b), m[b], acc_r[b]);
+        }
+    }
+}
+
+// ---------------------- AVX-512, 64-bit lanes (8 lanes) ----------------------
+
+inline __mmask8 tail_mask8x64(size_t count) {
+    return count >= 8 ? static_cast<__mmask8>(0xff) : static_cast<__mmask8>((1u << count) - 1);
+}
+
+__attribute__((target("avx512f"))) inline __m512i mullo64_avx512(__m512i a, __m512i b) {
+    __m512i cross = _mm512_add_epi64(_mm512_mul_epu32(_mm512_srli_epi64(a, 32), b), _mm512_mul_epu32(a, _mm512_srli_epi64(b, 32)));
+    return _mm512_add_epi64(_mm512_mul_epu32(a, b), _mm512_slli_epi64(cross, 32));
+}
+
+__attribute__((target("avx512f"))) inline uint64_t dot_avx512(const uint64_t* a, const uint64_t* b, size_t n) {
+    __m512i acc = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc = _mm512_add_epi64(acc, mullo64_avx512(_mm512_loadu_si512(a + i), _mm512_loadu_si512(b + i)));
+    }
+    if (i < n) {
+        __mmask8 m = tail_mask8x64(n - i);
+        acc = _mm512_add_epi64(acc, mullo64_avx512(_mm512_maskz_loadu_epi64(m, a + i), _mm512_maskz_loadu_epi64(m, b + i)));
+    }
+    return static_cast<uint64_t>(_mm512_reduce_add_epi64(acc));
+}
+
+__attribute__((target("avx512f"))) inline void weighted_rows_avx512(const uint64_t* w, const uint64_t* M, size_t n, size_t k, uint64_t* out) {
+    for (size_t g0 = 0; g0 < k; g0 += 8 * group_blocks) {
+        size_t nb = std::min(group_blocks, (k - g0 + 7) / 8);
+        __m512i acc[group_blocks];
+        __mmask8 m[group_blocks];
+        for (size_t b = 0; b < nb; ++b) { acc[b] = _mm512_setzero_si512(); m[b] = tail_mask8x64(k - g0 - 8 * b); }
+        for (size_t i = 0; i < n; ++i) {
+            const uint64_t* row = M + i * k + g0;
+            __m512i wi = _mm512_set1_epi64(static_cast<long long>(w[i]));
+            for (size_t b = 0; b < nb; ++b) {
+                acc[b] = _mm512_add_epi64(acc[b], mullo64_avx512(wi, _mm512_maskz_loadu_epi64(m[b], row + 8 * b)));
+            }
+        }
+        for (size_t b = 0; b < nb; ++b) _mm512_mask_storeu_epi64(out + g0 + 8 * b, m[b], acc[b]);
+    }
+}
+
+__attribute__((target("avx512f"))) inline void colwise_avx512(const uint64_t* A, const uint64_t* B, size_t n, size_t k, uint64_t* out) {
+    for (size_t g0 = 0; g0 < k; g0 += 8 * group_blocks) {
+        size_t nb = std::min(group_blocks, (k - g0 + 7) / 8);
+        __m512i acc[group_blocks];
+        __mmask8 m[group_blocks];
+        for (size_t b = 0; b < nb; ++b) { acc[b] = _mm512_setzero_si512(); m[b] = tail_mask8x64(k - g0 - 8 * b); }
+        for (size_t o = g0; o < n * k; o += k) {
+            for (size_t b = 0; b < nb; ++b) {
+                __m512i x = _mm512_maskz_loadu_epi64(m[b], A + o + 8 * b), y = _mm512_maskz_loadu_epi64(m[b], B + o + 8 * b);
+                acc[b] = _mm512_add_epi64(acc[b], mullo64_avx512(x, y));
+            }
+        }
+        for (size_t b = 0; b < nb; ++b) _mm512_mask_storeu_epi64(out + g0 + 8 * b, m[b], acc[b]);
+    }
+}
+
+__attribute__((target("avx512f"))) inline void fused_read_avx512(const FusedRead<uint64_t>& f) {
+    for (size_t g0 = 0; g0 < f.k; g0 += 8 * group_blocks) {
+        size_t nb = std::min(group_blocks, (f.k - g0 + 7) / 8);
+        __m512i acc_v[group_blocks], acc_r[group_blocks];
+        __mmask8 m[group_blocks];
+        for (size_t b = 0; b < nb; ++b) {
+            acc_v[b] = acc_r[b] = _mm512_setzero_si512();
+            m[b] = tail_mask8x64(f.k - g0 - 8 * b);
+        }
+        for (size_t i = 0; i < f.n; ++i) {
+            __m512i ei = _mm512_set1_epi64(static_cast<long long>(f.e[i]));
+            for (size_t b = 0; b < nb; ++b) {
+                size_t o = i * f.k + g0 + 8 * b;
+                if (f.v_masked) acc_v[b] = _mm512_add_epi64(acc_v[b], mullo64_avx512(ei, _mm512_maskz_loadu_epi64(m[b], f.v_masked + o)));
+                __m512i yr = _mm512_add_epi64(_mm512_maskz_loadu_epi64(m[b], f.y_dash + o), _mm512_maskz_loadu_epi64(m[b], f.r + o));
+                acc_r[b] = _mm512_add_epi64(acc_r[b], mullo64_avx512(ei, yr));
+                __m512i yx = mullo64_avx512(_mm512_maskz_loadu_epi64(m[b], f.y_n + o), _mm512_maskz_loadu_epi64(m[b], f.x_dash + o));
+                acc_r[b] = _mm512_sub_epi64(acc_r[b], yx);
+            }
+        }
+        for (size_t b = 0; b < nb; ++b) {
+            if (f.v_masked) _mm512_mask_storeu_epi64(f.v_j + g0 + 8 * b, m[b], acc_v[b]);
+            _mm512_mask_storeu_epi64(f.rs + g0 + 8 * b, m[b], acc_r[b]);
+        }
+    }
+}
+
+#endif // PRG_HAVE_X86
+
+} // namespace kernel_detail
+
+// ---------------------- dispatch ----------------------
+// 32-bit and 64-bit rings pick the SIMD overload for their word type; Z_2^128 is scalar.
+
+template <RingWord R>
+inline R ring_dot(const R* a, const R* b, size_t n) {
+#ifdef PRG_HAVE_X86
+    if constexpr (sizeof(R) <= 8) {
+        switch (prg_detail::detect_simd()) {
+            case prg_detail::SimdLevel::avx512: return kernel_detail::dot_avx512(a, b, n);
+            case prg_detail::SimdLevel::avx2: return kernel_detail::dot_avx2(a, b, n);
+            default: break;
+        }
+    }
+#endif
+    return kernel_detail::dot_scalar(a, b, n);
+}
+
+template <RingWord R>
+inline void ring_weighted_rows(const R* w, const R* M, size_t n, size_t k, R* out) {
+#ifdef PRG_HAVE_X86
+    if constexpr (sizeof(R) <= 8) {
+        switch (prg_detail::detect_simd()) {
+            case prg_detail::SimdLevel::avx512: return kernel_detail::weighted_rows_avx512(w, M, n, k, out);
+            case prg_detail::SimdLevel::avx2: return kernel_detail::weighted_rows_avx2(w, M, n, k, out);
+            default: break;
+        }
+    }
+#endif
+    kernel_detail::weighted_rows_scalar(w, M, n, k, out);
+}
+
+template <RingWord R>
+inline void ring_colwise_dot(const R* A, const R* B, size_t n, size_t k, R* out) {
+#ifdef PRG_HAVE_X86
+    if constexpr (sizeof(R) <= 8) {
+        switch (prg_detail::detect_simd()) {
+            case prg_detail::SimdLevel::avx512: return kernel_detail::colwise_avx512(A, B, n, k, out);
+            case prg_detail::SimdLevel::avx2: return kernel_detail::colwise_avx2(A, B, n, k, out);
+            default: break;
+        }
+    }
+#endif
+    kernel_detail::colwise_scalar(A, B, n, k, out);
+}
+
+template <RingWord R>
+inline void ring_fused_read(const FusedRead<R>& f) {
+#ifdef PRG_HAVE_X86
+    if constexpr (sizeof(R) <= 8) {
+        switch (prg_detail::detect_simd()) {
+            case prg_detail::SimdLevel::avx512: return kernel_detail::fused_read_avx512(f);
+            case prg_detail::SimdLevel::avx2: return kernel_detail::fused_read_avx2(f);
+            default: break;
+        }
+    }
+#endif
+    kernel_detail::fused_read_scalar(f);
+}
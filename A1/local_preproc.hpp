@@ -0,0 +1,220 @@
+#pragma once
+// P2-free preprocessing (--local-preproc): P0 and P1 generate the correlated randomness of every query
+// between themselves, with OT extension over the peer link (ot.hpp), instead of receiving it from P2.
+// The bundles satisfy the same relations as P2's (helper.hpp: generate_preproc), so the online protocol
+// runs on them unchanged:
+//
+//   Du-Atallah corrections. Each party draws its own masks x, y uniformly over Z_2^w; the corrections
+//   need shares of the cross terms x0 * y1 and x1 * y0, which come from Gilboa's OT multiplication. For
+//   a product x * y the holder of y is the OT receiver with the w bits y_t as choices, and the holder of
+//   x sends tau_t = H0_t - H1_t + x * 2^t on top of the random pads. The receiver's sum of
+//   H_{y_t} + y_t tau_t and the sender's -sum H0_t are shares of x * y. Every party sends for its x's and
+//   receives for its y's, and sums its shares of the elementwise products the way the product P does
+//   (Colwise, Dot, Hadamard) into its gamma. So a product takes w OTs per direction, and a query
+//   (nk + 2k) * w of them: with IKNP's 16 bytes per OT plus the w-bit tau that is (nk + 2k) * w * (16 + w/8)
+//   bytes each way, against the 2nk ring elements (8nk bytes at w = 32) P2 sends each party.
+//
+//   Rotation material. P0 draws alpha0 and P1 alpha1 in [0, n), alpha = alpha0 + alpha1 mod n, and
+//   they need shares of e_alpha: e_{alpha0}, held by P0, rotated by alpha1. That takes one stage per
+//   bit t of alpha1, an OT in which P1 chooses with the bit: P0 offers its current share rotated by
+//   0 or by 2^t, both minus its next random share r_{t+1}, and encrypted with the expanded pads. P0's
+//   shares r_t are drawn up front, so all stages go in one message; P1 folds them in order.
+//
+// A batch takes two rounds on the peer link (the receiver matrices, then the senders' corrections), and
+// the base OTs two more once per session. The heavy parts (expanding the IKNP columns, transposing and
+// hashing) run on the thread pool. With --rng-seed the masks are drawn on the calling thread, so a run is
+// reproducible. DPF keys would need a two-party key generation, so --dpf needs P2.
+
+#include <bit>
+#include <span>
+#include <vector>
+#include "common.hpp"
+#include "ot.hpp"
+#include "preproc.hpp"
+#include "round.hpp"
+
+constexpr int local_setup_rounds = 2, local_rounds_per_batch = 2;
+
+template <RingWord R>
+class LocalPreproc {
+    public:
+        LocalPreproc(int role, int n, int k) : role_(role), n_(n), k_(k), stages_(std::bit_width(static_cast<unsigned>(n - 1))) {}
+
+        // base OTs, once per session
+        template <typename Stream>
+        awaitable<void> setup(Stream& peer) {
+            co_await ot_.setup(peer);
+            co_return;
+        }
+
+        // The bundles of a batch (sized with Preproc(n, k)), in two rounds on the peer link.
+        template <typename Stream>
+        awaitable<void> generate(Stream& peer, std::span<Preproc<R>> batch, ThreadPool& pool) {
+            const size_t B = batch.size(), nk = size_t(n_) * k_;
+            const size_t gilboa = (nk + 2 * size_t(k_)) * bits;                  // product OTs per query and direction
+            const size_t rot_ots = stages_, rot_elems = 2 * size_t(n_) * stages_; // P0 -> P1 only
+            const size_t send_per_q = gilboa + (role_ == 0 ? rot_ots : 0), recv_per_q = gilboa + (role_ == 1 ? rot_ots : 0);
+
+            // this party's masks, uniform over the ring, and its alpha share in [0, n)
+            std::vector<std::vector<R>> rot_shares(B);
+            std::vector<uint8_t> choices(B * recv_per_q);
+            for (size_t q = 0; q < B; q++) {
+                Preproc<R> &p = batch[q];
+                random_ring(p.x_n);
+                random_ring(p.y_n);
+                random_ring(p.x_k);
+                random_ring(p.y_k);
+                random_ring(p.scaler_x);
+                random_ring(p.scaler_y);
+                p.alpha = rand_int(0, n_ - 1);
+                if (role_ == 0) {
+                    rot_shares[q].resize(size_t(n_) * stages_);
+                    random_ring(rot_shares[q]);
+                }
+                uint8_t *c = choices.data() + q * recv_per_q;
+                c = bits_of(p.y_n.flat(), c);
+                c = bits_of(std::span<const R>(p.y_k), c);
+                c = bits_of(std::span<const R>(p.scaler_y), c);
+                if (role_ == 1) for (int t = 0; t < stages_; t++) *c++ = (p.alpha >> t) & 1;
+            }
+
+            // round 1: the IKNP matrices
+            Round round;
+            co_await ot_.post(round, choices, B * send_per_q, pool);
+            co_await round.flush(peer);
+            co_await ot_.finish(pool);
+
+            // round 2: the senders' corrections; products' shares in share[q] (this party's x times the peer's y)
+            const size_t out_per_q = gilboa + (role_ == 0 ? rot_elems : 0), in_per_q = gilboa + (role_ == 1 ? rot_elems : 0);
+            std::vector<R> out(B * out_per_q), in(B * in_per_q);
+            std::vector<std::vector<R>> share(B, std::vector<R>(nk + 2 * size_t(k_)));
+            co_await offload(pool, [&] {
+                for (size_t q = 0; q < B; q++) {
+                    const Preproc<R> &p = batch[q];
+                    size_t pad = q * send_per_q;
+                    R *tau = out.data() + q * out_per_q, *z = share[q].data();
+                    pool.parallel_for(0, nk, grain, [&](size_t lo, size_t hi) { gilboa_send(p.x_n.flat(), lo, hi, pad, tau, z); });
+                    gilboa_send(std::span<const R>(p.x_k), 0, k_, pad + nk * bits, tau + nk * bits, z + nk);
+                    gilboa_send(std::span<const R>(p.scaler_x), 0, k_, pad + (nk + k_) * bits, tau + (nk + k_) * bits, z + nk + k_);
+                    if (role_ == 0) rotation_send(p.alpha, rot_shares[q], pad + gilboa, tau + gilboa);
+                }
+            });
+            round.send(std::span<const R>(out));
+            round.receive(std::span<R>(in));
+            co_await round.flush(peer);
+
+            // the receivers' halves, then the corrections and e_alpha
+            co_await offload(pool, [&] {
+                for (size_t q = 0; q < B; q++) {
+                    Preproc<R> &p = batch[q];
+                    size_t pad = q * recv_per_q;
+                    const uint8_t *c = choices.data() + q * recv_per_q;
+                    const R *tau = in.data() + q * in_per_q;
+                    R *z = share[q].data();
+                    pool.parallel_for(0, nk, grain, [&](size_t lo, size_t hi) { gilboa_recv(lo, hi, pad, c, tau, z); });
+                    size_t off = nk * bits;
+                    gilboa_recv(0, k_, pad + off, c + off, tau + off, z + nk);
+                    off += k_ * bits;
+                    gilboa_recv(0, k_, pad + off, c + off, tau + off, z + nk + k_);
+
+                    p.gamma_n.assign(k_, 0);
+                    for (size_t e = 0; e < nk; e++) p.gamma_n[e % k_] += z[e];
+                    p.gamma_k = 0;
+                    for (int c2 = 0; c2 < k_; c2++) p.gamma_k += z[nk + c2];
+                    for (int c2 = 0; c2 < k_; c2++) p.scaler_gamma[c2] = z[nk + k_ + c2];
+
+                    if (role_ == 0) p.e_alpha = stages_ > 0 ? std::vector<R>(rot_shares[q].end() - n_, rot_shares[q].end()) : unit(p.alpha);
+                    else p.e_alpha = rotation_recv(p.alpha, pad + gilboa, tau + gilboa);
+                }
+            });
+            co_return;
+        }
+
+    private:
+        static constexpr int bits = 8 * sizeof(R); // choice bits per product: the masks span the whole ring
+        static constexpr size_t grain = 512;       // products per parallel chunk
+
+        static R pad_value(const OtBlock &b) { return ring_from_words<R>(b.data()); }
+
+        static uint8_t *bits_of(std::span<const R> y, uint8_t *out) {
+            for (R v : y) for (int t = 0; t < bits; t++) *out++ = static_cast<uint8_t>((v >> t) & 1);
+            return out;
+        }
+
+        // n ring elements from a pad
+        std::vector<R> expand(const OtBlock &pad) const {
+            Prg g(ot_detail::block_seed(pad));
+            std::vector<R> v(n_);
+            std::vector<uint32_t> w(v.size() * ring_words<R>);
+            g.fill(std::span<uint32_t>(w));
+            for (size_t i = 0; i < v.size(); i++) v[i] = ring_from_words<R>(w.data() + i * ring_words<R>);
+            return v;
+        }
+
+        std::vector<R> unit(int at) const {
+            std::vector<R> e(n_, 0);
+            e[at] = 1;
+            return e;
+        }
+
+        // sender of x[e] * y[e] for e in [lo, hi): tau and this party's share -sum H0
+        void gilboa_send(std::span<const R> x, size_t lo, size_t hi, size_t pad, R *tau, R *z) const {
+            auto pad0 = ot_.send_pad0(), pad1 = ot_.send_pad1();
+            for (size_t e = lo; e < hi; e++) {
+                R acc = 0;
+                for (int t = 0; t < bits; t++) {
+                    size_t i = e * bits + t;
+                    R h0 = pad_value(pad0[pad + i]);
+                    tau[i] = h0 - pad_value(pad1[pad + i]) + (x[e] << t);
+                    acc -= h0;
+                }
+                z[e] = acc;
+            }
+        }
+
+        // receiver of the peer's x[e] * y[e]: adds sum H_c + c * tau to this party's share
+        void gilboa_recv(size_t lo, size_t hi, size_t pad, const uint8_t *c, const R *tau, R *z) const {
+            auto pads = ot_.recv_pad();
+            for (size_t e = lo; e < hi; e++) {
+                R acc = 0;
+                for (int t = 0; t < bits; t++) {
+                    size_t i = e * bits + t;
+                    acc += pad_value(pads[pad + i]) + (c[i] ? tau[i] : R(0));
+                }
+                z[e] += acc;
+            }
+        }
+
+        // P0: for stage t, (v - r_{t+1}, rot(v, 2^t) - r_{t+1}) under the two pads, v = e_{alpha0}, then r_t
+        void rotation_send(int alpha, const std::vector<R> &r, size_t pad, R *out) const {
+            auto pad0 = ot_.send_pad0(), pad1 = ot_.send_pad1();
+            std::vector<R> v = unit(alpha);
+            for (int t = 0; t < stages_; t++) {
+                std::vector<R> rot = rotate_cyclic(v, 1 << t), m0 = expand(pad0[pad + t]), m1 = expand(pad1[pad + t]);
+                const R *next = r.data() + size_t(t) * n_;
+                R *e0 = out + 2 * size_t(t) * n_, *e1 = e0 + n_;
+                for (int i = 0; i < n_; i++) {
+                    e0[i] = v[i] - next[i] + m0[i];
+                    e1[i] = rot[i] - next[i] + m1[i];
+                }
+                v.assign(next, next + n_);
+            }
+        }
+
+        // P1: fold in the chosen message of every stage; starts from the zero share
+        std::vector<R> rotation_recv(int alpha, size_t pad, const R *in) const {
+            auto pads = ot_.recv_pad();
+            std::vector<R> v(n_, 0);
+            for (int t = 0; t < stages_; t++) {
+                int c = (alpha >> t) & 1;
+                std::vector<R> m = expand(pads[pad + t]);
+                if (c) v = rotate_cyclic(v, 1 << t);
+                const R *e = in + (2 * size_t(t) + c) * n_;
+                for (int i = 0; i < n_; i++) v[i] += e[i] - m[i];
+            }
+            return v;
+        }
+
+        int role_, n_, k_, stages_;
+        OtExtension ot_;
+};
@@ -0,0 +1,156 @@
+#pragma once
+// Contiguous row-major matrix used for every n x k / m x k share object.
+// A single cache-aligned allocation backs the whole matrix, so rows are adjacent
+// in memory and the whole matrix can be moved over the network in one I/O call.
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+// ---------------------- Aligned allocator ----------------------
+
+// Minimal allocator that hands out storage aligned to a cache line (or a wider SIMD register).
+template <typename T, std::size_t Align = 64>
+struct AlignedAllocator {
+    using value_type = T;
+    template <typename U> struct rebind { using other = AlignedAllocator<U, Align>; };
+
+    AlignedAllocator() noexcept = default;
+    template <typename U> AlignedAllocator(const AlignedAllocator<U, Align>&) noexcept {}
+
+    T* allocate(std::size_t count) {
+        return static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t(Align)));
+    }
+    void deallocate(T* p, std::size_t) noexcept {
+        ::operator delete(p, std::align_val_t(Align));
+    }
+
+    template <typename U> bool operator==(const AlignedAllocator<U, Align>&) const noexcept { return true; }
+    template <typename U> bool operator!=(const AlignedAllocator<U, Align>&) const noexcept { return false; }
+};
+
+// ---------------------- Strided view ----------------------
+
+// Non-owning view over every `stride`-th element (used for matrix columns).
+template <typename T>
+class StridedView {
+    public:
+        StridedView(T* base, std::size_t count, std::size_t stride) : base_(base), count_(count), stride_(stride) {}
+
+        std::size_t size() const { return count_; }
+        T& operator[](std::size_t i) const { return base_[i * stride_]; }
+
+        // copy the viewed elements out into a dense vector
+        std::vector<std::remove_const_t<T>> to_vector() const {
+            std::vector<std::remove_const_t<T>> out(count_);
+            for (std::size_t i = 0; i < count_; ++i) out[i] = base_[i * stride_];
+            return out;
+        }
+
+    private:
+        T* base_;
+        std::size_t count_;
+        std::size_t stride_;
+};
+
+// ---------------------- Matrix view ----------------------
+
+// Non-owning row-major view (a whole matrix or a block of consecutive rows).
+template <typename T>
+class MatrixView {
+    public:
+        MatrixView() = default;
+        MatrixView(T* data, std::size_t rows, std::size_t cols) : data_(data), rows_(rows), cols_(cols) {}
+
+        std::size_t rows() const { return rows_; }
+        std::size_t cols() const { return cols_; }
+        std::size_t size() const { return rows_ * cols_; }
+        bool empty() const { return size() == 0; }
+        T* data() const { return data_; }
+        std::size_t size_bytes() const { return size() * sizeof(T); }
+
+        std::span<T> flat() const { return {data_, size()}; }
+        std::span<T> operator[](std::size_t r) const { return {data_ + r * cols_, cols_}; }
+        T& operator()(std::size_t r, std::size_t c) const { return data_[r * cols_ + c]; }
+
+        operator MatrixView<const T>() const { return {data_, rows_, cols_}; }
+
+    private:
+        T* data_ = nullptr;
+        std::size_t rows_ = 0, cols_ = 0;
+};
+
+// ---------------------- Matrix ----------------------
+
+template <typename T>
+class Matrix {
+    public:
+        Matrix() = default;
+        Matrix(std::size_t rows, std::size_t cols, T init = T{}) : rows_(rows), cols_(cols), data_(rows * cols, init) {}
+
+        std::size_t rows() const { return rows_; }
+        std::size_t cols() const { return cols_; }
+        std::size_t size() const { return data_.size(); }
+        bool empty() const { return data_.empty(); }
+
+        T* data() { return data_.data(); }
+        const T* data() const { return data_.data(); }
+        std::size_t size_bytes() const { return data_.size() * sizeof(T); }
+
+        // whole matrix as one flat row-major span
+        std::span<T> flat() { return {data_.data(), data_.size()}; }
+        std::span<const T> flat() const { return {data_.data(), data_.size()}; }
+
+        // row views (so mat[i][j] keeps working)
+        std::span<T> operator[](std::size_t r) { return {data_.data() + r * cols_, cols_}; }
+        std::span<const T> operator[](std::size_t r) const { return {data_.data() + r * cols_, cols_}; }
+        std::span<T> row(std::size_t r) {
+            if (r >= rows_) throw std::out_of_range("Matrix::row: row out of range");
+            return (*this)[r];
+        }
+        std::span<const T> row(std::size_t r) const {
+            if (r >= rows_) throw std::out_of_range("Matrix::row: row out of range");
+            return (*this)[r];
+        }
+
+        // column views (strided by the row length)
+        StridedView<T> col(std::size_t c) {
+            if (c >= cols_) throw std::out_of_range("Matrix::col: col out of range");
+            return {data_.data() + c, rows_, cols_};
+        }
+        StridedView<const T> col(std::size_t c) const {
+            if (c >= cols_) throw std::out_of_range("Matrix::col: col out of range");
+            return {data_.data() + c, rows_, cols_};
+        }
+
+        T& operator()(std::size_t r, std::size_t c) { return data_[r * cols_ + c]; }
+        const T& operator()(std::size_t r, std::size_t c) const { return data_[r * cols_ + c]; }
+
+        // views over the whole matrix or over `count` rows starting at `first`
+        MatrixView<T> view() { return {data_.data(), rows_, cols_}; }
+        MatrixView<const T> view() const { return {data_.data(), rows_, cols_}; }
+        MatrixView<T> block(std::size_t first, std::size_t count) {
+            if (first + count > rows_) throw std::out_of_range("Matrix::block: rows out of range");
+            return {data_.data() + first * cols_, count, cols_};
+        }
+        MatrixView<const T> block(std::size_t first, std::size_t count) const {
+            if (first + count > rows_) throw std::out_of_range("Matrix::block: rows out of range");
+            return {data_.data() + first * cols_, count, cols_};
+        }
+        operator MatrixView<T>() { return view(); }
+        operator MatrixView<const T>() const { return view(); }
+
+        void resize(std::size_t rows, std::size_t cols, T init = T{}) {
+            rows_ = rows;
+            cols_ = cols;
+            data_.assign(rows * cols, init);
+        }
+
+    private:
+        std::size_t rows_ = 0, cols_ = 0;
+        std::vector<T, AlignedAllocator<T>> data_;
+};
@@ -0,0 +1,203 @@
+#pragma once
+// Per-phase protocol instrumentation. Every protocol phase of a batch (see the phase names in party.hpp
+// and helper.hpp) is wrapped in a PhaseSpan, which records its wall time, the process CPU time spent
+// while it ran (all threads, so the thread pool and P2's generators are included) and what went over
+// the links it uses: bytes sent, bytes received and rounds, taken from the channels' LinkCounters.
+//
+// Metrics::write() exports two files:
+//   PREFIX.json        summary: totals per phase, and per query the wall / CPU time, bytes and rounds of every
+//                      phase it took part in (a phase over a batch or a wave of B queries is charged
+//                      1/B to each of them, so the rounds of a batched run come out fractional)
+//   PREFIX.trace.json  Chrome trace timeline (chrome://tracing, ui.perfetto.dev): one complete event per
+//                      span, pid = party, tid = link (P2 uses one per client). Timestamps are wall clock
+//                      microseconds, so the files of the three parties can be merged into one timeline.
+
+#include <time.h>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <initializer_list>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "channel.hpp"
+
+class Metrics {
+    public:
+        // party: 0, 1 or 2 (the Chrome trace pid)
+        explicit Metrics(int party) : party_(party) {}
+
+        struct Event {
+            const char *phase;
+            int first, count;        // queries [first, first + count) the span worked on
+            int tid;
+            double ts_us, dur_us;    // wall clock start and duration
+            double cpu_s;
+            LinkCounters link;       // traffic during the span
+        };
+
+        void record(const Event &e) {
+            std::lock_guard<std::mutex> lock(mu_);
+            events_.push_back(e);
+        }
+
+        // Totals of one phase over the whole session.
+        struct Totals {
+            uint64_t spans = 0;
+            double wall_s = 0, cpu_s = 0;
+            uint64_t bytes_sent = 0, bytes_received = 0, rounds = 0;
+        };
+
+        std::map<std::string, Totals> totals() const {
+            std::lock_guard<std::mutex> lock(mu_);
+            std::map<std::string, Totals> out;
+            for (const auto &e : events_) {
+                auto &t = out[e.phase];
+                t.spans++;
+                t.wall_s += e.dur_us * 1e-6;
+                t.cpu_s += e.cpu_s;
+                t.bytes_sent += e.link.bytes_sent;
+                t.bytes_received += e.link.bytes_received;
+                t.rounds += e.link.rounds;
+            }
+            return out;
+        }
+
+        // Write PREFIX.json and PREFIX.trace.json.
+        void write(const std::string &prefix) const {
+            write_summary(prefix + ".json");
+            write_timeline(prefix + ".trace.json");
+        }
+
+        void write_summary(const std::string &path) const {
+            std::ofstream out(path);
+            if (!out) throw std::runtime_error("cannot open metrics file " + path);
+            out << "{\n  \"party\": " << party_ << ",\n  \"phases\": {";
+            bool first = true;
+            for (const auto &[name, t] : totals()) {
+                out << (first ? "\n" : ",\n") << "    \"" << name << "\": {\"spans\": " << t.spans
+                    << ", \"wall_s\": " << t.wall_s << ", \"cpu_s\": " << t.cpu_s
+                    << ", \"bytes_sent\": " << t.bytes_sent << ", \"bytes_received\": " << t.bytes_received
+                    << ", \"rounds\": " << t.rounds << "}";
+                first = false;
+            }
+            out << "\n  },\n  \"queries\": [";
+
+            // per query: phase -> share of wall time, bytes and rounds
+            struct Share { double wall_s = 0, cpu_s = 0, bytes_sent = 0, bytes_received = 0, rounds = 0; };
+            std::vector<std::map<std::string, Share>> per_query;
+            {
+                std::lock_guard<std::mutex> lock(mu_);
+                for (const auto &e : events_) {
+                    if (e.count <= 0) continue;
+                    if (per_query.size() < static_cast<size_t>(e.first + e.count)) per_query.resize(e.first + e.count);
+                    double f = 1.0 / e.count;
+                    for (int q = e.first; q < e.first + e.count; q++) {
+                        auto &s = per_query[q][e.phase];
+                        s.wall_s += e.dur_us * 1e-6 * f;
+                        s.cpu_s += e.cpu_s * f;
+                        s.bytes_sent += e.link.bytes_sent * f;
+                        s.bytes_received += e.link.bytes_received * f;
+                        s.rounds += e.link.rounds * f;
+                    }
+                }
+            }
+            for (size_t q = 0; q < per_query.size(); q++) {
+                Share total;
+                out << (q ? ",\n" : "\n") << "    {\"query\": " << q << ", \"phases\": {";
+                bool first_phase = true;
+                for (const auto &[name, s] : per_query[q]) {
+                    out << (first_phase ? "" : ", ") << "\"" << name << "\": {\"wall_s\": " << s.wall_s << ", \"cpu_s\": " << s.cpu_s
+                        << ", \"bytes_sent\": " << s.bytes_sent << ", \"bytes_received\": " << s.bytes_received
+                        << ", \"rounds\": " << s.rounds << "}";
+                    first_phase = false;
+                    total.wall_s += s.wall_s;
+                    total.cpu_s += s.cpu_s;
+                    total.bytes_sent += s.bytes_sent;
+                    total.bytes_received += s.bytes_received;
+                    total.rounds += s.rounds;
+                }
+                out << "}, \"wall_s\": " << total.wall_s << ", \"cpu_s\": " << total.cpu_s << ", \"bytes_sent\": " << total.bytes_sent
+                    << ", \"bytes_received\": " << total.bytes_received << ", \"rounds\": " << total.rounds << "}";
+            }
+            out << "\n  ]\n}\n";
+        }
+
+        void write_timeline(const std::string &path) const {
+            std::ofstream out(path);
+            if (!out) throw std::runtime_error("cannot open timeline file " + path);
+            out.setf(std::ios::fixed);
+            out.precision(3);
+            std::lock_guard<std::mutex> lock(mu_);
+            out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n"
+                << "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << party_
+                << ", \"args\": {\"name\": \"P" << party_ << "\"}}";
+            for (const auto &e : events_) {
+                out << ",\n  {\"name\": \"" << e.phase << "\", \"cat\": \"protocol\", \"ph\": \"X\", \"pid\": " << party_
+                    << ", \"tid\": " << e.tid << ", \"ts\": " << e.ts_us << ", \"dur\": " << e.dur_us
+                    << ", \"args\": {\"queries\": \"" << e.first << ".." << e.first + e.count - 1
+                    << "\", \"cpu_ms\": " << e.cpu_s * 1e3 << ", \"bytes_sent\": " << e.link.bytes_sent
+                    << ", \"bytes_received\": " << e.link.bytes_received << ", \"rounds\": " << e.link.rounds << "}}";
+            }
+            out << "\n]}\n";
+        }
+
+    private:
+        int party_;
+        mutable std::mutex mu_; // P2's client handlers record from two threads
+        std::vector<Event> events_;
+};
+
+inline double process_cpu_seconds() {
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Measures one phase from construction to destruction (or end()). With a null Metrics it does nothing,
+// so an uninstrumented run only pays for the pointer test.
+class PhaseSpan {
+    public:
+        PhaseSpan(Metrics *m, const char *phase, int first, int count,
+                  std::initializer_list<const LinkCounters*> links, int tid = 0)
+            : m_(m), phase_(phase), first_(first), count_(count), tid_(tid) {
+            if (!m_) return;
+            for (auto *l : links) if (l && n_links_ < max_links) links_[n_links_++] = {l, *l};
+            wall_ = std::chrono::system_clock::now();
+            start_ = std::chrono::steady_clock::now();
+            cpu_ = process_cpu_seconds();
+        }
+        ~PhaseSpan() { end(); }
+        PhaseSpan(const PhaseSpan&) = delete;
+        PhaseSpan& operator=(const PhaseSpan&) = delete;
+
+        void end() {
+            if (!m_) return;
+            Metrics::Event e{phase_, first_, count_, tid_, 0, 0, 0, {}};
+            e.ts_us = std::chrono::duration<double, std::micro>(wall_.time_since_epoch()).count();
+            e.dur_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start_).count();
+            e.cpu_s = process_cpu_seconds() - cpu_;
+            for (int i = 0; i < n_links_; i++) {
+                e.link.bytes_sent += links_[i].now->bytes_sent - links_[i].at_start.bytes_sent;
+                e.link.bytes_received += links_[i].now->bytes_received - links_[i].at_start.bytes_received;
+                e.link.rounds += links_[i].now->rounds - links_[i].at_start.rounds;
+            }
+            m_->record(e);
+            m_ = nullptr;
+        }
+
+    private:
+        static constexpr int max_links = 2;
+        struct Link { const LinkCounters *now; LinkCounters at_start; };
+
+        Metrics *m_;
+        const char *phase_;
+        int first_, count_, tid_;
+        Link links_[max_links];
+        int n_links_ = 0;
+        std::chrono::system_clock::time_point wall_;
+        std::chrono::steady_clock::time_point start_;
+        double cpu_ = 0;
+};
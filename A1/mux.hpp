@@ -0,0 +1,273 @@
+#pragma once
+// Independent byte streams over one Channel, so that concurrent protocol sessions can share the P0-P1
+// link. Every write on a stream becomes a frame
+//   uint32 stream id, uint32 length, payload
+// on the link. Frames queued while the link is busy go out together in the next write, so sessions that
+// send at the same time share a system call (or a ring transfer). open(id) returns a Channel for stream
+// id, which works with every helper in common.hpp and counts its own bytes and rounds; both sides must
+// use the same ids for the same conversation.
+//
+// Flow control is per stream, with a window of credit: a stream has at most `window` bytes on their way
+// to the peer's stream that its reader has not taken yet. The receiving side returns credit in frames
+//   uint32 stream id | credit_bit, uint32 bytes
+// once its reader has taken half a window, so a stream's inbox never holds more than a window and a slow
+// stream does not stall the others on the link. A write sends what the credit allows straight from the
+// caller's buffers (gathered with the header, no copy) and completes once that frame is written to the
+// link; async_write sends the rest as the credit comes back. A read completes when the stream has data.
+// Everything runs on the link's executor, which must be single-threaded (the parties' io_context(1)).
+// The mux must outlive its streams. run() pumps the link: it returns once this side has called close(), all
+// queued frames are written and the peer has closed too.
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <boost/asio.hpp>
+#include "channel.hpp"
+
+class ChannelMux {
+    public:
+        static constexpr uint32_t default_window = 1u << 20;
+
+        explicit ChannelMux(Channel &link, uint32_t window = default_window)
+            : link_(link), ex_(link.get_executor()), window_(window), wake_(ex_, boost::asio::steady_timer::time_point::max()),
+              writer_done_(ex_, boost::asio::steady_timer::time_point::max()) {}
+        ChannelMux(const ChannelMux&) = delete;
+        ChannelMux& operator=(const ChannelMux&) = delete;
+
+        Channel open(uint32_t id) { return Channel(ex_, stream(id)); }
+
+        boost::asio::awaitable<void> run() {
+            namespace asio = boost::asio;
+            std::exception_ptr write_error;
+            bool writing = true;
+            asio::co_spawn(ex_, write_loop(), [&](std::exception_ptr e) {
+                write_error = e;
+                writing = false;
+                writer_done_.cancel();
+            });
+            std::exception_ptr read_error;
+            try {
+                for (;;) {
+                    uint32_t header[2];
+                    co_await asio::async_read(link_, asio::buffer(header, sizeof(header)), asio::use_awaitable);
+                    if (header[0] == close_id) break;
+                    if (header[0] & credit_bit) {
+                        stream(header[0] & ~credit_bit)->add_credit(header[1]);
+                        continue;
+                    }
+                    // the payload goes straight into the stream's inbox, which the window bounds
+                    auto s = stream(header[0]);
+                    co_await asio::async_read(link_, s->reserve(header[1]), asio::use_awaitable);
+                    s->delivered();
+                }
+                for (auto &[id, s] : streams_) s->fail(asio::error::eof);
+            } catch (const boost::system::system_error &e) {
+                read_error = std::current_exception();
+                abort(e.code());
+            }
+            if (writing) {
+                boost::system::error_code ignored;
+                co_await writer_done_.async_wait(asio::redirect_error(asio::use_awaitable, ignored));
+            }
+            if (read_error) std::rethrow_exception(read_error);
+            if (write_error) std::rethrow_exception(write_error);
+        }
+
+        // No more writes from this side: the close frame follows what is queued.
+        void close() {
+            closing_ = true;
+            wake_.cancel();
+        }
+
+        // Fail every pending and future read and write with ec and stop the link (error path).
+        void abort(boost::system::error_code ec = boost::asio::error::operation_aborted) {
+            for (auto &[id, s] : streams_) s->fail(ec);
+            closing_ = true;
+            wake_.cancel();
+            link_.cancel();
+        }
+
+    private:
+        static constexpr uint32_t close_id = 0xffffffffu;
+        static constexpr uint32_t credit_bit = 0x80000000u;
+
+        class Stream : public channel_detail::Impl {
+            public:
+                Stream(ChannelMux &mux, uint32_t id) : mux_(mux), id_(id), credit_(mux.window_) {}
+
+                void read_some(channel_detail::MutableBuffers bufs, channel_detail::Handler h) override {
+                    pending_bufs_ = std::move(bufs);
+                    pending_ = std::move(h);
+                    try_complete();
+                }
+                // picked up by the writer, completed when its frame is on the link
+                void write_some(channel_detail::ConstBuffers bufs, channel_detail::Handler h) override {
+                    if (error_) {
+                        boost::asio::post(mux_.ex_, [h = std::move(h), ec = error_] { h(ec, 0); });
+                        return;
+                    }
+                    write_bufs_ = std::move(bufs);
+                    write_ = std::move(h);
+                    mux_.wake_.cancel();
+                }
+                void cancel() override {
+                    if (pending_) {
+                        boost::asio::post(mux_.ex_, [h = std::move(pending_)] { h(boost::asio::error::operation_aborted, 0); });
+                        pending_ = nullptr;
+                    }
+                    if (write_ && !in_flight_) {
+                        boost::asio::post(mux_.ex_, [h = std::move(write_)] { h(boost::asio::error::operation_aborted, 0); });
+                        write_ = nullptr;
+                    }
+                }
+
+                // reading side: room for a frame of `bytes` at the end of the inbox, then delivered()
+                boost::asio::mutable_buffer reserve(size_t bytes) {
+                    size_t held = inbox_.size() - pos_;
+                    if (bytes > mux_.window_ - held - taken_) {
+                        throw boost::system::system_error(boost::asio::error::message_size, "mux: frame beyond the stream's window");
+                    }
+                    inbox_.erase(inbox_.begin(), inbox_.begin() + pos_);
+                    pos_ = 0;
+                    inbox_.resize(held + bytes);
+                    incoming_ = bytes;
+                    return boost::asio::buffer(inbox_.data() + held, bytes);
+                }
+                void delivered() {
+                    incoming_ = 0;
+                    try_complete();
+                }
+                void fail(boost::system::error_code ec) {
+                    if (!error_) error_ = ec;
+                    try_complete();
+                    if (write_ && !in_flight_) {
+                        boost::asio::post(mux_.ex_, [h = std::move(write_), ec = error_] { h(ec, 0); });
+                        write_ = nullptr;
+                    }
+                }
+
+                // writing side, for the writer: the next frame of the pending write (its header, then the
+                // first `bytes` of the payload) into parts; false if there is none or no credit for it
+                bool take_frame(std::vector<boost::asio::const_buffer> &parts) {
+                    if (!write_ || in_flight_ || credit_ == 0) return false;
+                    size_t bytes = std::min({boost::asio::buffer_size(write_bufs_), credit_, size_t(std::numeric_limits<uint32_t>::max())});
+                    frame_header_ = {id_, static_cast<uint32_t>(bytes)};
+                    parts.push_back(boost::asio::buffer(frame_header_));
+                    for (size_t i = 0, left = bytes; left > 0; i++) {
+                        size_t n = std::min(left, write_bufs_[i].size());
+                        parts.push_back(boost::asio::buffer(write_bufs_[i].data(), n));
+                        left -= n;
+                    }
+                    credit_ -= bytes;
+                    in_flight_ = true;
+                    return true;
+                }
+                void frame_written(boost::system::error_code ec) {
+                    size_t bytes = ec ? 0 : frame_header_[1];
+                    boost::asio::post(mux_.ex_, [h = std::move(write_), ec, bytes] { h(ec, bytes); });
+                    write_ = nullptr;
+                    in_flight_ = false;
+                }
+                void add_credit(uint32_t bytes) {
+                    credit_ += bytes;
+                    mux_.wake_.cancel();
+                }
+
+            private:
+                void try_complete() {
+                    if (!pending_) return;
+                    size_t want = boost::asio::buffer_size(pending_bufs_);
+                    size_t n = boost::asio::buffer_copy(pending_bufs_, boost::asio::buffer(inbox_.data() + pos_, inbox_.size() - incoming_ - pos_));
+                    boost::system::error_code ec;
+                    if (n == 0 && want > 0) {
+                        if (!error_) return;
+                        ec = error_;
+                    }
+                    pos_ += n;
+                    taken_ += n;
+                    if (taken_ >= mux_.window_ / 2) {
+                        mux_.grant(id_, taken_);
+                        taken_ = 0;
+                    }
+                    boost::asio::post(mux_.ex_, [h = std::move(pending_), ec, n] { h(ec, n); });
+                    pending_ = nullptr;
+                }
+
+                ChannelMux &mux_;
+                uint32_t id_;
+                // reading side
+                std::vector<char> inbox_;
+                size_t pos_ = 0, incoming_ = 0; // first unread byte; bytes of the frame being read in
+                size_t taken_ = 0;               // read since the last credit frame
+                channel_detail::MutableBuffers pending_bufs_;
+                channel_detail::Handler pending_;
+                // writing side
+                size_t credit_;
+                channel_detail::ConstBuffers write_bufs_;
+                channel_detail::Handler write_;
+                bool in_flight_ = false;
+                std::array<uint32_t, 2> frame_header_{};
+                boost::system::error_code error_;
+        };
+
+        std::shared_ptr<Stream> stream(uint32_t id) {
+            auto &s = streams_[id];
+            if (!s) s = std::make_shared<Stream>(*this, id);
+            return s;
+        }
+
+        void grant(uint32_t id, size_t bytes) {
+            grants_.push_back({id | credit_bit, static_cast<uint32_t>(bytes)});
+            wake_.cancel();
+        }
+
+        // Each pass sends the queued credit frames and one frame of every stream that has a write and
+        // credit, in a single gathered write.
+        boost::asio::awaitable<void> write_loop() {
+            namespace asio = boost::asio;
+            std::vector<std::array<uint32_t, 2>> granting;
+            std::vector<asio::const_buffer> parts;
+            std::vector<Stream*> sending;
+            for (;;) {
+                granting.clear();
+                granting.swap(grants_);
+                parts.clear();
+                sending.clear();
+                for (const auto &g : granting) parts.push_back(asio::buffer(g));
+                for (auto &[id, s] : streams_) {
+                    if (s->take_frame(parts)) sending.push_back(s.get());
+                }
+                if (parts.empty()) {
+                    if (closing_) break;
+                    boost::system::error_code ignored;
+                    co_await wake_.async_wait(asio::redirect_error(asio::use_awaitable, ignored));
+                    continue;
+                }
+                boost::system::error_code ec;
+                co_await asio::async_write(link_, parts, asio::redirect_error(asio::use_awaitable, ec));
+                for (Stream *s : sending) s->frame_written(ec);
+                if (ec) {
+                    abort(ec); // the writes still waiting would never go out
+                    throw boost::system::system_error(ec);
+                }
+            }
+            uint32_t header[2] = {close_id, 0};
+            co_await asio::async_write(link_, asio::buffer(header, sizeof(header)), asio::use_awaitable);
+        }
+
+        Channel &link_;
+        boost::asio::any_io_executor ex_;
+        size_t window_;                      // per stream, see the top of the file
+        std::map<uint32_t, std::shared_ptr<Stream>> streams_;
+        std::vector<std::array<uint32_t, 2>> grants_; // credit frames waiting for the writer
+        bool closing_ = false;
+        boost::asio::steady_timer wake_;     // cancelled to wake the writer
+        boost::asio::steady_timer writer_done_;
+};
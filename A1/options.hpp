@@ -0,0 +1,149 @@
+#pragma once
+// Command line options shared by P0, P1 and P2.
+// Every binary accepts the same flags, so one ARGS string can be passed to all three containers.
+
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+struct Options {
+    int batch = 1;   // number of queries processed per network round (--batch B)
+    int window = 8;  // P2: queries of preprocessing buffered ahead of the clients (--window W)
+    int workers = 2; // P2: preprocessing generator threads (--workers T)
+    bool seeded = false; // P2 ships PRG seeds plus correction terms instead of full tensors (--seeded)
+    bool dpf = false;    // e_alpha travels as a DPF key and is expanded by the parties (--dpf)
+    long long rng_seed = -1; // deterministic randomness for reproducible runs (--rng-seed S), -1 = OS entropy
+    int threads = 1;         // P0/P1: threads for the local computation, including the network thread (--threads N)
+    int affinity = -1;       // P0/P1: pin the threads to CPUs C, C+1, ... (--affinity C), -1 = no pinning
+    int epoch = 1;           // P0/P1: batches that share one blinded database (--epoch E), 0 = the whole session
+    int refresh_rows = 0;    // P0/P1: re-blind only this many rows per new epoch instead of rebuilding (--refresh-rows R)
+    std::string shares;      // P0/P1: share file to map (--shares PATH), default shares_p<role>.bin
+    bool reset_shares = false; // P0/P1: regenerate the share file even if it matches (--reset-shares)
+    int role = -1;             // P0/P1: which party this process is (--role R), -1 = from the build (ROLE_p0 / ROLE_p1)
+    std::string p2 = "tcp:p2:9002";   // link to P2, P2 listens (--p2 EP), see channel.hpp
+    std::string peer = "tcp:p1:9001"; // link between P0 and P1, P1 listens (--peer EP)
+    size_t buffer = 0;         // socket buffer / shared memory ring bytes (--buffer BYTES), 0 = OS default / 4 MiB ring
+    int sessions = 1;          // P0/P1: concurrent protocol sessions over independent users (--sessions S), see party.hpp
+    std::string metrics;       // per-phase metrics to PREFIX_p<party>.json / .trace.json (--metrics PREFIX), see metrics.hpp
+    std::string preproc_out;   // P2: write the preprocessing to PREFIX_p0.pre / PREFIX_p1.pre and exit (--preproc-out PREFIX)
+    std::string preproc_file;  // offline preprocessing to use instead of live generation (--preproc-file PREFIX), see preproc_file.hpp
+    bool local_preproc = false; // P0/P1: generate the preprocessing with the peer by OT extension, no P2 (--local-preproc)
+    bool binary_queries = false; // read the binary query files f1.qry / f2.qry instead of f1.txt / f2.txt (--binary-queries)
+    bool update_items = false;   // also write v_j <- v_j + u_i * delta back into V, obliviously (--update-items), see item_write.hpp
+};
+
+inline void print_usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [--batch B] [--window W] [--workers T] [--seeded] [--dpf] [--rng-seed S]\n"
+              << "       [--threads N] [--affinity C] [--epoch E] [--refresh-rows R] [--shares PATH] [--reset-shares]\n"
+              << "       [--role R] [--p2 EP] [--peer EP] [--buffer BYTES] [--sessions S] [--metrics PREFIX]\n"
+              << "       [--preproc-out PREFIX] [--preproc-file PREFIX] [--binary-queries]\n"
+              << "       [--local-preproc] [--update-items]\n"
+              << "  --batch B   process B queries per network round (default 1)\n"
+              << "  --window W  P2 only: buffer at most W queries of preprocessing (default 8)\n"
+              << "  --workers T P2 only: number of preprocessing generator threads (default 2)\n"
+              << "  --seeded    seed-compressed preprocessing (must be given to all three parties)\n"
+              << "  --dpf       DPF keys instead of length-n e_alpha shares (must be given to all three parties)\n"
+              << "  --rng-seed S derive all randomness from S, for reproducible benchmarks\n"
+              << "  --threads N P0/P1: run the O(nk) local work on N threads (default 1)\n"
+              << "  --affinity C P0/P1: pin those threads to CPUs C .. C+N-1\n"
+              << "  --epoch E   P0/P1: reuse the blinded database for E batches (default 1, 0 = whole session)\n"
+              << "  --refresh-rows R P0/P1: at a new epoch re-blind and resend only R rows (default 0 = everything)\n"
+              << "  --shares PATH P0/P1: memory-mapped share file (default shares_p0.bin / shares_p1.bin)\n"
+              << "  --reset-shares P0/P1: discard the share file and start from fresh random shares\n"
+              << "  --role R    P0/P1: run as party R (0 or 1) instead of the role the binary was built for\n"
+              << "  --p2 EP     endpoint of P2: tcp:HOST:PORT, unix:PATH or shm:NAME (default tcp:p2:9002)\n"
+              << "  --peer EP   endpoint of the P0-P1 link, P1 listens (default tcp:p1:9001)\n"
+              << "  --buffer BYTES socket buffer size, or shared memory ring size (default: OS default / 4 MiB)\n"
+              << "  --sessions S P0/P1: run queries on different users in S concurrent sessions (needs --batch 1)\n"
+              << "  --metrics PREFIX per-phase bytes, rounds and times: PREFIX_pN.json summary and PREFIX_pN.trace.json timeline\n"
+              << "  --preproc-out PREFIX P2 only: generate all preprocessing into PREFIX_p0.pre / PREFIX_p1.pre and exit\n"
+              << "  --preproc-file PREFIX use those files: on P2 serve them instead of generating; on P0/P1 read\n"
+              << "              PREFIX_p<role>.pre directly and do not connect to P2\n"
+              << "  --local-preproc P0/P1: generate the correlated randomness between P0 and P1 with OT extension; P2 is not used\n"
+              << "  --binary-queries read the binary query files f1.qry / f2.qry (gen_queries --binary) instead of f1.txt / f2.txt\n"
+              << "  --update-items also update the item row: v_j += u_i * delta, as an oblivious write (must be given to all three parties)\n";
+}
+
+inline Options parse_options(int argc, char* argv[]) {
+    Options opt;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next_value = [&]() -> std::string {
+            if (i + 1 >= argc) throw std::invalid_argument("missing value for " + arg);
+            return argv[++i];
+        };
+        if (arg == "--batch") {
+            opt.batch = std::stoi(next_value());
+            if (opt.batch < 1) throw std::invalid_argument("--batch must be >= 1");
+        } else if (arg == "--window") {
+            opt.window = std::stoi(next_value());
+            if (opt.window < 1) throw std::invalid_argument("--window must be >= 1");
+        } else if (arg == "--workers") {
+            opt.workers = std::stoi(next_value());
+            if (opt.workers < 1) throw std::invalid_argument("--workers must be >= 1");
+        } else if (arg == "--seeded") {
+            opt.seeded = true;
+        } else if (arg == "--dpf") {
+            opt.dpf = true;
+        } else if (arg == "--rng-seed") {
+            opt.rng_seed = std::stoll(next_value());
+            if (opt.rng_seed < 0) throw std::invalid_argument("--rng-seed must be >= 0");
+        } else if (arg == "--threads") {
+            opt.threads = std::stoi(next_value());
+            if (opt.threads < 1) throw std::invalid_argument("--threads must be >= 1");
+        } else if (arg == "--affinity") {
+            opt.affinity = std::stoi(next_value());
+            if (opt.affinity < 0) throw std::invalid_argument("--affinity must be >= 0");
+        } else if (arg == "--epoch") {
+            opt.epoch = std::stoi(next_value());
+            if (opt.epoch < 0) throw std::invalid_argument("--epoch must be >= 0");
+        } else if (arg == "--refresh-rows") {
+            opt.refresh_rows = std::stoi(next_value());
+            if (opt.refresh_rows < 0) throw std::invalid_argument("--refresh-rows must be >= 0");
+        } else if (arg == "--shares") {
+            opt.shares = next_value();
+        } else if (arg == "--reset-shares") {
+            opt.reset_shares = true;
+        } else if (arg == "--role") {
+            opt.role = std::stoi(next_value());
+            if (opt.role != 0 && opt.role != 1) throw std::invalid_argument("--role must be 0 or 1");
+        } else if (arg == "--p2") {
+            opt.p2 = next_value();
+        } else if (arg == "--peer") {
+            opt.peer = next_value();
+        } else if (arg == "--buffer") {
+            long long b = std::stoll(next_value());
+            if (b < 0) throw std::invalid_argument("--buffer must be >= 0");
+            opt.buffer = static_cast<size_t>(b);
+        } else if (arg == "--sessions") {
+            opt.sessions = std::stoi(next_value());
+            if (opt.sessions < 1) throw std::invalid_argument("--sessions must be >= 1");
+        } else if (arg == "--metrics") {
+            opt.metrics = next_value();
+        } else if (arg == "--preproc-out") {
+            opt.preproc_out = next_value();
+        } else if (arg == "--preproc-file") {
+            opt.preproc_file = next_value();
+        } else if (arg == "--local-preproc") {
+            opt.local_preproc = true;
+        } else if (arg == "--binary-queries") {
+            opt.binary_queries = true;
+        } else if (arg == "--update-items") {
+            opt.update_items = true;
+        } else if (arg == "--help" || arg == "-h") {
+            print_usage(argv[0]);
+            std::exit(0);
+        } else {
+            throw std::invalid_argument("unknown option: " + arg);
+        }
+    }
+    if (opt.local_preproc && (opt.dpf || opt.seeded || !opt.preproc_file.empty())) {
+        throw std::invalid_argument("--local-preproc replaces P2: it cannot be combined with --dpf, --seeded or --preproc-file");
+    }
+    if (opt.update_items && (opt.local_preproc || opt.sessions > 1)) {
+        throw std::invalid_argument("--update-items needs P2's write material and a single session: it cannot be combined with --local-preproc or --sessions");
+    }
+    if (opt.sessions > 1 && opt.batch > 1) throw std::invalid_argument("--sessions runs one query per session at a time; use it with --batch 1");
+    return opt;
+}
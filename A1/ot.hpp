@@ -0,0 +1,287 @@
+#pragma once
+// Oblivious transfer between P0 and P1, for generating correlated randomness without P2
+// (local_preproc.hpp). Semi-honest security, like the rest of the protocol.
+//
+// Base OTs: 128 of them per direction, once per session, with the "simplest OT" of Chou and Orlandi on
+// the NIST P-256 curve (OpenSSL libcrypto; link with -lcrypto). The sender publishes A = aG; the
+// receiver with choice bit c sends B = bG + cA; the keys are k0 = H(j, aB), k1 = H(j, a(B - A)) and the
+// receiver learns k_c = H(j, bA). Both directions run at once, in two rounds.
+//
+// Extension: IKNP. Every party is the sender of one direction and the receiver of the other, so one
+// round carries both parties' receiver matrices. For m OTs the receiver with choice bits r expands its
+// base keys into the 128 columns t_j = G(k0_j) and sends u_j = t_j ^ G(k1_j) ^ r; the sender (base
+// choices s) gets q_j = G(k_{s_j}) ^ s_j u_j = t_j ^ s_j r. Transposed, row i is q_i = t_i ^ r_i s, and
+// the random OT pads are H(i, q_i) and H(i, q_i ^ s) for the sender and H(i, t_i) for the receiver,
+// which equals the pad of its choice. G is ChaCha20 keyed by the base key, continued across batches;
+// H is one ChaCha20 block keyed by the row with the global OT index folded in as the tweak. The
+// parties turn the random pads into the transfers they need themselves (see local_preproc.hpp).
+
+#include <openssl/ec.h>
+#include <openssl/evp.h>
+#include <openssl/obj_mac.h>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <vector>
+#include "common.hpp"
+#include "round.hpp"
+
+using OtBlock = std::array<uint32_t, 4>; // a 128-bit OT pad
+
+namespace ot_detail {
+
+constexpr int kappa = 128;               // base OTs per direction
+constexpr size_t point_bytes = 33;       // compressed P-256 point
+constexpr uint32_t hash_domain = 0x4f54; // keeps H apart from other uses of the ChaCha20 block
+
+// 64 x 64 bit matrix transpose in place: bit c of a[r] becomes bit r of a[c].
+inline void transpose64(uint64_t a[64]) {
+    uint64_t m = 0x00000000ffffffffULL;
+    for (int j = 32; j != 0; j >>= 1, m ^= m << j) {
+        for (int k = 0; k < 64; k = ((k | j) + 1) & ~j) {
+            uint64_t t = ((a[k] >> j) ^ a[k | j]) & m;
+            a[k] ^= t << j;
+            a[k | j] ^= t;
+        }
+    }
+}
+
+// rows [lo, hi) (multiples of 64) of the m x 128 matrix whose columns are cols[j * words .. ], two
+// words per row
+inline void transpose_rows(const uint64_t *cols, size_t words, size_t lo, size_t hi, uint64_t *rows) {
+    uint64_t a[64];
+    for (size_t b = lo / 64; b < hi / 64; b++) {
+        for (int c = 0; c < 2; c++) {
+            for (int jj = 0; jj < 64; jj++) a[jj] = cols[(64 * c + jj) * words + b];
+            transpose64(a);
+            for (int ii = 0; ii < 64; ii++) rows[(64 * b + ii) * 2 + c] = a[ii];
+        }
+    }
+}
+
+// H(index, row) for `count` consecutive rows (two words each, optionally xored with `delta`): the first
+// 128 bits of the ChaCha20 block keyed by the row with the index folded into it, 8 or 16 rows per SIMD
+// call (prg.hpp: keyed_blocks)
+inline void hash_rows(uint64_t index, const uint64_t *rows, size_t count, const uint64_t *delta, OtBlock *out) {
+    constexpr size_t chunk = 64;
+    uint32_t keys[4 * chunk], blocks[16 * chunk];
+    for (size_t lo = 0; lo < count; lo += chunk) {
+        size_t len = std::min(chunk, count - lo);
+        for (size_t i = 0; i < len; i++) {
+            const uint64_t *r = rows + 2 * (lo + i);
+            uint64_t w0 = r[0] ^ (index + lo + i), w1 = r[1];
+            if (delta) { w0 ^= delta[0]; w1 ^= delta[1]; }
+            keys[4 * i] = static_cast<uint32_t>(w0); keys[4 * i + 1] = static_cast<uint32_t>(w0 >> 32);
+            keys[4 * i + 2] = static_cast<uint32_t>(w1); keys[4 * i + 3] = static_cast<uint32_t>(w1 >> 32);
+        }
+        prg_detail::keyed_blocks(keys, len, hash_domain, blocks);
+        for (size_t i = 0; i < len; i++) std::memcpy(out[lo + i].data(), blocks + 16 * i, sizeof(OtBlock));
+    }
+}
+
+inline PrgSeed block_seed(const OtBlock &k) { return {k[0], k[1], k[2], k[3], 0, 0, 0, 0}; }
+
+// P-256 arithmetic for the base OTs
+class Curve {
+    public:
+        Curve() : group_(EC_GROUP_new_by_curve_name(NID_X9_62_prime256v1)), ctx_(BN_CTX_new()) {
+            if (!group_ || !ctx_) fail("cannot set up P-256");
+        }
+        ~Curve() {
+            EC_GROUP_free(group_);
+            BN_CTX_free(ctx_);
+        }
+        Curve(const Curve&) = delete;
+        Curve& operator=(const Curve&) = delete;
+
+        using Point = std::unique_ptr<EC_POINT, decltype(&EC_POINT_free)>;
+        using Scalar = std::unique_ptr<BIGNUM, decltype(&BN_free)>;
+
+        // uniform scalar from the calling thread's stream (reproducible with --rng-seed)
+        Scalar random_scalar() {
+            uint32_t words[12];
+            thread_rng().fill(std::span<uint32_t>(words, 12));
+            Scalar s(BN_bin2bn(reinterpret_cast<const unsigned char*>(words), sizeof(words), nullptr), BN_free);
+            if (!s || !BN_nnmod(s.get(), s.get(), EC_GROUP_get0_order(group_), ctx_)) fail("scalar");
+            return s;
+        }
+
+        Point point() {
+            Point p(EC_POINT_new(group_), EC_POINT_free);
+            if (!p) fail("point");
+            return p;
+        }
+        // s * G + t * P (either term may be left out)
+        Point mul(const BIGNUM *s, const EC_POINT *p = nullptr, const BIGNUM *t = nullptr) {
+            Point r = point();
+            if (!EC_POINT_mul(group_, r.get(), s, p, t, ctx_)) fail("point multiplication");
+            return r;
+        }
+        Point add(const EC_POINT *a, const EC_POINT *b) {
+            Point r = point();
+            if (!EC_POINT_add(group_, r.get(), a, b, ctx_)) fail("point addition");
+            return r;
+        }
+        Point sub(const EC_POINT *a, const EC_POINT *b) {
+            Point nb = point();
+            if (!EC_POINT_copy(nb.get(), b) || !EC_POINT_invert(group_, nb.get(), ctx_)) fail("point inversion");
+            return add(a, nb.get());
+        }
+
+        void encode(const EC_POINT *p, uint8_t *out) {
+            if (EC_POINT_point2oct(group_, p, POINT_CONVERSION_COMPRESSED, out, point_bytes, ctx_) != point_bytes) fail("point encoding");
+        }
+        Point decode(const uint8_t *in) {
+            Point p = point();
+            if (!EC_POINT_oct2point(group_, p.get(), in, point_bytes, ctx_) || EC_POINT_is_at_infinity(group_, p.get())) {
+                throw std::runtime_error("OT setup: the peer sent an invalid curve point");
+            }
+            return p;
+        }
+
+        // H(j, P): SHA-256 of the index and the encoded point, cut to 128 bits
+        OtBlock key(uint32_t j, const EC_POINT *p) {
+            uint8_t msg[4 + point_bytes], md[EVP_MAX_MD_SIZE];
+            std::memcpy(msg, &j, 4);
+            encode(p, msg + 4);
+            unsigned int len = 0;
+            if (!EVP_Digest(msg, sizeof(msg), md, &len, EVP_sha256(), nullptr)) fail("SHA-256");
+            OtBlock k;
+            std::memcpy(k.data(), md, sizeof(k));
+            return k;
+        }
+
+    private:
+        [[noreturn]] static void fail(const char *what) { throw std::runtime_error(std::string("OT setup: libcrypto failed: ") + what); }
+
+        EC_GROUP *group_;
+        BN_CTX *ctx_;
+};
+
+} // namespace ot_detail
+
+class OtExtension {
+    public:
+        // Base OTs of both directions: two rounds on the peer link.
+        template <typename Stream>
+        awaitable<void> setup(Stream& peer) {
+            using namespace ot_detail;
+            Curve curve;
+            // as base-OT sender (this party's receiver role): A = aG
+            auto a = curve.random_scalar();
+            auto A = curve.mul(a.get());
+            std::vector<uint8_t> my_a(point_bytes), peer_a(point_bytes);
+            curve.encode(A.get(), my_a.data());
+            Round round;
+            round.add(my_a, peer_a);
+            co_await round.flush(peer);
+
+            // as base-OT receiver (this party's sender role), with choices s: B_j = b_j G + s_j A'
+            auto A_peer = curve.decode(peer_a.data());
+            s_[0] = uint64_t(thread_rng().next_u32()) | uint64_t(thread_rng().next_u32()) << 32;
+            s_[1] = uint64_t(thread_rng().next_u32()) | uint64_t(thread_rng().next_u32()) << 32;
+            std::vector<ot_detail::Curve::Scalar> b;
+            std::vector<uint8_t> my_b(kappa * point_bytes), peer_b(kappa * point_bytes);
+            for (int j = 0; j < kappa; j++) {
+                b.push_back(curve.random_scalar());
+                auto B = choice(j) ? curve.mul(b.back().get(), A_peer.get(), BN_value_one()) : curve.mul(b.back().get());
+                curve.encode(B.get(), my_b.data() + j * point_bytes);
+            }
+            round.add(my_b, peer_b);
+            co_await round.flush(peer);
+
+            auto aA = curve.mul(nullptr, A.get(), a.get());
+            for (int j = 0; j < kappa; j++) {
+                auto aB = curve.mul(nullptr, curve.decode(peer_b.data() + j * point_bytes).get(), a.get());
+                g0_.emplace_back(block_seed(curve.key(j, aB.get())));
+                g1_.emplace_back(block_seed(curve.key(j, curve.sub(aB.get(), aA.get()).get())));
+                gs_.emplace_back(block_seed(curve.key(j, curve.mul(nullptr, A_peer.get(), b[j].get()).get())));
+            }
+            co_return;
+        }
+
+        // Queue this party's receiver matrix for m = choices.size() OTs (one choice bit per byte), and
+        // receive the peer's for the m_send OTs in which this party is the sender.
+        awaitable<void> post(Round& round, std::span<const uint8_t> choices, size_t m_send, ThreadPool& pool) {
+            m_recv_ = choices.size();
+            m_send_ = m_send;
+            size_t wr = words(m_recv_), ws = words(m_send_);
+            std::vector<uint64_t> r(wr, 0);
+            for (size_t i = 0; i < m_recv_; i++) r[i / 64] |= uint64_t(choices[i] & 1) << (i % 64);
+            t_cols_.assign(ot_detail::kappa * wr, 0);
+            u_out_.assign(ot_detail::kappa * wr, 0);
+            u_in_.assign(ot_detail::kappa * ws, 0);
+            co_await offload(pool, [&] {
+                pool.parallel_for(0, ot_detail::kappa, 8, [&](size_t lo, size_t hi) {
+                    std::vector<uint64_t> other(wr);
+                    for (size_t j = lo; j < hi; j++) {
+                        uint64_t *t = t_cols_.data() + j * wr, *u = u_out_.data() + j * wr;
+                        fill_words(g0_[j], t, wr);
+                        fill_words(g1_[j], other.data(), wr);
+                        for (size_t w = 0; w < wr; w++) u[w] = t[w] ^ other[w] ^ r[w];
+                    }
+                });
+            });
+            round.send(std::span<const uint64_t>(u_out_));
+            round.receive(std::span<uint64_t>(u_in_));
+            co_return;
+        }
+
+        // After the round: the pads of this batch. The sender's are send_pad0 / send_pad1, the receiver's
+        // recv_pad (the pad of its choice).
+        awaitable<void> finish(ThreadPool& pool) {
+            size_t wr = words(m_recv_), ws = words(m_send_);
+            std::vector<uint64_t> q_cols(ot_detail::kappa * ws), q_rows(2 * 64 * ws), t_rows(2 * 64 * wr);
+            pad0_.resize(m_send_);
+            pad1_.resize(m_send_);
+            pad_.resize(m_recv_);
+            co_await offload(pool, [&] {
+                pool.parallel_for(0, ot_detail::kappa, 8, [&](size_t lo, size_t hi) {
+                    for (size_t j = lo; j < hi; j++) {
+                        uint64_t *q = q_cols.data() + j * ws;
+                        const uint64_t *u = u_in_.data() + j * ws;
+                        fill_words(gs_[j], q, ws);
+                        if (choice(j)) for (size_t w = 0; w < ws; w++) q[w] ^= u[w];
+                    }
+                });
+                pool.parallel_for(0, ws, grain_words, [&](size_t lo, size_t hi) {
+                    ot_detail::transpose_rows(q_cols.data(), ws, 64 * lo, 64 * hi, q_rows.data());
+                    size_t first = 64 * lo, count = std::min(m_send_, 64 * hi) - first;
+                    ot_detail::hash_rows(send_index_ + first, q_rows.data() + 2 * first, count, nullptr, pad0_.data() + first);
+                    ot_detail::hash_rows(send_index_ + first, q_rows.data() + 2 * first, count, s_, pad1_.data() + first);
+                });
+                pool.parallel_for(0, wr, grain_words, [&](size_t lo, size_t hi) {
+                    ot_detail::transpose_rows(t_cols_.data(), wr, 64 * lo, 64 * hi, t_rows.data());
+                    size_t first = 64 * lo, count = std::min(m_recv_, 64 * hi) - first;
+                    ot_detail::hash_rows(recv_index_ + first, t_rows.data() + 2 * first, count, nullptr, pad_.data() + first);
+                });
+            });
+            send_index_ += m_send_;
+            recv_index_ += m_recv_;
+            co_return;
+        }
+
+        std::span<const OtBlock> send_pad0() const { return pad0_; }
+        std::span<const OtBlock> send_pad1() const { return pad1_; }
+        std::span<const OtBlock> recv_pad() const { return pad_; }
+
+    private:
+        static constexpr size_t grain_words = 64; // 4096 OTs per parallel chunk
+
+        static size_t words(size_t m) { return (m + 63) / 64; }
+        bool choice(size_t j) const { return (s_[j / 64] >> (j % 64)) & 1; }
+        static void fill_words(Prg& g, uint64_t *out, size_t count) {
+            g.fill(std::span<uint32_t>(reinterpret_cast<uint32_t*>(out), 2 * count));
+        }
+
+        std::vector<Prg> g0_, g1_; // receiver role: G(k0_j), G(k1_j)
+        std::vector<Prg> gs_;      // sender role: G(k_{s_j})
+        uint64_t s_[2] = {0, 0};   // sender role: base choices
+        uint64_t send_index_ = 0, recv_index_ = 0; // OTs so far in each role, the tweak of H
+        size_t m_send_ = 0, m_recv_ = 0;
+        std::vector<uint64_t> t_cols_, u_out_, u_in_;
+        std::vector<OtBlock> pad0_, pad1_, pad_;
+};
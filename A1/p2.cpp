@@ -1,78 +1,20 @@
 #include "common.hpp"
+#include "channel.hpp"
+#include "helper.hpp"
+#include "metrics.hpp"
+#include "options.hpp"
+#include "query_file.hpp"
 // #include "shares.hpp"
 
-using boost::asio::ip::tcp;
-
-int m,n,k,Q;
-// Send a number to a client
-boost::asio::awaitable<void> handle_client(tcp::socket socket, const std::string &name, const std::vector<std::vector<int>> &e_alpha, std::vector<int> &alpha, std::vector<std::vector<std::vector<int>>> &matrix_xn, std::vector<std::vector<std::vector<int>>> &matrix_yn, std::vector<std::vector<int>> & gamma_shares, std::vector<std::vector<int>> &mpc_vec_xk, std::vector<std::vector<int>> &mpc_vec_yk, std::vector<int> &mpc_gamma_shares, std::vector<std::vector<int>> &mpc_scaler_xk_shares, std::vector<std::vector<int>> &mpc_scaler_yk_shares, std::vector<std::vector<int>> &mpc_scaler_gamma_shares)
+// Read only header (m n k Q) from a query file, text or binary (query_file.hpp)
+bool read_header_from_file(const std::string &filename, int &m, int &n, int &k, int &Q)
 {
     try {
-        for (int q = 0; q < Q; ++q) {
-            
-            co_await send_vector1d(socket, e_alpha[q]); // send e_alpha share (1d vector of length n)
-            // std::cout<<"Sent e_alpha share to "<<name<<"\n"; 
-            co_await send_int32(socket, alpha[q]); // send alpha share (single int)
-            // std::cout<<"Sent alpha share to "<<name<<"\n";
-
-            co_await send_vector2d(socket, matrix_xn[q]); // send x_n share (2d vector of size n * k)
-            // std::cout<<"Sent x_n share to "<<name<<"\n";
-            co_await send_vector2d(socket, matrix_yn[q]); // send y_n share (2d vector of size n * k)
-            // std::cout<<"Sent y_n share to "<<name<<"\n";
-            co_await send_vector1d(socket, gamma_shares[q]); // send gamma share (1d vector of length k)
-            // std::cout<<"Sent gamma share to "<<name<<"\n";
-
-            co_await send_vector1d(socket, mpc_vec_xk[q]); // send x_k share (1d vector of length k)
-            // std::cout<<"Sent x_k share to "<<name<<"\n";
-            co_await send_vector1d(socket, mpc_vec_yk[q]); // send y_k share (1d vector of length k)
-            // std::cout<<"Sent y_k share to "<<name<<"\n";
-            co_await send_int32(socket, mpc_gamma_shares[q]); // send gamma_k share (single int)
-            // std::cout<<"Sent gamma_k share to "<<name<<"\n";
-
-            co_await send_vector1d(socket, mpc_scaler_xk_shares[q]); // send scaler_xk share (1d vector of length k)
-            // std::cout<<"Sent scaler_xk share to "<<name<<"\n";
-            co_await send_vector1d(socket, mpc_scaler_yk_shares[q]); // send scaler_yk share (1d vector of length k)
-            // std::cout<<"Sent scaler_yk share to "<<name<<"\n";
-            // std::cout<<"mpc_scaler_gamma_shares[q] size: "<<mpc_scaler_gamma_shares[q].size()<<"\n";
-            co_await send_vector1d(socket, mpc_scaler_gamma_shares[q]);
-            // std::cout<<"Sent scaler_gamma share to "<<name<<"\n";
-
-        }
-    } catch (const std::exception &ex) {
-        std::cerr << "Exception in handle_client for " << name << ": " << ex.what() << "\n";
-    }
-}
-
-
-
-std::vector<int> colwise_dot(const std::vector<std::vector<int>> &A,
-                             const std::vector<std::vector<int>> &B) {
-    if (A.size() != B.size() || A.empty() || A[0].size() != B[0].size()) {
-        throw std::invalid_argument("Matrix dimensions must match for column-wise dot product.");
+        QueryReader in(filename);
+        m = in.m(); n = in.n(); k = in.k(); Q = in.queries();
+    } catch (const std::exception &) {
+        return false;
     }
-
-    int n_rows = static_cast<int>(A.size());
-    int n_cols = static_cast<int>(A[0].size());
-
-    std::vector<int> out(n_cols, 0);
-
-    for (int col = 0; col < n_cols; ++col) {
-        int sum = 0;
-        for (int row = 0; row < n_rows; ++row) {
-            sum += A[row][col] * B[row][col];
-        }
-        out[col] = sum;
-    }
-
-    return out;
-}
-
-// Read only header (m n k Q) from a query file
-bool read_header_from_file(const std::string &filename, int &m, int &n, int &k, int &Q)
-{
-    std::ifstream in(filename);
-    if (!in) return false;
-    if (!(in >> m >> n >> k >> Q)) return false;
     return true;
 }
 
@@ -83,144 +25,84 @@ void run_in_parallel(boost::asio::io_context &io, Fs &&...funcs)
     (boost::asio::co_spawn(io, funcs, boost::asio::detached), ...);
 }
 
-int main()
+int main(int argc, char* argv[])
 {
     try
     {
-        
-        // 1) Read header (m,n,k,Q) from f1.txt or f2.txt (P0/P1 files). If not found, fallback to defaults.
-        bool ok = read_header_from_file("f1.txt", m, n, k, Q);
+        Options opt = parse_options(argc, argv);
+        if (opt.rng_seed >= 0) set_rng_seed(opt.rng_seed, 2);
+
+        // 1) Read header (m,n,k,Q) from the P0/P1 query files (f1/f2, .txt or with --binary-queries .qry). If not found, fallback to defaults.
+        int m = 0, n = 0, k = 0, Q = 0;
+        bool ok = read_header_from_file(query_file_path(0, opt.binary_queries), m, n, k, Q);
         if (!ok) {
-            ok = read_header_from_file("f2.txt", m, n, k, Q);
+            ok = read_header_from_file(query_file_path(1, opt.binary_queries), m, n, k, Q);
         }
         if (!ok) {
-            std::cout << "Warning: no f1.txt or f2.txt found or readable — using defaults n=" << n << " Q=" << Q << "\n";
+            std::cout << "Warning: no " << query_file_path(0, opt.binary_queries) << " or " << query_file_path(1, opt.binary_queries)
+                      << " found or readable — using defaults n=" << n << " Q=" << Q << "\n";
         } else {
             std::cout << "P2 read header: m=" << m << " n=" << n << " k=" << k << " Q=" << Q << "\n";
         }
-        
-        // Step 0: generate all shares for all queries
-        
-        // Storage units for both parties.
-        std::vector<int> alpha_shares_p0, alpha_shares_p1; // each is a single int
-        std::vector<std::vector<int>> e_alpha_shares_p0, e_alpha_shares_p1; // each is Q vectors of length n
-        std::vector<std::vector<std::vector<int>>> matrix_xn_shares_p0, matrix_xn_shares_p1; // each is Q matrices of size n * k (i.e., x_n)
-        std::vector<std::vector<std::vector<int>>> matrix_yn_shares_p0, matrix_yn_shares_p1; // each is Q matrices of size n * k (i.e., x_n)
-        std::vector<int> gamma_p0, gamma_p1; // each is a vector of length k
-        std::vector<std::vector<int>> gamma_shares_p0, gamma_shares_p1;
-        std::vector<std::vector<int>> mpc_vec_xk_shares_p0, mpc_vec_xk_shares_p1; // each is a vector of length k
-        std::vector<std::vector<int>> mpc_vec_yk_shares_p0, mpc_vec_yk_shares_p1; // each is a vector of length k
-        int vec_gamma_k_p0, vec_gamma_k_p1; // each is a single int
-        std::vector<int> mpc_gamma_shares_p0, mpc_gamma_shares_p1; // each is a single int
-        std::vector<std::vector<int>> mpc_scaler_xk_shares_p0, mpc_scaler_xk_shares_p1; // each is a vector of length k
-        std::vector<std::vector<int>> mpc_scaler_yk_shares_p0, mpc_scaler_yk_shares_p1; // each is a vector of length k
-        std::vector<std::vector<int>> mpc_scaler_gamma_shares_p0, mpc_scaler_gamma_shares_p1; // each is a single int
-        for (int q = 0; q < Q; ++q) {
-            // Firstly, let us get alpha shares(int) and e_alpha shares (1d vector).
-            int alpha = rand_int(0, n - 1);
-            std::cout<<"Query "<<q<<": alpha = "<<alpha<<"\n";
-            auto [alpha_p0, alpha_p1] = make_additive_shares_int(alpha);
-            alpha_shares_p0.push_back(alpha_p0);
-            alpha_shares_p1.push_back(alpha_p1);
-            auto [e_alpha_share_p0, e_alpha_share_p1] = make_basis_vector_shares(n, alpha);
-            e_alpha_shares_p0.push_back(e_alpha_share_p0);
-            e_alpha_shares_p1.push_back(e_alpha_share_p1);
 
-            // Now is the time for creating random 2d vectors and store them.
-            std::vector<std::vector<int>> mat_p0(n, std::vector<int>(k));
-            std::vector<std::vector<int>> mat_p1(n, std::vector<int>(k));
-            // for xn
-            fill_random(mat_p0);
-            fill_random(mat_p1);
-            matrix_xn_shares_p0.push_back(mat_p0);
-            matrix_xn_shares_p1.push_back(mat_p1);
-            // for yn
-            fill_random(mat_p0);
-            fill_random(mat_p1);
-            matrix_yn_shares_p0.push_back(mat_p0);
-            matrix_yn_shares_p1.push_back(mat_p1);
+        // Offline mode: generate everything into the two preprocessing files and stop there.
+        if (!opt.preproc_out.empty()) {
+            write_preproc_files(opt.preproc_out, n, k, Q, opt);
+            std::cout << "Wrote preprocessing of " << Q << " queries to " << preproc_file_path(opt.preproc_out, 0)
+                      << " and " << preproc_file_path(opt.preproc_out, 1) << "\n";
+            return 0;
+        }
 
-            // Now get gamma --> i.e., colwise dot product of x_n and y_n
-            gamma_p0 = colwise_dot(matrix_xn_shares_p0[q], matrix_yn_shares_p1[q]);
-            gamma_p1 = colwise_dot(matrix_xn_shares_p1[q], matrix_yn_shares_p0[q]);
-            
-            // Add a random vector to gamma_p0 and subtract it from gamma_p1
-            std::vector<int> gamma_mask(k);
-            for(int i = 0;i<k;i++) gamma_mask[i] = rand_int();
-            for(int i = 0;i<k;i++) {
-                gamma_p0[i] += gamma_mask[i];
-                gamma_p1[i] -= gamma_mask[i];
-            }
-            gamma_shares_p0.push_back(gamma_p0);
-            gamma_shares_p1.push_back(gamma_p1);
-            // Now let us make vectors for MPC dotprouct.
-            std::vector<int> mpc_dot_xk_p0(k), mpc_dot_xk_p1(k);
-            std::vector<int> mpc_dot_yk_p0(k), mpc_dot_yk_p1(k);
-            for(int i = 0;i<k;i++) {
-                mpc_dot_xk_p0[i] = rand_int();
-                mpc_dot_xk_p1[i] = rand_int();
-                mpc_dot_yk_p0[i] = rand_int();
-                mpc_dot_yk_p1[i] = rand_int();
+        // Step 0: start generating shares in the background, or map the offline files and serve those.
+        PreprocRing ring = make_preproc_ring(n, k, Q, opt);
+        std::unique_ptr<PreprocFile> files[2];
+        if (opt.preproc_file.empty()) {
+            ring.start(opt.workers);
+        } else {
+            for (int party = 0; party < 2; ++party) {
+                files[party] = std::make_unique<PreprocFile>(preproc_file_path(opt.preproc_file, party));
+                files[party]->check<Ring>(party, n, k, Q, opt.seeded, opt.dpf, opt.update_items);
             }
-            mpc_vec_xk_shares_p0.push_back(mpc_dot_xk_p0);
-            mpc_vec_xk_shares_p1.push_back(mpc_dot_xk_p1);
-            mpc_vec_yk_shares_p0.push_back(mpc_dot_yk_p0);
-            mpc_vec_yk_shares_p1.push_back(mpc_dot_yk_p1);
-
-            // Now get vec_gamma_k.
-            vec_gamma_k_p0 = dot_prod(mpc_vec_xk_shares_p0[q], mpc_vec_yk_shares_p1[q]);
-            vec_gamma_k_p1 = dot_prod(mpc_vec_xk_shares_p1[q], mpc_vec_yk_shares_p0[q]);
-            int gamma_mask_scalar = rand_int();
-            vec_gamma_k_p0 += gamma_mask_scalar;
-            vec_gamma_k_p1 -= gamma_mask_scalar;
-            mpc_gamma_shares_p0.push_back(vec_gamma_k_p0);
-            mpc_gamma_shares_p1.push_back(vec_gamma_k_p1);
+        }
 
-            // Now generate shares for mpc scalar multiplication.
-            std::vector<int> mpc_scalar_xk_p0(k), mpc_scalar_xk_p1(k);
-            std::vector<int> mpc_scalar_yk_p0(k), mpc_scalar_yk_p1(k);
-            for(int i = 0;i<k;i++) {
-                mpc_scalar_xk_p0[i] = rand_int();
-                mpc_scalar_xk_p1[i] = rand_int();
-                mpc_scalar_yk_p0[i] = rand_int();
-                mpc_scalar_yk_p1[i] = rand_int();
+        std::unique_ptr<Metrics> metrics;
+        if (!opt.metrics.empty()) metrics = std::make_unique<Metrics>(2);
+
+        boost::asio::io_context io_context(1);
+        Endpoint endpoint = Endpoint::parse(opt.p2);
+        ChannelListener listener(io_context.get_executor(), endpoint, opt.buffer);
+        // Accept clients (in whatever order they arrive); each one announces its role first.
+        Channel socket_p0, socket_p1;
+        co_spawn(io_context, [&]() -> boost::asio::awaitable<void> {
+            for (int c = 0; c < 2; ++c) {
+                Channel sock = co_await listener.accept();
+                int32_t role = -1;
+                co_await recv_int32(sock, role);
+                if (role == 0 && !socket_p0.is_open()) socket_p0 = std::move(sock);
+                else if (role == 1 && !socket_p1.is_open()) socket_p1 = std::move(sock);
+                else throw std::runtime_error("unknown or duplicate role announced by client: " + std::to_string(role));
             }
-            mpc_scaler_xk_shares_p0.push_back(mpc_scalar_xk_p0);
-            mpc_scaler_xk_shares_p1.push_back(mpc_scalar_xk_p1);
-            mpc_scaler_yk_shares_p0.push_back(mpc_scalar_yk_p0);
-            mpc_scaler_yk_shares_p1.push_back(mpc_scalar_yk_p1);
-
-            // Now get mpc_gamma shares.
-            std::vector<int> scaler_gamma_shares_p0, scaler_gamma_shares_p1;
-            for(int i = 0;i<k;i++){
-                int mpc_scalar_gamma_p0 = mpc_scaler_xk_shares_p0[q][i]*mpc_scaler_yk_shares_p1[q][i];
-                int mpc_scalar_gamma_p1 = mpc_scaler_xk_shares_p1[q][i]*mpc_scaler_yk_shares_p0[q][i];
-                int gamma_mask_scalar_2 = rand_int();
-                mpc_scalar_gamma_p0 += gamma_mask_scalar_2;
-                mpc_scalar_gamma_p1 -= gamma_mask_scalar_2;
-                
-                scaler_gamma_shares_p0.push_back(mpc_scalar_gamma_p0);
-                scaler_gamma_shares_p1.push_back(mpc_scalar_gamma_p1);
+            std::cout<<"Both clients connected to P2. Starting protocol...\n";
+            // Launch all coroutines in parallel
+            if (files[0]) {
+                run_in_parallel(io_context, [&]() -> boost::asio::awaitable<void>
+                                { co_await handle_client_file(socket_p0, "P0", *files[0], 0, Q, opt.batch, metrics.get());}, [&]() -> boost::asio::awaitable<void>
+                                { co_await handle_client_file(socket_p1, "P1", *files[1], 1, Q, opt.batch, metrics.get());});
+            } else {
+                run_in_parallel(io_context, [&]() -> boost::asio::awaitable<void>
+                                { co_await handle_client(socket_p0, "P0", ring, 0, n, k, Q, opt.batch, opt.seeded, metrics.get());}, [&]() -> boost::asio::awaitable<void>
+                                { co_await handle_client(socket_p1, "P1", ring, 1, n, k, Q, opt.batch, opt.seeded, metrics.get());});
             }
-            mpc_scaler_gamma_shares_p0.push_back(scaler_gamma_shares_p0);
-            mpc_scaler_gamma_shares_p1.push_back(scaler_gamma_shares_p1);
-        }
-        boost::asio::io_context io_context;
-        tcp::acceptor acceptor(io_context, tcp::endpoint(tcp::v4(), 9002));
-        // Accept clients
-        // Accept P0.
-        tcp::socket socket_p0(io_context);
-        acceptor.accept(socket_p0);
-        // Accept P1.
-        tcp::socket socket_p1(io_context);
-        acceptor.accept(socket_p1);
-        std::cout<<"Both clients connected to P2. Starting protocol...\n";
-        // Launch all coroutines in parallel
-        run_in_parallel(io_context, [&]() -> boost::asio::awaitable<void>
-                        { co_await handle_client(std::move(socket_p0), "P0", e_alpha_shares_p0, alpha_shares_p0, matrix_xn_shares_p0, matrix_yn_shares_p0, gamma_shares_p0, mpc_vec_xk_shares_p0, mpc_vec_yk_shares_p0, mpc_gamma_shares_p0, mpc_scaler_xk_shares_p0, mpc_scaler_yk_shares_p0, mpc_scaler_gamma_shares_p0);}, [&]() -> boost::asio::awaitable<void>
-                        { co_await handle_client(std::move(socket_p1), "P1", e_alpha_shares_p1, alpha_shares_p1, matrix_xn_shares_p1, matrix_yn_shares_p1, gamma_shares_p1, mpc_vec_xk_shares_p1, mpc_vec_yk_shares_p1, mpc_gamma_shares_p1, mpc_scaler_xk_shares_p1, mpc_scaler_yk_shares_p1, mpc_scaler_gamma_shares_p1);});
-
+        }, [&](std::exception_ptr e) {
+            if (!e) return;
+            try { std::rethrow_exception(e); }
+            catch (const std::exception &ex) { std::cerr << "Exception in P2 while accepting clients: " << ex.what() << "\n"; }
+            io_context.stop();
+        });
+
+        // The handlers wait for the ring without blocking (PreprocRing::take), so one io thread serves both.
         io_context.run();
+        if (metrics) metrics->write(opt.metrics + "_p2");
 
         //
     }
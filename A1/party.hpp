@@ -0,0 +1,583 @@
+#pragma once
+// The P0/P1 side of the protocol, shared by pB.cpp (one party per process) and bench_protocol.cpp
+// (all three parties as threads of one process). The role is a runtime argument, and the links to
+// P2 and to the peer can be any connected asio byte stream. Everything is a template on the ring word R
+// (ring.hpp); the binaries run with Ring.
+
+#include <chrono>
+#include <deque>
+#include <exception>
+#include <map>
+#include <memory>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "common.hpp"
+#include "du_atallah.hpp"
+#include "item_write.hpp"
+#include "local_preproc.hpp"
+#include "shares.hpp"
+#include "preproc.hpp"
+#include "preproc_file.hpp"
+#include "query_file.hpp"
+#include "options.hpp"
+#include "trace.hpp"
+#include "metrics.hpp"
+#include "mux.hpp"
+
+// ----------------------- Helper coroutines -----------------------
+
+// DPF read: expand the key into this party's e_alpha share and, in the same pass, rotate it into e_j
+// and accumulate the share of the masked row, <e_j, V_masked>. Runs of the expansion are consumed as
+// they come out of the DPF tree, so no separate pass over e_j or V_masked is needed.
+template <RingWord R>
+inline void dpf_read(const DpfKey &key, int party, int shift, MatrixView<const R> v_masked,
+              std::vector<R> &e_alpha, std::vector<R> &e_j, std::vector<R> &v_j_masked) {
+    size_t n = v_masked.rows(), k = v_masked.cols();
+    size_t s = static_cast<size_t>(((shift % static_cast<int>(n)) + static_cast<int>(n)) % static_cast<int>(n));
+    e_alpha.assign(n, 0);
+    e_j.assign(n, 0);
+    v_j_masked.assign(k, 0);
+    dpf_eval_full<R>(key, party, [&](size_t first, std::span<const R> vals) {
+        size_t dest = first + s >= n ? first + s - n : first + s;
+        for (size_t t = 0; t < vals.size(); t++) {
+            R e = vals[t];
+            e_alpha[first + t] = e;
+            e_j[dest] = e;
+            const R *row = v_masked[dest].data();
+            for (size_t c = 0; c < k; c++) v_j_masked[c] += e * row[c];
+            if (++dest == n) dest = 0;
+        }
+    });
+}
+
+// ----------------------- Main protocol -----------------------
+
+// State of one query inside a batch. Everything the log needs is kept until the update is applied.
+template <RingWord R>
+struct QueryState {
+    int index;                  // position of the query in the query file
+    int user_index;
+    int item_index_share;
+    Preproc<R> pre;             // correlated randomness from P2
+    int shift = 0;
+    std::vector<R> e_j;         // share of the standard basis vector e_j
+    std::vector<R> v_j_masked;  // share of (V + r0 + r1)[j]
+    std::vector<R> r_share;     // share of (r0 + r1)[j]
+    std::vector<R> v_j_share;   // share of V[j]
+    R inn_product = 0;
+    R delta = 0;
+    std::vector<R> result;      // share of v_j * delta
+    std::chrono::steady_clock::time_point start; // start of the query's batch (or its dispatch), for latencies
+};
+
+// Where a party's inputs come from and where its outputs go.
+struct PartyIO {
+    int role;                    // 0 = P0, 1 = P1
+    QueryReader *queries;        // the party's query file (query_file.hpp), text or binary
+    std::string share_file;      // memory-mapped share file, "" keeps the shares in memory only
+    std::string trace_file;      // binary trace of the shares (trace.hpp), "" for none
+    std::ostream *console = &std::cout; // progress messages, nullptr to stay quiet
+    Metrics *metrics = nullptr;  // per-phase instrumentation (metrics.hpp), nullptr for none
+    const PreprocFile *preproc = nullptr; // offline preprocessing (preproc_file.hpp) instead of P2, nullptr for P2
+};
+
+// Per-query timings, filled in by run_party when asked for (the benchmark harness).
+struct PartyStats {
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point begin, end;          // whole session, after the connections are up
+    std::vector<double> query_latency;     // seconds from the start of a query's batch to its update
+    uint64_t planned_rounds = 0;           // peer-link rounds the protocol flow implies (rounds_per_batch / _wave)
+};
+
+// What every batch of a run shares: the party's long-lived state.
+template <RingWord R>
+struct PartyState {
+    int role, n, k;
+    const Options &opt;
+    Share<R> &share;
+    ThreadPool &pool;
+    TraceLog<R> &trace;
+    Metrics *metrics;
+    PartyStats *stats;
+    std::ostream *console;
+    const PreprocFile *preproc;
+    LocalPreproc<R> *local;      // --local-preproc: generated with the peer instead of received from P2
+    ItemWrites<R> *writes;       // --update-items: the last batch's writes into V, opened in the next batch's round 1
+};
+
+// The preprocessing of queries [first, first + pre.size()) (pre sized with Preproc(n, k, dpf, write)): one read
+// from P2, or unpacked straight from the mapped offline file when there is one, with no I/O on the
+// online path (server_sock is not used then), or generated together with the peer over peer_link
+// (local_preproc.hpp).
+template <typename Stream, typename PeerStream, RingWord R>
+awaitable<void> fetch_preproc(PartyState<R> &ps, Stream &server_sock, PeerStream &peer_link, std::span<Preproc<R>> pre, int first) {
+    const int count = static_cast<int>(pre.size());
+    if (ps.local) {
+        PhaseSpan span(ps.metrics, "local_preproc", first, count, {&peer_link.counters()});
+        co_await ps.local->generate(peer_link, pre, ps.pool);
+        if (ps.stats) ps.stats->planned_rounds += local_rounds_per_batch;
+        co_return;
+    }
+    if (ps.preproc) {
+        PhaseSpan span(ps.metrics, "p2_delivery", first, count, {});
+        read_preproc_batch(*ps.preproc, pre, first, ps.opt.seeded, ps.role);
+        co_return;
+    }
+    PhaseSpan span(ps.metrics, "p2_delivery", first, count, {&server_sock.counters()});
+    co_await recv_preproc_batch(server_sock, pre, ps.n, ps.k, ps.opt.seeded, ps.role);
+    co_return;
+}
+
+// What happens to the blinded database before a batch reads it. V does not change between queries, so
+// it is built once per epoch of opt.epoch batches and reused by every read in it. At a new epoch the blinds
+// are either redrawn and the whole v_dash resent, or (--refresh-rows R) only the next R rows of a
+// round-robin schedule are re-blinded.
+enum class BlindStep { None, Rebuild, Refresh };
+
+inline BlindStep blind_step(const Options &opt, int batch_no) {
+    bool new_epoch = opt.epoch > 0 && batch_no % opt.epoch == 0;
+    if (batch_no == 0 || (new_epoch && opt.refresh_rows == 0)) return BlindStep::Rebuild;
+    return new_epoch ? BlindStep::Refresh : BlindStep::None;
+}
+
+// Rounds on the peer link. The messages of a batch are grouped by what they depend on (round.hpp):
+//   1  rotation (j - alpha), the blinded database (v_dash, or the refreshed rows of it) and the y half
+//      of the mask removal (y_n + r): none of them depends on another
+//   2  the x half of the mask removal (x_n + e_j), which needs the rotation
+// and for every wave of distinct users (see below)
+//   3  <u_i, v_j> (both halves) and the v_j half of v_j * delta, which need the read of v_j
+//   4  the delta half of v_j * delta, which needs <u_i, v_j>
+// So a query costs 4 rounds with --batch 1, and a batch 2 + 2 * waves.
+//
+// With --update-items the item row is written too (item_write.hpp): u_i * delta rides rounds 3 and 4
+// next to v_j * delta, and the opened writes of the previous batch ride round 1. They must reach r
+// before the y half of the mask removal is masked, so that half moves to round 2. The reads of a batch
+// all happen before its writes, so nothing waits for them, and only the last batch's writes need a
+// round of their own, at the end of the run.
+constexpr int rounds_per_batch = 2, rounds_per_wave = 2, item_write_final_rounds = 1;
+
+// The online phase of one batch whose preprocessing has arrived: rotation, the blinded database step,
+// the read of v_j and the user updates, all on peer_sock. tid is the batch's timeline row (its session).
+template <typename Stream, RingWord R>
+awaitable<void> run_batch(PartyState<R> &ps, Stream &peer_sock, std::vector<QueryState<R>> &batch, BlindStep blind, int tid = 0) {
+    const Options &opt = ps.opt;
+    const int role = ps.role, n = ps.n, k = ps.k;
+    Share<R> &share = ps.share;
+    ThreadPool &pool = ps.pool;
+    [[maybe_unused]] TraceLog<R> &trace = ps.trace;
+    Metrics *metrics = ps.metrics;
+    const LinkCounters *peer_link = &peer_sock.counters();
+    const int B = static_cast<int>(batch.size()), first = batch.front().index;
+
+    // Round 1. Rotation trick: exchange (j_b - alpha_b) for every query; with it go the new blinds of
+    // the masked V database (see BlindStep) and the y half of the mask removal, which uses those blinds
+    // (with item writes: the previous batch's writes instead, and the y half waits for round 2).
+    PhaseSpan rotation(metrics, "rotation", first, B, {peer_link}, tid);
+    Round round;
+    std::vector<int> local_diff(B);
+    for(int b = 0; b < B; b++) local_diff[b] = index_sub(batch[b].item_index_share, batch[b].pre.alpha);
+    std::vector<int> peer_diff(B);
+    round.add(local_diff, peer_diff);
+    if (blind == BlindStep::Rebuild) co_await share.post_rebuild(round, pool);
+    else if (blind == BlindStep::Refresh) share.post_refresh(round, share.next_refresh_rows(opt.refresh_rows));
+    if (ps.writes) ps.writes->post(round);
+
+    // Task is to unmask the read now....
+    // Here D is matrix.. So, the e_j shares (f0, f1) are extrapolated to matrices (every row i is e_j[i])
+    // for a column wise dot product with r; the matrix itself is never built (a row-broadcast operand).
+    // One Du-Atallah instance per query; the fused pass over V_masked, y_dash', r, y_n and x_dash'
+    // (kernels.hpp) also yields <e_j, V_masked> unless the DPF read already did. e_j is sized here and
+    // filled in place after the rotation, so the instances can be set up before it is known.
+    MultBatch<R> unmask;
+    for(int b = 0; b < B; b++){
+        auto &qs = batch[b];
+        qs.e_j.assign(n, 0);
+        unmask.colwise(Operand<R>(qs.e_j, k), Operand<R>(share.r.flat()), qs.pre.x_n.flat(), qs.pre.y_n.flat(), qs.pre.gamma_n,
+                       k, share.v_masked, opt.dpf ? nullptr : &qs.v_j_masked);
+    }
+    if (!ps.writes) co_await unmask.post_v(round, &pool);
+    co_await round.flush(peer_sock);
+    for(int b = 0; b < B; b++){
+        auto &qs = batch[b];
+        qs.shift = index_add(peer_diff[b], local_diff[b]); // j - alpha, exact in int32
+        if (!opt.dpf) { // DPF mode: e_j comes out of dpf_read below
+            std::vector<R> e_j = rotate_cyclic(qs.pre.e_alpha, qs.shift);
+            std::copy(e_j.begin(), e_j.end(), qs.e_j.begin());
+        }
+    }
+    rotation.end();
+    if (ps.stats) ps.stats->planned_rounds += rounds_per_batch;
+
+    // Step 2: Now, we have e_j shares. Next, we need the masked V database (its exchange was in round 1).
+    if (blind == BlindStep::Rebuild) {
+        PhaseSpan span(metrics, "blinded_db", first, B, {}, tid);
+        co_await share.complete_rebuild(pool);
+    } else if (blind == BlindStep::Refresh) {
+        PhaseSpan span(metrics, "blinded_db", first, B, {}, tid);
+        share.complete_refresh();
+    }
+    // The previous batch's writes go into v and r before anything reads r.
+    if (ps.writes) {
+        PhaseSpan span(metrics, "item_write", first, B, {}, tid);
+        co_await ps.writes->apply(share, pool);
+        co_await unmask.post_v(round, &pool);
+    }
+
+    // Now, we have to perform dot product <D + r0 + r1, f0> or <D + r0 + r1, f1> to get v_j shares.
+    // In DPF mode it is accumulated while the key is expanded; otherwise it is part of the fused pass below.
+    // The keys of a batch are expanded in parallel, one query per task.
+    if (opt.dpf) {
+        PhaseSpan span(metrics, "dpf_read", first, B, {}, tid);
+        co_await offload(pool, [&] {
+            pool.parallel_for(0, B, 1, [&](size_t lo, size_t hi) {
+                for(size_t b = lo; b < hi; b++){
+                    auto &qs = batch[b];
+                    dpf_read<R>(qs.pre.dpf_key, role, qs.shift, share.v_masked, qs.pre.e_alpha, qs.e_j, qs.v_j_masked);
+                }
+            });
+        });
+    }
+
+    // Round 2: the x half of the mask removal, then the local products.
+    PhaseSpan mask_removal(metrics, "mask_removal", first, B, {peer_link}, tid);
+    co_await unmask.post_u(round, &pool);
+    co_await round.flush(peer_sock);
+    co_await unmask.finish(&pool);
+    for(int b = 0; b < B; b++){
+        auto &qs = batch[b];
+        qs.r_share = std::move(unmask.result(b));
+        // Now, r_share is the share of dot product. Now remove mask.
+        qs.v_j_share = vec_sub<R>(qs.v_j_masked, qs.r_share);
+    }
+    mask_removal.end();
+
+    // Step 3: update the user rows. A query reads u_i, so queries on the same user must see the
+    // previous update: split the batch into waves of distinct users and run each wave in lockstep.
+    int w_begin = 0;
+    while(w_begin < B){
+        std::vector<int> users;
+        int w_end = w_begin;
+        while(w_end < B && std::find(users.begin(), users.end(), batch[w_end].user_index) == users.end()){
+            users.push_back(batch[w_end].user_index);
+            w_end++;
+        }
+
+        // Now, let us proceed with computing delta shares. Round 3 carries <u_i, v_j> and, since v_j is
+        // known by now, also the v_j half of the scalar product v_j * delta (delta broadcast over k).
+        // With item writes the item row's update u_i * delta (the old u_i) goes the same way.
+        MultBatch<R> dots, scalars;
+        std::vector<size_t> user_step(w_end - w_begin), item_step(w_end - w_begin);
+        for(int b = w_begin; b < w_end; b++){
+            auto &qs = batch[b];
+            dots.dot(Operand<R>(share.u[qs.user_index]), Operand<R>(qs.v_j_share), qs.pre.x_k, qs.pre.y_k, std::span<const R>(&qs.pre.gamma_k, 1));
+            user_step[b - w_begin] = scalars.hadamard(Operand<R>(qs.v_j_share), Operand<R>(std::span<const R>(&qs.delta, 1), k), qs.pre.scaler_x, qs.pre.scaler_y, qs.pre.scaler_gamma);
+            if (ps.writes) {
+                item_step[b - w_begin] = scalars.hadamard(Operand<R>(share.u[qs.user_index]), Operand<R>(std::span<const R>(&qs.delta, 1), k),
+                                                          qs.pre.item_x, qs.pre.item_y, qs.pre.item_gamma);
+            }
+        }
+        {
+            PhaseSpan span(metrics, "dot_product", first + w_begin, w_end - w_begin, {peer_link}, tid);
+            co_await dots.post_u(round);
+            co_await dots.post_v(round);
+            co_await scalars.post_u(round);
+            co_await round.flush(peer_sock);
+            co_await dots.finish();
+        }
+
+        // Now lets get shares of delta, and with them round 4: the delta half of the scalar product.
+        for(int b = w_begin; b < w_end; b++){
+            auto &qs = batch[b];
+            qs.inn_product = dots.result(b - w_begin)[0];
+            qs.delta = R(role == 0 ? 1 : 0) - qs.inn_product;
+        }
+        {
+            PhaseSpan span(metrics, "scalar_product", first + w_begin, w_end - w_begin, {peer_link}, tid);
+            co_await scalars.post_v(round);
+            co_await round.flush(peer_sock);
+            co_await scalars.finish();
+        }
+        if (ps.stats) ps.stats->planned_rounds += rounds_per_wave;
+
+        // Do the final update to user database now (in query order, logging as we go).
+        PhaseSpan update(metrics, "update", first + w_begin, w_end - w_begin, {}, tid);
+        for(int b = w_begin; b < w_end; b++){
+            auto &qs = batch[b];
+            qs.result = std::move(scalars.result(user_step[b - w_begin]));
+
+            // write them to the trace (just for the sake of sanity check).
+            // Log role and received values
+            TRACE_INFO(trace.query(role, qs.index));
+            TRACE_DEBUG(trace.matrix("User feature matrix u", share.u));
+            TRACE_DEBUG(trace.matrix("Item feature matrix v", share.v));
+            TRACE_DEBUG(trace.matrix("Random matrix r", share.r));
+            TRACE_DEBUG(trace.vector("e_alpha", qs.pre.e_alpha));
+            TRACE_INFO(trace.scalar("alpha", qs.pre.alpha));
+            TRACE_INFO(trace.scalar("shift", qs.shift));
+            TRACE_DEBUG(trace.vector("e_j", qs.e_j));
+            TRACE_DEBUG(trace.matrix("v_dash (after exchange)", share.v_dash_peer));
+            TRACE_DEBUG(trace.matrix("v_masked", share.v_masked));
+            TRACE_INFO(trace.vector("v_j_share (masked)", qs.v_j_masked));
+            TRACE_DEBUG(trace.broadcast("e_j_matrix", qs.e_j, k));
+            TRACE_DEBUG(trace.matrix("x_n", qs.pre.x_n));
+            TRACE_DEBUG(trace.matrix("y_n", qs.pre.y_n));
+            TRACE_INFO(trace.vector("gamma_n", qs.pre.gamma_n));
+            TRACE_DEBUG(trace.matrix("x_dash (after exchange)", MatrixView<const R>(unmask.peer_masked_u(b).data(), n, k)));
+            TRACE_DEBUG(trace.matrix("y_dash (after exchange)", MatrixView<const R>(unmask.peer_masked_v(b).data(), n, k)));
+            TRACE_INFO(trace.vector("r_share", qs.r_share));
+            TRACE_INFO(trace.vector("v_j_share (unmasked)", qs.v_j_share));
+            TRACE_INFO(trace.vector("x_k", qs.pre.x_k));
+            TRACE_INFO(trace.vector("y_k", qs.pre.y_k));
+            TRACE_INFO(trace.scalar("gamma_k", qs.pre.gamma_k));
+            TRACE_INFO(trace.scalar("Inner product share", qs.inn_product));
+            TRACE_INFO(trace.vector("scaler_x", qs.pre.scaler_x));
+            TRACE_INFO(trace.vector("scaler_y", qs.pre.scaler_y));
+            TRACE_INFO(trace.vector("scaler_gamma", qs.pre.scaler_gamma));
+
+            if (ps.writes) {
+                std::vector<R> &item_update = scalars.result(item_step[b - w_begin]);
+                TRACE_INFO(trace.vector("Item update share", item_update));
+                ps.writes->add(qs.shift, std::move(qs.pre.e_alpha), std::move(qs.pre.write_cross), item_update, qs.pre.write_mask);
+            }
+
+            std::vector<R> u_new = vec_add<R>(share.u[qs.user_index], qs.result);
+            std::copy(u_new.begin(), u_new.end(), share.u[qs.user_index].begin());
+            TRACE_DEBUG(trace.matrix("Final updated user feature vector", share.u));
+            if (ps.stats) ps.stats->query_latency[qs.index] = std::chrono::duration<double>(PartyStats::Clock::now() - qs.start).count();
+            if (ps.console) *ps.console << "User database updated.\n";
+        }
+        update.end();
+        w_begin = w_end;
+    }
+    co_return;
+}
+
+// --sessions S: a query only reads and writes its own user's row u[i] (V and the blinded database are
+// read-only within an epoch), so queries on different users are independent. They are spread over S
+// protocol sessions that run concurrently on this io_context, one query at a time each, every session on
+// its own stream of the peer link (mux.hpp, stream s + 1). A user's queries form a dependency chain: while
+// one of them is unfinished the next goes to the same session, behind it; otherwise it goes to an idle
+// session (or the least loaded one), and a user's entry is dropped as soon as its chain drains, so the
+// table only holds the users in flight. Idleness depends on timing, so P0 makes the choice and sends it to
+// P1 on stream S + 1. A query also names its user's unfinished predecessor, and a session waits for that
+// one locally before it starts: P1 may not have seen a chain drain that P0 has. P2 streams the bundles in
+// query order as always; the dispatcher reads them in that order and hands each to its query's session,
+// at most 2 * S queries ahead of the oldest unfinished one. At an epoch boundary it first waits for every
+// earlier query and then updates the blinded database on stream 0.
+template <typename Stream, RingWord R>
+awaitable<void> run_sessions(PartyState<R> &ps, Stream &server_sock, Stream &peer_sock, QueryReader &queries, int q) {
+    namespace asio = boost::asio;
+    const Options &opt = ps.opt;
+    const int S = opt.sessions, in_flight = 2 * opt.sessions;
+    auto ex = co_await asio::this_coro::executor;
+    auto forever = asio::steady_timer::time_point::max();
+
+    ChannelMux mux(peer_sock);
+    Channel control = mux.open(0), dispatch = mux.open(S + 1);
+    std::exception_ptr error;
+    asio::steady_timer wake(ex, forever); // cancelled whenever a session finishes a query or stops
+    bool mux_running = true;
+    asio::co_spawn(ex, mux.run(), [&](std::exception_ptr e) {
+        if (e && !error) error = e;
+        mux_running = false;
+        wake.cancel();
+    });
+
+    struct Job {
+        QueryState<R> qs;
+        int after; // the user's unfinished predecessor, -1 for none
+    };
+    struct Session {
+        Channel stream;
+        std::deque<Job> queue;
+        asio::steady_timer wake;
+        bool busy = false;
+        size_t load() const { return queue.size() + busy; }
+    };
+    struct Chain {
+        int session, last, pending; // where the user's queries go, its newest one, how many are unfinished
+    };
+    std::deque<Session> sessions;
+    std::map<int, Chain> chains; // users with unfinished queries
+    std::vector<char> finished(q, 0);
+    int oldest = 0, running = S;
+    bool dispatched = false;
+    for (int s = 0; s < S; s++) {
+        sessions.push_back(Session{mux.open(s + 1), {}, asio::steady_timer(ex, forever)});
+        asio::co_spawn(ex, [&, s]() -> awaitable<void> {
+            Session &sess = sessions[s];
+            for (;;) {
+                while ((sess.queue.empty() && !dispatched) ||
+                       (!sess.queue.empty() && sess.queue.front().after >= 0 && !finished[sess.queue.front().after] && !error)) {
+                    boost::system::error_code ignored;
+                    co_await sess.wake.async_wait(asio::redirect_error(asio::use_awaitable, ignored));
+                }
+                if (sess.queue.empty() || error) break;
+                std::vector<QueryState<R>> batch;
+                batch.push_back(std::move(sess.queue.front().qs));
+                sess.queue.pop_front();
+                sess.busy = true;
+                co_await run_batch(ps, sess.stream, batch, BlindStep::None, s + 1);
+                sess.busy = false;
+                finished[batch[0].index] = 1;
+                while (oldest < q && finished[oldest]) oldest++;
+                auto chain = chains.find(batch[0].user_index);
+                if (--chain->second.pending == 0) chains.erase(chain);
+                for (auto &other : sessions) other.wake.cancel();
+                wake.cancel();
+            }
+        }, [&](std::exception_ptr e) {
+            if (e && !error) error = e;
+            running--;
+            wake.cancel();
+        });
+    }
+    auto wait = [&]() -> awaitable<void> {
+        boost::system::error_code ignored;
+        co_await wake.async_wait(asio::redirect_error(asio::use_awaitable, ignored));
+    };
+
+    // (a failure here must stop the sessions like one of theirs does: they still refer to this frame)
+    try {
+        for (int i = 0; i < q && !error; i++) {
+            QueryState<R> qs;
+            qs.index = i;
+            QueryRecord rec = queries.next();
+            qs.user_index = static_cast<int>(rec.user);
+            qs.item_index_share = rec.item_share;
+            BlindStep blind = blind_step(opt, i);
+            if (blind != BlindStep::None) {
+                while (oldest < i && !error) co_await wait();
+                if (error) break;
+                PhaseSpan span(ps.metrics, "blinded_db", i, 0, {&control.counters()});
+                if (blind == BlindStep::Rebuild) co_await ps.share.rebuild_blinded(control, ps.pool);
+                else co_await ps.share.refresh_rows(control, ps.share.next_refresh_rows(opt.refresh_rows));
+            }
+            while (i - oldest >= in_flight && !error) co_await wait();
+            if (error) break;
+
+            std::vector<Preproc<R>> pre(1, Preproc<R>(ps.n, ps.k, opt.dpf, opt.update_items));
+            co_await fetch_preproc(ps, server_sock, control, std::span<Preproc<R>>(pre), i);
+            qs.pre = std::move(pre[0]);
+            qs.start = PartyStats::Clock::now();
+
+            int32_t target = 0;
+            if (ps.role == 0) {
+                auto chain = chains.find(qs.user_index);
+                if (chain != chains.end()) target = chain->second.session;
+                else for (int s = 1; s < S; s++) if (sessions[s].load() < sessions[target].load()) target = s;
+                co_await asio::async_write(dispatch, asio::buffer(&target, sizeof(target)), asio::use_awaitable);
+            } else {
+                co_await asio::async_read(dispatch, asio::buffer(&target, sizeof(target)), asio::use_awaitable);
+                if (target < 0 || target >= S) throw std::runtime_error("P0 dispatched a query to session " + std::to_string(target));
+            }
+            // (looked up again: the chain may have drained while this side waited on the dispatch stream)
+            auto chain = chains.find(qs.user_index);
+            int after = -1;
+            if (chain == chains.end()) {
+                chains.emplace(qs.user_index, Chain{target, i, 1});
+            } else {
+                after = chain->second.last;
+                chain->second = Chain{target, i, chain->second.pending + 1};
+            }
+            Session &sess = sessions[target];
+            sess.queue.push_back(Job{std::move(qs), after});
+            sess.wake.cancel();
+        }
+    } catch (...) {
+        if (!error) error = std::current_exception();
+    }
+
+    // Drain the sessions (on an error: stop them), then close the streams.
+    dispatched = true;
+    if (error) mux.abort();
+    for (auto &sess : sessions) sess.wake.cancel();
+    while (running > 0) co_await wait();
+    mux.close();
+    while (mux_running) co_await wait();
+    if (error) std::rethrow_exception(error);
+    co_return;
+}
+
+// Run every query of io.queries as party io.role, with shares in Z_2^w for R = ring_for_bits<w>::type.
+// server_sock is the link to P2 (unused with io.preproc or --local-preproc), peer_sock the link to the peer.
+template <RingWord R = Ring, typename Stream>
+awaitable<void> run_party(Stream& server_sock, Stream& peer_sock, const Options& opt, const PartyIO& io, PartyStats* stats = nullptr) {
+    const int role = io.role;
+    QueryReader &queries = *io.queries;
+    Metrics *metrics = io.metrics;
+    // Binary trace of the shares (trace.hpp), decoded offline by trace_decode into the old text log.
+    // Compiled out entirely with -DMPC_TRACE_LEVEL=0.
+    TraceLog<R> trace(io.trace_file);
+    int m = queries.m(), n = queries.n(), k = queries.k(), q = queries.queries();
+    if (queries.ring_bytes() != 0 && queries.ring_bytes() != sizeof(R)) {
+        throw std::runtime_error("query file made for " + std::to_string(8 * queries.ring_bytes()) + "-bit shares, this build uses " + std::to_string(8 * sizeof(R)));
+    }
+    // Initialize shares: U, V and r live for the whole session in a memory-mapped share file, so updates
+    // to U carry over to later queries (and later runs) and nothing is regenerated per query.
+    Share<R> share(n, m, k, io.share_file, opt.reset_shares);
+    // Local O(nk) work runs on this pool; the coroutine waits for it without blocking the io_context.
+    ThreadPool pool(opt.threads, opt.affinity);
+    if (io.console && !io.share_file.empty())
+        *io.console << (share.store.created() ? "Created fresh shares in " : "Mapped existing shares from ") << io.share_file << "\n";
+    if (stats) {
+        stats->query_latency.assign(q, 0.0);
+        stats->begin = PartyStats::Clock::now();
+    }
+    if (io.preproc) io.preproc->check<R>(role, n, k, q, opt.seeded, opt.dpf, opt.update_items);
+    // Without P2 (--local-preproc) the parties run the base OTs once, before any query.
+    std::unique_ptr<LocalPreproc<R>> local;
+    if (opt.local_preproc) {
+        local = std::make_unique<LocalPreproc<R>>(role, n, k);
+        PhaseSpan span(metrics, "local_preproc", 0, 0, {&peer_sock.counters()});
+        co_await local->setup(peer_sock);
+        if (stats) stats->planned_rounds += local_setup_rounds;
+    }
+    ItemWrites<R> writes(k);
+    PartyState<R> ps{role, n, k, opt, share, pool, trace, metrics, stats, io.console, io.preproc, local.get(), opt.update_items ? &writes : nullptr};
+    if (opt.sessions > 1) {
+        co_await run_sessions(ps, server_sock, peer_sock, queries, q);
+        if (stats) stats->end = PartyStats::Clock::now();
+        co_return;
+    }
+
+    // Queries are processed in batches of opt.batch: every protocol phase runs for the whole batch in lockstep,
+    // so each phase costs one message per direction instead of one per query. With --batch 1 this is the
+    // one-query-at-a-time protocol, in 4 rounds per query (see rounds_per_batch).
+    for(int first = 0; first < q; first += opt.batch){
+        auto batch_start = PartyStats::Clock::now();
+        int B = std::min(opt.batch, q - first);
+        // extract the queries of this batch
+        std::vector<QueryState<R>> batch(B);
+        for(int b = 0; b < B; b++){
+            batch[b].index = first + b;
+            batch[b].start = batch_start;
+            QueryRecord rec = queries.next();
+            batch[b].user_index = static_cast<int>(rec.user);
+            batch[b].item_index_share = rec.item_share;
+        }
+
+        // Here the protocol begins.
+        // Step 1: Receive the preprocessing material of the whole batch from the server (one read),
+        // or take it from the offline file.
+        std::vector<Preproc<R>> pre(B, Preproc<R>(n, k, opt.dpf, opt.update_items));
+        co_await fetch_preproc(ps, server_sock, peer_sock, std::span<Preproc<R>>(pre), first);
+        for(int b = 0; b < B; b++) batch[b].pre = std::move(pre[b]);
+
+        co_await run_batch(ps, peer_sock, batch, blind_step(opt, first / opt.batch));
+    }
+    // The last batch's item writes have no next batch to ride along with.
+    if (!writes.empty()) {
+        PhaseSpan span(metrics, "item_write", q, 0, {&peer_sock.counters()});
+        Round round;
+        writes.post(round);
+        co_await round.flush(peer_sock);
+        co_await writes.apply(share, pool);
+        if (stats) stats->planned_rounds += item_write_final_rounds;
+    }
+    if (stats) stats->end = PartyStats::Clock::now();
+
+    co_return;
+}
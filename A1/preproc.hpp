@@ -0,0 +1,224 @@
+#pragma once
+// Per-query correlated randomness that P2 hands to one party, and its wire layout.
+// The packed layout is exactly the order in which P2 has always sent the fields,
+// so a bundle (or several bundles back to back) can be moved with a single I/O call.
+// Ring fields take sizeof(R) bytes each, alpha (an index share) and the DPF key words 4.
+// With --update-items the bundle also carries the material of the item write (party.hpp, item_write.hpp)
+// after the old fields; without it those fields are empty and the layout is unchanged.
+
+#include "common.hpp"
+#include "dpf.hpp"
+#include "prg.hpp"
+
+template <RingWord R>
+struct Preproc {
+    std::vector<R> e_alpha;                          // share of the standard basis vector e_alpha (length n; DPF mode: expanded locally)
+    DpfKey dpf_key;                                  // DPF mode: key for e_alpha instead of the vector itself
+    int alpha = 0;                                   // share of alpha (an index share, always int32)
+    Matrix<R> x_n, y_n;                              // Du-Atallah masks for the n x k mask removal
+    std::vector<R> gamma_n;                          // correction term of the mask removal (length k)
+    std::vector<R> x_k, y_k;                         // Du-Atallah masks for <u_i, v_j>
+    R gamma_k = 0;                                   // correction term of <u_i, v_j>
+    std::vector<R> scaler_x, scaler_y, scaler_gamma; // Du-Atallah masks for v_j * delta
+    std::vector<R> item_x, item_y, item_gamma;       // item writes: Du-Atallah masks for u_i * delta
+    std::vector<R> write_mask;                       // item writes: Y_b, hides u_i * delta when it is opened
+    Matrix<R> write_cross;                           // item writes: share of e_alpha x (Y_0 + Y_1), n x k
+    PrgSeed seed{};                                  // seeded mode: the seed the random fields were expanded from
+
+    Preproc() = default;
+    Preproc(int n, int k, bool dpf = false, bool write = false)
+        : e_alpha(dpf ? 0 : n), dpf_key(dpf ? DpfKey(n, ring_words<R>) : DpfKey()),
+          x_n(n, k), y_n(n, k), gamma_n(k), x_k(k), y_k(k), scaler_x(k), scaler_y(k), scaler_gamma(k),
+          item_x(write ? k : 0), item_y(write ? k : 0), item_gamma(write ? k : 0), write_mask(write ? k : 0),
+          write_cross(write ? n : 0, write ? k : 0) {}
+
+    bool uses_dpf() const { return !dpf_key.words().empty(); }
+    bool writes_items() const { return !write_mask.empty(); }
+
+    // bytes that carry e_alpha: the vector itself, or the O(log n) DPF key in its place
+    static size_t e_alpha_bytes(int n, bool dpf) {
+        return dpf ? dpf_key_words(n, ring_words<R>) * sizeof(uint32_t) : static_cast<size_t>(n) * sizeof(R);
+    }
+
+    // number of bytes of one packed bundle
+    static size_t wire_bytes(int n, int k, bool dpf = false, bool write = false) {
+        size_t items = write ? static_cast<size_t>(n) * k + 4 * k : 0;
+        return e_alpha_bytes(n, dpf) + sizeof(int32_t) + (2 * static_cast<size_t>(n) * k + k + 2 * k + 1 + 3 * k + items) * sizeof(R);
+    }
+
+    // write the bundle to out (must hold wire_bytes(n, k) bytes), returns one past the end
+    char* pack(char* out) const {
+        auto put = [&](std::span<const R> v) { std::memcpy(out, v.data(), v.size_bytes()); out += v.size_bytes(); };
+        put(e_alpha);
+        out = pack_dpf_key(out);
+        out = put_scalar(out, int32_t(alpha));
+        put(x_n.flat());
+        put(y_n.flat());
+        put(gamma_n);
+        put(x_k);
+        put(y_k);
+        out = put_scalar(out, gamma_k);
+        put(scaler_x);
+        put(scaler_y);
+        put(scaler_gamma);
+        put(item_x);
+        put(item_y);
+        put(item_gamma);
+        put(write_mask);
+        put(write_cross.flat());
+        return out;
+    }
+
+    // read the bundle back from in (fields must already be sized), returns one past the end
+    const char* unpack(const char* in) {
+        auto get = [&](std::span<R> v) { std::memcpy(v.data(), in, v.size_bytes()); in += v.size_bytes(); };
+        get(e_alpha);
+        in = unpack_dpf_key(in);
+        in = get_scalar(in, alpha);
+        get(x_n.flat());
+        get(y_n.flat());
+        get(gamma_n);
+        get(x_k);
+        get(y_k);
+        in = get_scalar(in, gamma_k);
+        get(scaler_x);
+        get(scaler_y);
+        get(scaler_gamma);
+        get(item_x);
+        get(item_y);
+        get(item_gamma);
+        get(write_mask);
+        get(write_cross.flat());
+        return in;
+    }
+
+    // the DPF key words (none outside DPF mode)
+    char* pack_dpf_key(char* out) const {
+        auto words = dpf_key.words();
+        std::memcpy(out, words.data(), words.size_bytes());
+        return out + words.size_bytes();
+    }
+    const char* unpack_dpf_key(const char* in) {
+        auto words = dpf_key.words();
+        std::memcpy(words.data(), in, words.size_bytes());
+        return in + words.size_bytes();
+    }
+
+    template <typename T>
+    static char* put_scalar(char* out, T v) {
+        std::memcpy(out, &v, sizeof(v));
+        return out + sizeof(v);
+    }
+    template <typename T>
+    static const char* get_scalar(const char* in, T& v) {
+        std::memcpy(&v, in, sizeof(v));
+        return in + sizeof(v);
+    }
+};
+
+// ---------------------- Seed-compressed bundles ----------------------
+//
+// Every field of party 0's bundle is independent randomness, so P2 sends P0 only the seed.
+// Party 1 expands its masks (x_n, y_n, x_k, y_k, scaler_x, scaler_y) from its own seed and receives
+// just the terms that are correlated with party 0: e_alpha, alpha, gamma_n, gamma_k and scaler_gamma
+// (with --update-items also item_gamma and write_cross, drawn after the old fields so that their streams
+// do not change). Every expanded value is uniform over the ring (the alpha share over int32), as in the
+// live generator (helper.hpp).
+// In DPF mode e_alpha is not expanded from the seed; both parties get their DPF key right after the seed.
+
+// Expand the fields of `party`'s bundle that come from its seed (p must be sized, p.seed set).
+template <RingWord R>
+inline void expand_preproc(Preproc<R>& p, int party) {
+    Prg prg(p.seed);
+    prg.fill_ring<R>(p.x_n.flat());
+    prg.fill_ring<R>(p.y_n.flat());
+    prg.fill_ring<R>(p.x_k);
+    prg.fill_ring<R>(p.y_k);
+    prg.fill_ring<R>(p.scaler_x);
+    prg.fill_ring<R>(p.scaler_y);
+    if (party == 0) {
+        prg.fill_ring<R>(p.e_alpha);
+        p.alpha = static_cast<int32_t>(prg.next_u32());
+        prg.fill_ring<R>(p.gamma_n);
+        prg.fill_ring<R>(std::span<R>(&p.gamma_k, 1));
+        prg.fill_ring<R>(p.scaler_gamma);
+    }
+    if (!p.writes_items()) return;
+    prg.fill_ring<R>(p.item_x);
+    prg.fill_ring<R>(p.item_y);
+    prg.fill_ring<R>(p.write_mask);
+    if (party == 0) {
+        prg.fill_ring<R>(p.item_gamma);
+        prg.fill_ring<R>(p.write_cross.flat());
+    }
+}
+
+// number of bytes of one seed-compressed bundle for `party`
+template <RingWord R>
+inline size_t seeded_wire_bytes(int n, int k, int party, bool dpf = false, bool write = false) {
+    size_t key = dpf ? dpf_key_words(n, ring_words<R>) * sizeof(uint32_t) : 0;
+    if (party == 0) return sizeof(PrgSeed) + key;
+    size_t items = write ? static_cast<size_t>(n) * k + k : 0;
+    return sizeof(PrgSeed) + Preproc<R>::e_alpha_bytes(n, dpf) + sizeof(int32_t) + (2 * static_cast<size_t>(k) + 1 + items) * sizeof(R);
+}
+
+template <RingWord R>
+inline char* pack_seeded(const Preproc<R>& p, int party, char* out) {
+    std::memcpy(out, p.seed.data(), sizeof(PrgSeed));
+    out += sizeof(PrgSeed);
+    out = p.pack_dpf_key(out);
+    if (party == 0) return out;
+    auto put = [&](std::span<const R> v) { std::memcpy(out, v.data(), v.size_bytes()); out += v.size_bytes(); };
+    put(p.e_alpha);
+    out = Preproc<R>::put_scalar(out, int32_t(p.alpha));
+    put(p.gamma_n);
+    out = Preproc<R>::put_scalar(out, p.gamma_k);
+    put(p.scaler_gamma);
+    put(p.item_gamma);
+    put(p.write_cross.flat());
+    return out;
+}
+
+template <RingWord R>
+inline const char* unpack_seeded(Preproc<R>& p, int party, const char* in) {
+    std::memcpy(p.seed.data(), in, sizeof(PrgSeed));
+    in += sizeof(PrgSeed);
+    in = p.unpack_dpf_key(in);
+    expand_preproc(p, party);
+    if (party == 0) return in;
+    auto get = [&](std::span<R> v) { std::memcpy(v.data(), in, v.size_bytes()); in += v.size_bytes(); };
+    get(p.e_alpha);
+    in = Preproc<R>::get_scalar(in, p.alpha);
+    get(p.gamma_n);
+    in = Preproc<R>::get_scalar(in, p.gamma_k);
+    get(p.scaler_gamma);
+    get(p.item_gamma);
+    get(p.write_cross.flat());
+    return in;
+}
+
+// Send a run of bundles as one write (party is only used in seeded mode).
+template <typename Stream, RingWord R>
+awaitable<void> send_preproc_batch(Stream& sock, std::span<const Preproc<R>> batch, int n, int k, bool seeded = false, int party = 0) {
+    if (batch.empty()) co_return;
+    bool dpf = batch.front().uses_dpf(), write = batch.front().writes_items();
+    size_t bytes = seeded ? seeded_wire_bytes<R>(n, k, party, dpf, write) : Preproc<R>::wire_bytes(n, k, dpf, write);
+    std::vector<char> buf(batch.size() * bytes);
+    char* out = buf.data();
+    for (const auto& p : batch) out = seeded ? pack_seeded(p, party, out) : p.pack(out);
+    co_await send_vector1d(sock, buf);
+    co_return;
+}
+
+// Receive batch.size() bundles with one read into pre-sized bundles (sized with Preproc(n, k, dpf, write)).
+template <typename Stream, RingWord R>
+awaitable<void> recv_preproc_batch(Stream& sock, std::span<Preproc<R>> batch, int n, int k, bool seeded = false, int party = 0) {
+    if (batch.empty()) co_return;
+    bool dpf = batch.front().uses_dpf(), write = batch.front().writes_items();
+    size_t bytes = seeded ? seeded_wire_bytes<R>(n, k, party, dpf, write) : Preproc<R>::wire_bytes(n, k, dpf, write);
+    std::vector<char> buf(batch.size() * bytes);
+    co_await recv_vector1d(sock, buf);
+    const char* in = buf.data();
+    for (auto& p : batch) in = seeded ? unpack_seeded(p, party, in) : p.unpack(in);
+    co_return;
+}
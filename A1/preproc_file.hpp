@@ -0,0 +1,199 @@
+#pragma once
+// Offline preprocessing files. P2's correlated randomness does not depend on the inputs, so it can be
+// generated ahead of time (p2 --preproc-out PREFIX) into one file per party, PREFIX_p0.pre and
+// PREFIX_p1.pre. Each file holds exactly the bytes P2 would stream to that party live, query after
+// query, behind a 64-byte header:
+//   8-byte magic "CS670PRE", uint32 version, uint32 party, uint32 n, k, Q, uint32 ring element bytes,
+//   uint32 flags (1 = seeded, 2 = dpf, 4 = item writes), uint32 0, uint64 bytes per query, then padding to 64 bytes
+// so the bundle of query q sits at 64 + q * record_bytes and a run of queries is one contiguous range.
+//
+// Online, either the parties map their own file and unpack the bundles from the mapping
+// (--preproc-file PREFIX on P0/P1, no connection to P2 at all), or P2 serves the files
+// (--preproc-file PREFIX on P2) and moves each batch from the page cache to the socket with
+// sendfile(2), with no generation, packing or user-space copy on its side.
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "preproc.hpp"
+
+struct PreprocFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t party;
+    uint32_t n, k, queries;
+    uint32_t ring_bytes;
+    uint32_t flags;
+    uint32_t reserved;
+    uint64_t record_bytes;
+    uint8_t pad[16];
+};
+static_assert(sizeof(PreprocFileHeader) == 64);
+
+constexpr char preproc_file_magic[8] = {'C', 'S', '6', '7', '0', 'P', 'R', 'E'};
+constexpr uint32_t preproc_file_version = 1;
+constexpr uint32_t preproc_flag_seeded = 1, preproc_flag_dpf = 2, preproc_flag_write = 4;
+
+inline uint32_t preproc_flags(bool seeded, bool dpf, bool write) {
+    return (seeded ? preproc_flag_seeded : 0) | (dpf ? preproc_flag_dpf : 0) | (write ? preproc_flag_write : 0);
+}
+
+inline std::string preproc_file_path(const std::string &prefix, int party) {
+    return prefix + "_p" + std::to_string(party) + ".pre";
+}
+
+// bytes of one query's bundle for `party`, as P2 sends it
+template <RingWord R>
+inline size_t preproc_record_bytes(int n, int k, int party, bool seeded, bool dpf, bool write) {
+    return seeded ? seeded_wire_bytes<R>(n, k, party, dpf, write) : Preproc<R>::wire_bytes(n, k, dpf, write);
+}
+
+// Appends the bundles of one party in query order; finish() checks that all Q were written.
+template <RingWord R>
+class PreprocFileWriter {
+    public:
+        PreprocFileWriter(const std::string &path, int party, int n, int k, int Q, bool seeded, bool dpf, bool items)
+            : path_(path), party_(party), Q_(Q), seeded_(seeded) {
+            file_ = std::fopen(path.c_str(), "wb");
+            if (!file_) throw std::runtime_error("cannot create preprocessing file " + path + ": " + std::strerror(errno));
+            PreprocFileHeader h{};
+            std::memcpy(h.magic, preproc_file_magic, sizeof(h.magic));
+            h.version = preproc_file_version;
+            h.party = party;
+            h.n = n; h.k = k; h.queries = Q;
+            h.ring_bytes = sizeof(R);
+            h.flags = preproc_flags(seeded, dpf, items);
+            h.record_bytes = preproc_record_bytes<R>(n, k, party, seeded, dpf, items);
+            record_bytes_ = h.record_bytes;
+            write(&h, sizeof(h));
+        }
+
+        ~PreprocFileWriter() {
+            if (file_) std::fclose(file_);
+        }
+
+        PreprocFileWriter(const PreprocFileWriter&) = delete;
+        PreprocFileWriter& operator=(const PreprocFileWriter&) = delete;
+
+        // one write per batch
+        void append(std::span<const Preproc<R>> batch) {
+            buf_.resize(batch.size() * record_bytes_);
+            char *out = buf_.data();
+            for (const auto &p : batch) out = seeded_ ? pack_seeded(p, party_, out) : p.pack(out);
+            write(buf_.data(), buf_.size());
+            written_ += static_cast<int>(batch.size());
+        }
+
+        void finish() {
+            if (written_ != Q_) throw std::runtime_error("preprocessing file " + path_ + " is incomplete");
+            if (std::fflush(file_) != 0 || fsync(fileno(file_)) != 0) {
+                throw std::runtime_error("cannot write preprocessing file " + path_ + ": " + std::strerror(errno));
+            }
+            std::fclose(file_);
+            file_ = nullptr;
+        }
+
+    private:
+        void write(const void *p, size_t bytes) {
+            if (std::fwrite(p, 1, bytes, file_) != bytes) throw std::runtime_error("cannot write preprocessing file " + path_ + ": " + std::strerror(errno));
+        }
+
+        std::string path_;
+        int party_, Q_;
+        bool seeded_;
+        size_t record_bytes_ = 0;
+        int written_ = 0;
+        std::vector<char> buf_;
+        std::FILE *file_ = nullptr;
+};
+
+// A preprocessing file, mapped read-only.
+class PreprocFile {
+    public:
+        explicit PreprocFile(const std::string &path) : path_(path) {
+            fd_ = ::open(path.c_str(), O_RDONLY);
+            if (fd_ < 0) throw std::runtime_error("cannot open preprocessing file " + path + ": " + std::strerror(errno));
+            struct stat st{};
+            fstat(fd_, &st);
+            bytes_ = static_cast<size_t>(st.st_size);
+            if (bytes_ < sizeof(PreprocFileHeader)) throw std::runtime_error("preprocessing file " + path + " is truncated");
+            base_ = mmap(nullptr, bytes_, PROT_READ, MAP_SHARED, fd_, 0);
+            if (base_ == MAP_FAILED) throw std::runtime_error("cannot map preprocessing file " + path + ": " + std::strerror(errno));
+            std::memcpy(&h_, base_, sizeof(h_));
+            if (std::memcmp(h_.magic, preproc_file_magic, sizeof(h_.magic)) != 0 || h_.version != preproc_file_version) {
+                throw std::runtime_error(path + " is not a preprocessing file of this version");
+            }
+            // (by division: a damaged header must not pass through an overflowing product)
+            size_t body = bytes_ - sizeof(PreprocFileHeader);
+            if (h_.queries == 0 ? body != 0 : body % h_.queries != 0 || body / h_.queries != h_.record_bytes) {
+                throw std::runtime_error("preprocessing file " + path + " is truncated");
+            }
+        }
+
+        ~PreprocFile() {
+            if (base_ != MAP_FAILED) munmap(base_, bytes_);
+            if (fd_ >= 0) ::close(fd_);
+        }
+
+        PreprocFile(const PreprocFile&) = delete;
+        PreprocFile& operator=(const PreprocFile&) = delete;
+
+        const PreprocFileHeader &header() const { return h_; }
+        int fd() const { return fd_; }
+        int queries() const { return static_cast<int>(h_.queries); }
+
+        // where the bundle of query q starts, in the file and in the mapping
+        uint64_t offset(int q) const { return sizeof(PreprocFileHeader) + h_.record_bytes * static_cast<uint64_t>(q); }
+        const char *record(int q) const { return static_cast<const char*>(base_) + offset(q); }
+
+        // The file must have been generated for this party and session, with shares in R, at least Q
+        // queries long, and its records must have the size the readers unpack.
+        template <RingWord R>
+        void check(int party, int n, int k, int Q, bool seeded, bool dpf, bool write) const {
+            uint32_t flags = preproc_flags(seeded, dpf, write);
+            auto fail = [&](const std::string &what) { throw std::runtime_error("preprocessing file " + path_ + ": " + what); };
+            if (h_.party != static_cast<uint32_t>(party)) fail("made for party " + std::to_string(h_.party));
+            if (h_.n != static_cast<uint32_t>(n) || h_.k != static_cast<uint32_t>(k)) fail("made for other dimensions");
+            if (h_.ring_bytes != sizeof(R)) fail("made for another ring width");
+            if (h_.flags != flags) fail("--seeded / --dpf / --update-items differ from the ones it was made with");
+            size_t expected = preproc_record_bytes<R>(n, k, party, seeded, dpf, write);
+            if (h_.record_bytes != expected) {
+                fail("records of " + std::to_string(h_.record_bytes) + " bytes, expected " + std::to_string(expected));
+            }
+            if (h_.queries < static_cast<uint32_t>(Q)) fail("holds only " + std::to_string(h_.queries) + " queries");
+        }
+
+    private:
+        std::string path_;
+        int fd_ = -1;
+        void *base_ = MAP_FAILED;
+        size_t bytes_ = 0;
+        PreprocFileHeader h_{};
+};
+
+// Bundles of queries [first, first + batch.size()) straight from the mapping, as recv_preproc_batch
+// unpacks them from the socket (batch pre-sized with Preproc(n, k, dpf, write)).
+template <RingWord R>
+inline void read_preproc_batch(const PreprocFile &file, std::span<Preproc<R>> batch, int first, bool seeded, int party) {
+    const char *in = file.record(first);
+    for (auto &p : batch) in = seeded ? unpack_seeded(p, party, in) : p.unpack(in);
+}
+
+// P2: send the bundles of queries [first, first + count) to a party, with sendfile(2) on a socket
+// channel, or as one write straight from the mapping on shared memory.
+template <typename Stream>
+awaitable<void> send_preproc_file(Stream &sock, const PreprocFile &file, int first, int count) {
+    if (count <= 0) co_return;
+    size_t bytes = file.header().record_bytes * static_cast<size_t>(count);
+    if (co_await sock.send_file(file.fd(), file.offset(first), bytes)) co_return;
+    co_await boost::asio::async_write(sock, boost::asio::buffer(file.record(first), bytes), use_awaitable);
+    co_return;
+}
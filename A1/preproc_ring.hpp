@@ -0,0 +1,157 @@
+#pragma once
+// Bounded producer/consumer ring for P2's preprocessing.
+// Worker threads generate the bundles of query q+1 ... q+W while the client handlers are still sending
+// query q, so P2 only ever holds `capacity` queries worth of material, whatever the total number of queries.
+// The handlers are coroutines: take() suspends until the bundle is there and the worker that finishes it
+// posts the completion to the handler's executor, so any number of handlers can wait on one io thread.
+// A generator that throws (e.g. bad_alloc) fails its query: the exception is rethrown from take().
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <boost/asio.hpp>
+#include "preproc.hpp"
+
+template <RingWord R = Ring>
+class PreprocRing {
+    public:
+        using Generator = std::function<std::pair<Preproc<R>, Preproc<R>>(int q)>;
+
+        PreprocRing(size_t capacity, int total, Generator gen)
+            : slots_(capacity), total_(total), gen_(std::move(gen)) {
+            if (capacity == 0) throw std::invalid_argument("PreprocRing: capacity must be >= 1");
+        }
+
+        ~PreprocRing() {
+            {
+                std::lock_guard<std::mutex> lock(mu_);
+                stop_ = true;
+            }
+            cv_.notify_all();
+            for (auto &t : workers_) t.join();
+        }
+
+        // Start the producer threads (queries are claimed in order, so the ring fills front to back).
+        void start(int workers) {
+            for (int w = 0; w < workers; ++w) workers_.emplace_back([this] { produce(); });
+        }
+
+        // Wait until query q is generated and hand out the bundle of `party` (0 or 1).
+        // The slot is recycled once both parties have taken their half.
+        boost::asio::awaitable<Preproc<R>> take(int q, int party) {
+            auto init = [this, q, party](auto handler) {
+                auto h = std::make_shared<decltype(handler)>(std::move(handler));
+                Completion done = [h](std::exception_ptr e, Preproc<R> out) {
+                    auto ex = boost::asio::get_associated_executor(*h);
+                    boost::asio::post(ex, [h, e, out = std::move(out)]() mutable { std::move(*h)(e, std::move(out)); });
+                };
+                std::unique_lock<std::mutex> lock(mu_);
+                Slot &s = slots_[q % slots_.size()];
+                if (!(s.q == q && s.ready)) {
+                    waiters_.push_back({q, party, std::move(done)});
+                    return;
+                }
+                Preproc<R> out;
+                std::exception_ptr e;
+                bool freed = claim(s, party, out, e);
+                lock.unlock();
+                if (freed) cv_.notify_all();
+                done(e, std::move(out));
+            };
+            co_return co_await boost::asio::async_initiate<decltype(boost::asio::use_awaitable), void(std::exception_ptr, Preproc<R>)>(
+                init, boost::asio::use_awaitable);
+        }
+
+        // The same for a caller off any executor (the offline writer): blocks the calling thread.
+        Preproc<R> take_blocking(int q, int party) {
+            std::unique_lock<std::mutex> lock(mu_);
+            Slot &s = slots_[q % slots_.size()];
+            cv_.wait(lock, [&] { return s.q == q && s.ready; });
+            Preproc<R> out;
+            std::exception_ptr e;
+            bool freed = claim(s, party, out, e);
+            lock.unlock();
+            if (freed) cv_.notify_all();
+            if (e) std::rethrow_exception(e);
+            return out;
+        }
+
+    private:
+        struct Slot {
+            int q = -1;       // query held by this slot (-1 when free)
+            bool ready = false;
+            bool taken[2] = {false, false};
+            Preproc<R> part[2];
+            std::exception_ptr error; // the generator's, handed to both parties instead of the bundles
+        };
+        using Completion = std::function<void(std::exception_ptr, Preproc<R>)>;
+        struct Waiter {
+            int q, party;
+            Completion done;
+        };
+
+        // Take party's half of the ready slot s (mu_ held). True once both halves are gone and the slot is
+        // free again, so the caller wakes the producers.
+        static bool claim(Slot &s, int party, Preproc<R> &out, std::exception_ptr &error) {
+            out = std::move(s.part[party]);
+            error = s.error;
+            s.taken[party] = true;
+            if (!(s.taken[0] && s.taken[1])) return false;
+            s = Slot{};
+            return true;
+        }
+
+        void produce() {
+            for (;;) {
+                int q;
+                {
+                    std::unique_lock<std::mutex> lock(mu_);
+                    // wait for the slot of the next query to be released by both consumers
+                    cv_.wait(lock, [&] { return stop_ || next_q_ >= total_ || slots_[next_q_ % slots_.size()].q == -1; });
+                    if (stop_ || next_q_ >= total_) return;
+                    q = next_q_++;
+                    slots_[q % slots_.size()].q = q;
+                }
+                std::pair<Preproc<R>, Preproc<R>> parts;
+                std::exception_ptr error;
+                try {
+                    parts = gen_(q);
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                // hand the halves straight to the handlers already waiting for them
+                struct Handoff { Completion done; Preproc<R> out; std::exception_ptr error; };
+                std::vector<Handoff> ready;
+                {
+                    std::lock_guard<std::mutex> lock(mu_);
+                    Slot &s = slots_[q % slots_.size()];
+                    s.part[0] = std::move(parts.first);
+                    s.part[1] = std::move(parts.second);
+                    s.error = error;
+                    s.ready = true;
+                    for (size_t i = 0; i < waiters_.size();) {
+                        if (waiters_[i].q != q) { i++; continue; }
+                        Handoff h{std::move(waiters_[i].done), {}, {}};
+                        claim(s, waiters_[i].party, h.out, h.error);
+                        ready.push_back(std::move(h));
+                        waiters_.erase(waiters_.begin() + i);
+                    }
+                }
+                cv_.notify_all();
+                for (auto &h : ready) h.done(h.error, std::move(h.out));
+            }
+        }
+
+        std::vector<Slot> slots_;
+        int total_;
+        Generator gen_;
+        int next_q_ = 0;
+        bool stop_ = false;
+        std::mutex mu_;
+        std::condition_variable cv_;
+        std::vector<Waiter> waiters_; // handlers suspended in take() until their query is generated
+        std::vector<std::thread> workers_;
+};
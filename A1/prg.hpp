@@ -0,0 +1,392 @@
+#pragma once
+// Keyed pseudorandom generator (ChaCha20 in counter mode) and the process-wide randomness API.
+// P2 and a party that hold the same seed expand exactly the same stream, so uniformly random
+// preprocessing can be shipped as a 32-byte seed instead of the full vectors and matrices.
+//
+// Bulk fills run several ChaCha blocks side by side in SIMD registers (AVX-512: 16 blocks,
+// AVX2: 8 blocks) picked at runtime from the CPU flags, with a portable scalar fallback.
+// All paths produce the same keystream.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <span>
+#include "ring.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PRG_HAVE_X86 1
+#endif
+
+using PrgSeed = std::array<uint32_t, 8>; // 256-bit ChaCha key
+
+// ---------------------- ChaCha20 block kernels ----------------------
+
+namespace prg_detail {
+
+inline uint32_t rotl(uint32_t v, int c) { return (v << c) | (v >> (32 - c)); }
+
+inline void quarter(uint32_t &a, uint32_t &b, uint32_t &c, uint32_t &d) {
+    a += b; d ^= a; d = rotl(d, 16);
+    c += d; b ^= c; b = rotl(b, 12);
+    a += b; d ^= a; d = rotl(d, 8);
+    c += d; b ^= c; b = rotl(b, 7);
+}
+
+// One 64-byte block for the given state (state[12..13] is the block counter)
+inline void block_scalar(const uint32_t state[16], uint32_t out[16]) {
+    uint32_t x[16];
+    std::memcpy(x, state, sizeof(x));
+    for (int round = 0; round < 10; ++round) {
+        quarter(x[0], x[4], x[8], x[12]);
+        quarter(x[1], x[5], x[9], x[13]);
+        quarter(x[2], x[6], x[10], x[14]);
+        quarter(x[3], x[7], x[11], x[15]);
+        quarter(x[0], x[5], x[10], x[15]);
+        quarter(x[1], x[6], x[11], x[12]);
+        quarter(x[2], x[7], x[8], x[13]);
+        quarter(x[3], x[4], x[9], x[14]);
+    }
+    for (int i = 0; i < 16; ++i) out[i] = x[i] + state[i];
+}
+
+#ifdef PRG_HAVE_X86
+#define PRG_QR(ROTL, a, b, c, d)                       \
+    a = ADD(a, b); d = XOR(d, a); d = ROTL(d, 16);     \
+    c = ADD(c, d); b = XOR(b, c); b = ROTL(b, 12);     \
+    a = ADD(a, b); d = XOR(d, a); d = ROTL(d, 8);      \
+    c = ADD(c, d); b = XOR(b, c); b = ROTL(b, 7);
+
+#define PRG_DOUBLE_ROUND(ROTL, x)                                                  \
+    PRG_QR(ROTL, x[0], x[4], x[8], x[12]) PRG_QR(ROTL, x[1], x[5], x[9], x[13])   \
+    PRG_QR(ROTL, x[2], x[6], x[10], x[14]) PRG_QR(ROTL, x[3], x[7], x[11], x[15]) \
+    PRG_QR(ROTL, x[0], x[5], x[10], x[15]) PRG_QR(ROTL, x[1], x[6], x[11], x[12]) \
+    PRG_QR(ROTL, x[2], x[7], x[8], x[13]) PRG_QR(ROTL, x[3], x[4], x[9], x[14])
+
+// Run the rounds on 8 lane-sliced input states (word w of lane l in lane l of s[w]) and store the
+// 8 output blocks contiguously.
+__attribute__((target("avx2"))) inline void rounds8_avx2(const __m256i s[16], uint32_t* out) {
+#define ADD _mm256_add_epi32
+#define XOR _mm256_xor_si256
+#define ROTL256(v, c) _mm256_or_si256(_mm256_slli_epi32(v, c), _mm256_srli_epi32(v, 32 - c))
+    __m256i x[16];
+    for (int i = 0; i < 16; ++i) x[i] = s[i];
+    for (int round = 0; round < 10; ++round) { PRG_DOUBLE_ROUND(ROTL256, x) }
+    for (int i = 0; i < 16; ++i) x[i] = _mm256_add_epi32(x[i], s[i]);
+#undef ROTL256
+#undef XOR
+#undef ADD
+    // transpose two 8x8 tiles (words 0-7 and 8-15) so every block comes out contiguous
+    for (int half = 0; half < 2; ++half) {
+        __m256i *r = x + 8 * half;
+        __m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]), t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+        __m256i t2 = _mm256_unpacklo_epi32(r[2], r[3]), t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+        __m256i t4 = _mm256_unpacklo_epi32(r[4], r[5]), t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+        __m256i t6 = _mm256_unpacklo_epi32(r[6], r[7]), t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+        __m256i u0 = _mm256_unpacklo_epi64(t0, t2), u1 = _mm256_unpackhi_epi64(t0, t2);
+        __m256i u2 = _mm256_unpacklo_epi64(t1, t3), u3 = _mm256_unpackhi_epi64(t1, t3);
+        __m256i u4 = _mm256_unpacklo_epi64(t4, t6), u5 = _mm256_unpackhi_epi64(t4, t6);
+        __m256i u6 = _mm256_unpacklo_epi64(t5, t7), u7 = _mm256_unpackhi_epi64(t5, t7);
+        __m256i rows[8] = {
+            _mm256_permute2x128_si256(u0, u4, 0x20), _mm256_permute2x128_si256(u1, u5, 0x20),
+            _mm256_permute2x128_si256(u2, u6, 0x20), _mm256_permute2x128_si256(u3, u7, 0x20),
+            _mm256_permute2x128_si256(u0, u4, 0x31), _mm256_permute2x128_si256(u1, u5, 0x31),
+            _mm256_permute2x128_si256(u2, u6, 0x31), _mm256_permute2x128_si256(u3, u7, 0x31)};
+        for (int b = 0; b < 8; ++b) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 16 * b + 8 * half), rows[b]);
+        }
+    }
+}
+
+// 8 consecutive blocks; the caller guarantees the low counter word does not wrap inside them.
+__attribute__((target("avx2"))) inline void blocks8_avx2(const uint32_t state[16], uint32_t* out) {
+    __m256i s[16];
+    for (int i = 0; i < 16; ++i) s[i] = _mm256_set1_epi32(static_cast<int>(state[i]));
+    s[12] = _mm256_add_epi32(s[12], _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    rounds8_avx2(s, out);
+}
+
+// Block 0 of 8 independent short-key states (see keyed_blocks); lane l takes its key from keys + 4 * l.
+__attribute__((target("avx2"))) inline void keyed8_avx2(const uint32_t base[16], const uint32_t* keys, uint32_t* out) {
+    const __m256i idx = _mm256_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28);
+    __m256i s[16];
+    for (int i = 0; i < 16; ++i) s[i] = _mm256_set1_epi32(static_cast<int>(base[i]));
+    for (int w = 0; w < 4; ++w) s[4 + w] = _mm256_i32gather_epi32(reinterpret_cast<const int*>(keys + w), idx, 4);
+    rounds8_avx2(s, out);
+}
+
+// 16-lane counterpart of rounds8_avx2.
+__attribute__((target("avx512f"))) inline void rounds16_avx512(const __m512i s[16], uint32_t* out) {
+#define ADD _mm512_add_epi32
+#define XOR _mm512_xor_si512
+#define ROTL512(v, c) _mm512_rol_epi32(v, c)
+    __m512i x[16];
+    for (int i = 0; i < 16; ++i) x[i] = s[i];
+    for (int round = 0; round < 10; ++round) { PRG_DOUBLE_ROUND(ROTL512, x) }
+#undef ROTL512
+#undef XOR
+#undef ADD
+    // word w of block b lives in lane b of x[w]: scatter each word vector with a stride of one block
+    const __m512i idx = _mm512_setr_epi32(0, 16, 32, 48, 64, 80, 96, 112, 128, 144, 160, 176, 192, 208, 224, 240);
+    for (int w = 0; w < 16; ++w) {
+        _mm512_i32scatter_epi32(out + w, idx, _mm512_add_epi32(x[w], s[w]), 4);
+    }
+}
+
+// 16 consecutive blocks; same counter precondition as blocks8_avx2.
+__attribute__((target("avx512f"))) inline void blocks16_avx512(const uint32_t state[16], uint32_t* out) {
+    __m512i s[16];
+    for (int i = 0; i < 16; ++i) s[i] = _mm512_set1_epi32(static_cast<int>(state[i]));
+    s[12] = _mm512_add_epi32(s[12], _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+    rounds16_avx512(s, out);
+}
+
+// 16-lane counterpart of keyed8_avx2.
+__attribute__((target("avx512f"))) inline void keyed16_avx512(const uint32_t base[16], const uint32_t* keys, uint32_t* out) {
+    const __m512i idx = _mm512_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28, 32, 36, 40, 44, 48, 52, 56, 60);
+    __m512i s[16];
+    for (int i = 0; i < 16; ++i) s[i] = _mm512_set1_epi32(static_cast<int>(base[i]));
+    for (int w = 0; w < 4; ++w) s[4 + w] = _mm512_i32gather_epi32(idx, keys + w, 4);
+    rounds16_avx512(s, out);
+}
+#undef PRG_DOUBLE_ROUND
+#undef PRG_QR
+#endif
+
+enum class SimdLevel { scalar, avx2, avx512 };
+
+inline SimdLevel detect_simd() {
+#ifdef PRG_HAVE_X86
+    static const SimdLevel level = [] {
+        if (__builtin_cpu_supports("avx512f")) return SimdLevel::avx512;
+        if (__builtin_cpu_supports("avx2")) return SimdLevel::avx2;
+        return SimdLevel::scalar;
+    }();
+    return level;
+#else
+    return SimdLevel::scalar;
+#endif
+}
+
+// Write nblocks keystream blocks to out and advance the counter in state[12..13].
+inline void generate_blocks(uint32_t state[16], size_t nblocks, uint32_t* out) {
+    SimdLevel level = detect_simd();
+    while (nblocks > 0) {
+        // the SIMD kernels add the lane index to the low counter word only
+        size_t until_wrap = static_cast<size_t>(0x100000000ULL - state[12]);
+#ifdef PRG_HAVE_X86
+        if (level == SimdLevel::avx512 && nblocks >= 16 && until_wrap >= 16) {
+            blocks16_avx512(state, out);
+            state[12] += 16; out += 16 * 16; nblocks -= 16;
+            if (state[12] == 0) ++state[13]; // (a batch may end exactly on the wrap)
+            continue;
+        }
+        if (level != SimdLevel::scalar && nblocks >= 8 && until_wrap >= 8) {
+            blocks8_avx2(state, out);
+            state[12] += 8; out += 8 * 16; nblocks -= 8;
+            if (state[12] == 0) ++state[13]; // (a batch may end exactly on the wrap)
+            continue;
+        }
+#endif
+        block_scalar(state, out);
+        if (++state[12] == 0) ++state[13];
+        out += 16; nblocks -= 1;
+    }
+}
+
+// One keystream block for each of `count` 128-bit keys (4 words per key, back to back): the key fills
+// state words 4..7, words 8..11 and the counter are zero and `domain` is the stream id, so one input
+// key gives independent outputs per domain. This is the length-expanding PRG of the DPF tree in
+// dpf.hpp, where every node has its own key; the SIMD paths hash 8 or 16 keys at once.
+inline void keyed_blocks(const uint32_t* keys, size_t count, uint32_t domain, uint32_t* out) {
+    uint32_t base[16] = {0x61707865, 0x3320646e, 0x79622d32, 0x6b206574, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, domain, 0};
+    SimdLevel level = detect_simd();
+    while (count > 0) {
+#ifdef PRG_HAVE_X86
+        if (level == SimdLevel::avx512 && count >= 16) {
+            keyed16_avx512(base, keys, out);
+            keys += 4 * 16; out += 16 * 16; count -= 16;
+            continue;
+        }
+        if (level != SimdLevel::scalar && count >= 8) {
+            keyed8_avx2(base, keys, out);
+            keys += 4 * 8; out += 8 * 16; count -= 8;
+            continue;
+        }
+#endif
+        std::memcpy(base + 4, keys, 4 * sizeof(uint32_t));
+        block_scalar(base, out);
+        keys += 4; out += 16; count -= 1;
+    }
+}
+
+} // namespace prg_detail
+
+// ---------------------- Prg ----------------------
+
+class Prg {
+    public:
+        explicit Prg(const PrgSeed& key, uint64_t stream = 0) {
+            // "expand 32-byte k" constants, key, 64-bit block counter, 64-bit stream id
+            state_[0] = 0x61707865; state_[1] = 0x3320646e; state_[2] = 0x79622d32; state_[3] = 0x6b206574;
+            for (int i = 0; i < 8; ++i) state_[4 + i] = key[i];
+            state_[12] = 0; state_[13] = 0;
+            state_[14] = static_cast<uint32_t>(stream);
+            state_[15] = static_cast<uint32_t>(stream >> 32);
+        }
+
+        // Next 32 uniformly random bits
+        uint32_t next_u32() {
+            if (pos_ == 16) refill();
+            return block_[pos_++];
+        }
+
+        // Fill a run of words with uniformly random bits. Whole blocks are written straight
+        // into the destination by the SIMD kernels; only the ragged ends go through the buffer.
+        void fill(std::span<uint32_t> out) {
+            size_t i = 0;
+            while (i < out.size() && pos_ < 16) out[i++] = block_[pos_++];
+            size_t whole = (out.size() - i) / 16;
+            if (whole > 0) {
+                prg_detail::generate_blocks(state_.data(), whole, out.data() + i);
+                i += whole * 16;
+            }
+            while (i < out.size()) out[i++] = next_u32();
+        }
+        void fill(std::span<int32_t> out) {
+            fill(std::span<uint32_t>(reinterpret_cast<uint32_t*>(out.data()), out.size()));
+        }
+
+        // Uniform int in [lo, hi] (multiply-shift range reduction)
+        int32_t uniform(int32_t lo, int32_t hi) {
+            return reduce(next_u32(), lo, static_cast<uint64_t>(static_cast<int64_t>(hi) - lo) + 1);
+        }
+
+        // Fill a run of ints with uniform values in [lo, hi]: bulk random bits, then an in-place
+        // range reduction that the compiler vectorizes.
+        void fill_range(std::span<int32_t> out, int32_t lo, int32_t hi) {
+            fill(out);
+            uint64_t range = static_cast<uint64_t>(static_cast<int64_t>(hi) - lo) + 1;
+            if (range == (1ULL << 32)) return;
+            for (auto &x : out) x = reduce(static_cast<uint32_t>(x), lo, range);
+        }
+
+        // The same for ring elements (ring.hpp): the same 32-bit draws, sign-extended to the ring width,
+        // so 32-bit rings see exactly the stream above.
+        template <RingWord R>
+        void fill_range(std::span<R> out, int32_t lo, int32_t hi) {
+            if constexpr (sizeof(R) == sizeof(int32_t)) {
+                fill_range(std::span<int32_t>(reinterpret_cast<int32_t*>(out.data()), out.size()), lo, hi);
+            } else {
+                int32_t buf[256];
+                for (size_t i = 0; i < out.size(); i += 256) {
+                    size_t len = std::min<size_t>(256, out.size() - i);
+                    fill_range(std::span<int32_t>(buf, len), lo, hi);
+                    for (size_t t = 0; t < len; ++t) out[i + t] = static_cast<R>(static_cast<int64_t>(buf[t]));
+                }
+            }
+        }
+
+        // Fill a run of ring elements uniformly over the whole ring: ring_words<R> fresh words per element
+        // (masks and share splits, which must hide a value anywhere in Z_2^w).
+        template <RingWord R>
+        void fill_ring(std::span<R> out) {
+            if constexpr (sizeof(R) == sizeof(uint32_t)) {
+                fill(std::span<uint32_t>(reinterpret_cast<uint32_t*>(out.data()), out.size()));
+            } else {
+                uint32_t buf[256 * ring_words<R>];
+                for (size_t i = 0; i < out.size(); i += 256) {
+                    size_t len = std::min<size_t>(256, out.size() - i);
+                    fill(std::span<uint32_t>(buf, len * ring_words<R>));
+                    for (size_t t = 0; t < len; ++t) out[i + t] = ring_from_words<R>(buf + t * ring_words<R>);
+                }
+            }
+        }
+
+    private:
+        static int32_t reduce(uint32_t bits, int32_t lo, uint64_t range) {
+            return static_cast<int32_t>(lo + static_cast<int64_t>((bits * range) >> 32));
+        }
+
+        // Produce the next 64-byte keystream block and advance the block counter
+        void refill() {
+            prg_detail::block_scalar(state_.data(), block_.data());
+            if (++state_[12] == 0) ++state_[13];
+            pos_ = 0;
+        }
+
+        std::array<uint32_t, 16> state_;
+        std::array<uint32_t, 16> block_{};
+        size_t pos_ = 16;
+};
+
+// ---------------------- Process-wide randomness ----------------------
+//
+// By default every thread gets its own generator keyed from std::random_device.
+// With set_rng_seed() (the --rng-seed flag) all streams are derived from one master key instead,
+// so runs are reproducible for benchmarking. The domain keeps the parties' streams apart.
+
+namespace prg_detail {
+struct RngConfig {
+    std::optional<PrgSeed> master;
+    std::atomic<uint64_t> next_stream{0};
+};
+inline RngConfig& rng_config() {
+    static RngConfig cfg;
+    return cfg;
+}
+inline uint64_t splitmix64(uint64_t &x) {
+    uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+inline Prg make_thread_prg() {
+    auto &cfg = rng_config();
+    if (cfg.master) return Prg(*cfg.master, cfg.next_stream.fetch_add(1));
+    std::random_device rd;
+    PrgSeed key;
+    for (auto &w : key) w = rd();
+    return Prg(key);
+}
+} // namespace prg_detail
+
+// Switch to deterministic mode (call before any randomness is drawn).
+inline void set_rng_seed(uint64_t seed, uint64_t domain) {
+    uint64_t x = seed ^ (domain * 0xd1b54a32d192ed03ULL);
+    PrgSeed key;
+    for (int i = 0; i < 8; i += 2) {
+        uint64_t w = prg_detail::splitmix64(x);
+        key[i] = static_cast<uint32_t>(w);
+        key[i + 1] = static_cast<uint32_t>(w >> 32);
+    }
+    prg_detail::rng_config().master = key;
+}
+
+inline bool rng_is_deterministic() { return prg_detail::rng_config().master.has_value(); }
+
+// The calling thread's generator (independent stream per thread)
+inline Prg& thread_rng() {
+    thread_local Prg prg = prg_detail::make_thread_prg();
+    return prg;
+}
+
+// In deterministic mode, restart the calling thread's generator on a fixed stream, so that work
+// units (e.g. P2's per-query generation) get the same randomness whichever thread runs them.
+// Streams with the top bit set never collide with the per-thread ones. No-op otherwise.
+inline void reseed_thread_rng(uint64_t stream) {
+    auto &cfg = prg_detail::rng_config();
+    if (cfg.master) thread_rng() = Prg(*cfg.master, stream | (1ULL << 63));
+}
+
+// Fresh key for a new Prg, drawn from the calling thread's stream
+inline PrgSeed random_seed() {
+    PrgSeed s;
+    thread_rng().fill(std::span<uint32_t>(s.data(), s.size()));
+    return s;
+}
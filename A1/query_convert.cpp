@@ -0,0 +1,33 @@
+// Converter between the two query file formats (query_file.hpp): a text file (f1.txt) becomes a binary
+// one (f1.qry) and a binary file becomes text; the input format is read from the file itself. A text
+// input carries no ring width, so the binary header gets this build's (or --ring-bits W).
+// Usage: ./query_convert IN OUT [--ring-bits W]
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <string>
+#include "query_file.hpp"
+
+int main(int argc, char *argv[]) {
+    if (argc != 3 && !(argc == 5 && std::string(argv[3]) == "--ring-bits")) {
+        std::cerr << "Usage: " << argv[0] << " IN OUT [--ring-bits W]\n";
+        return 1;
+    }
+    try {
+        QueryReader in(argv[1]);
+        size_t ring_bytes = in.binary() ? in.ring_bytes() : sizeof(Ring);
+        if (argc == 5) {
+            int bits = std::stoi(argv[4]);
+            if (bits != 32 && bits != 64 && bits != 128) throw std::invalid_argument("--ring-bits must be 32, 64 or 128");
+            ring_bytes = static_cast<size_t>(bits / 8);
+        }
+        QueryWriter out(argv[2], !in.binary(), in.m(), in.n(), in.k(), in.queries(), ring_bytes);
+        for (int q = 0; q < in.queries(); q++) out.append(in.next());
+        out.finish();
+        std::cout << "Wrote " << in.queries() << " queries to " << argv[2] << (in.binary() ? " (text)\n" : " (binary)\n");
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
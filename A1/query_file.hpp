@@ -0,0 +1,249 @@
+#pragma once
+// Query files. The text format (f1.txt / f2.txt) is "m n k Q" and then one "i j_share" line per query.
+// For large Q there is a binary format (gen_queries --binary, f1.qry / f2.qry): a 64-byte header
+//   8-byte magic "CS670QRY", uint32 version, uint32 ring element bytes, uint32 m, n, k, Q,
+//   uint32 bytes per record, then padding to 64 bytes
+// followed by Q fixed-size records {uint32 user, int32 item index share}. The ring width only records
+// which build the file was made for: the records are index shares, which are 32-bit under every width.
+//
+// QueryReader reads either format, picked by the magic. A binary file is mapped and read in place;
+// the reader asks the kernel to read ahead (madvise) a window of records beyond the protocol's position,
+// so the page faults are taken off the query loop. query_convert turns one format into the other.
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include "ring.hpp"
+
+struct QueryFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t ring_bytes;
+    uint32_t m, n, k, queries;
+    uint32_t record_bytes;
+    uint8_t pad[28];
+};
+static_assert(sizeof(QueryFileHeader) == 64);
+
+struct QueryRecord {
+    uint32_t user;
+    int32_t item_share;
+};
+static_assert(sizeof(QueryRecord) == 8);
+
+constexpr char query_file_magic[8] = {'C', 'S', '6', '7', '0', 'Q', 'R', 'Y'};
+constexpr uint32_t query_file_version = 1;
+
+// the query file of party `role`: f1.txt / f2.txt, or f1.qry / f2.qry with --binary-queries
+inline std::string query_file_path(int role, bool binary) {
+    return "f" + std::to_string(role + 1) + (binary ? ".qry" : ".txt");
+}
+
+class QueryReader {
+    public:
+        // text from a stream (the benchmark's in-memory query files)
+        explicit QueryReader(std::istream &text) : text_(&text) { read_text_header(); }
+
+        // a query file of either format
+        explicit QueryReader(const std::string &path) : path_(path) {
+            char magic[sizeof(query_file_magic)] = {};
+            {
+                std::ifstream probe(path, std::ios::binary);
+                if (!probe) throw std::runtime_error("cannot open query file " + path);
+                probe.read(magic, sizeof(magic));
+            }
+            if (std::memcmp(magic, query_file_magic, sizeof(magic)) != 0) {
+                owned_ = std::make_unique<std::ifstream>(path);
+                text_ = owned_.get();
+                read_text_header();
+                return;
+            }
+            map_binary();
+        }
+
+        ~QueryReader() {
+            if (base_ != MAP_FAILED) munmap(base_, bytes_);
+            if (fd_ >= 0) ::close(fd_);
+        }
+
+        QueryReader(const QueryReader&) = delete;
+        QueryReader& operator=(const QueryReader&) = delete;
+
+        int m() const { return m_; }
+        int n() const { return n_; }
+        int k() const { return k_; }
+        int queries() const { return q_; }
+        bool binary() const { return text_ == nullptr; }
+        size_t ring_bytes() const { return ring_bytes_; } // 0 for text, which does not say
+
+        // the next query, in file order; its user is checked against m
+        QueryRecord next() {
+            if (next_ >= q_) throw std::runtime_error("query file " + path_ + ": read past the last query");
+            QueryRecord r{};
+            if (text_) {
+                if (!(*text_ >> r.user >> r.item_share)) throw std::runtime_error("query file " + path_ + ": malformed query " + std::to_string(next_));
+            } else {
+                if (next_ >= prefetched_) prefetch();
+                std::memcpy(&r, records_ + static_cast<size_t>(next_) * sizeof(QueryRecord), sizeof(r));
+            }
+            // the user indexes the parties' share files, so it must be a row of U
+            if (m_ <= 0 || r.user >= static_cast<uint32_t>(m_)) {
+                throw std::runtime_error("query file " + path_ + ": query " + std::to_string(next_) + " is on user " + std::to_string(r.user) +
+                                         ", out of range for m = " + std::to_string(m_));
+            }
+            next_++;
+            return r;
+        }
+
+    private:
+        static constexpr int prefetch_records = 1 << 17; // 1 MiB of records ahead of the reader
+
+        void read_text_header() {
+            if (!(*text_ >> m_ >> n_ >> k_ >> q_)) throw std::runtime_error("malformed query file header");
+        }
+
+        void map_binary() {
+            fd_ = ::open(path_.c_str(), O_RDONLY);
+            if (fd_ < 0) throw std::runtime_error("cannot open query file " + path_ + ": " + std::strerror(errno));
+            struct stat st{};
+            fstat(fd_, &st);
+            bytes_ = static_cast<size_t>(st.st_size);
+            if (bytes_ < sizeof(QueryFileHeader)) throw std::runtime_error("query file " + path_ + " is truncated");
+            base_ = mmap(nullptr, bytes_, PROT_READ, MAP_SHARED, fd_, 0);
+            if (base_ == MAP_FAILED) throw std::runtime_error("cannot map query file " + path_ + ": " + std::strerror(errno));
+            madvise(base_, bytes_, MADV_SEQUENTIAL);
+            QueryFileHeader h;
+            std::memcpy(&h, base_, sizeof(h));
+            if (h.version != query_file_version || h.record_bytes != sizeof(QueryRecord)) {
+                throw std::runtime_error(path_ + " is not a query file of this version");
+            }
+            if (bytes_ != sizeof(QueryFileHeader) + static_cast<size_t>(h.queries) * sizeof(QueryRecord) || h.queries > INT32_MAX) {
+                throw std::runtime_error("query file " + path_ + " is truncated");
+            }
+            m_ = static_cast<int>(h.m); n_ = static_cast<int>(h.n); k_ = static_cast<int>(h.k);
+            q_ = static_cast<int>(h.queries);
+            ring_bytes_ = h.ring_bytes;
+            records_ = static_cast<const char*>(base_) + sizeof(QueryFileHeader);
+        }
+
+        // Ask for the next two windows of records; the reader comes back here one window later, so the
+        // kernel always has at least a window in flight ahead of the protocol.
+        void prefetch() {
+            int end = static_cast<int>(std::min<int64_t>(q_, int64_t(next_) + 2 * prefetch_records));
+            uintptr_t page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+            uintptr_t lo = reinterpret_cast<uintptr_t>(records_ + static_cast<size_t>(next_) * sizeof(QueryRecord)) & ~(page - 1);
+            uintptr_t hi = reinterpret_cast<uintptr_t>(records_ + static_cast<size_t>(end) * sizeof(QueryRecord));
+            madvise(reinterpret_cast<void*>(lo), hi - lo, MADV_WILLNEED);
+            prefetched_ = next_ + prefetch_records;
+        }
+
+        std::string path_ = "(stream)";
+        std::istream *text_ = nullptr;
+        std::unique_ptr<std::ifstream> owned_;
+        int fd_ = -1;
+        void *base_ = MAP_FAILED;
+        size_t bytes_ = 0;
+        const char *records_ = nullptr;
+        int m_ = 0, n_ = 0, k_ = 0, q_ = 0;
+        size_t ring_bytes_ = 0;
+        int next_ = 0, prefetched_ = 0;
+};
+
+// Writes a query file in either format; finish() checks that all Q queries were written.
+class QueryWriter {
+    public:
+        QueryWriter(const std::string &path, bool binary, int m, int n, int k, int Q, size_t ring_bytes = sizeof(Ring))
+            : path_(path), binary_(binary), q_(Q) {
+            file_ = std::fopen(path.c_str(), binary ? "wb" : "w");
+            if (!file_) throw std::runtime_error("cannot create query file " + path + ": " + std::strerror(errno));
+            if (binary) {
+                QueryFileHeader h{};
+                std::memcpy(h.magic, query_file_magic, sizeof(h.magic));
+                h.version = query_file_version;
+                h.ring_bytes = static_cast<uint32_t>(ring_bytes);
+                h.m = m; h.n = n; h.k = k; h.queries = Q;
+                h.record_bytes = sizeof(QueryRecord);
+                write(&h, sizeof(h));
+            } else {
+                std::string head = std::to_string(m) + " " + std::to_string(n) + " " + std::to_string(k) + " " + std::to_string(Q) + "\n";
+                write(head.data(), head.size());
+            }
+        }
+
+        ~QueryWriter() {
+            if (file_) std::fclose(file_);
+        }
+
+        QueryWriter(const QueryWriter&) = delete;
+        QueryWriter& operator=(const QueryWriter&) = delete;
+
+        void append(QueryRecord r) {
+            if (binary_) {
+                write(&r, sizeof(r));
+            } else {
+                char line[32];
+                write(line, text_line(r, line));
+            }
+            written_++;
+        }
+
+        // Append count records that encode() already turned into bytes, e.g. on another thread
+        void append_encoded(std::string_view bytes, size_t count) {
+            write(bytes.data(), bytes.size());
+            written_ += static_cast<int>(count);
+        }
+
+        // The bytes append() writes for these records, added to out
+        static void encode(std::span<const QueryRecord> records, bool binary, std::string &out) {
+            if (binary) {
+                out.append(reinterpret_cast<const char*>(records.data()), records.size_bytes());
+                return;
+            }
+            size_t at = out.size();
+            out.resize(at + records.size() * 24);
+            for (const QueryRecord &r : records) at += text_line(r, out.data() + at);
+            out.resize(at);
+        }
+
+        void finish() {
+            if (written_ != q_) throw std::runtime_error("query file " + path_ + " is incomplete");
+            if (std::fclose(file_) != 0) {
+                file_ = nullptr;
+                throw std::runtime_error("cannot write query file " + path_ + ": " + std::strerror(errno));
+            }
+            file_ = nullptr;
+        }
+
+    private:
+        // "i j_share\n" into line (at most 10 + 1 + 11 + 1 characters); returns its length
+        static size_t text_line(QueryRecord r, char *line) {
+            char *p = std::to_chars(line, line + 10, r.user).ptr;
+            *p++ = ' ';
+            p = std::to_chars(p, p + 11, r.item_share).ptr;
+            *p++ = '\n';
+            return static_cast<size_t>(p - line);
+        }
+
+        void write(const void *p, size_t bytes) {
+            if (std::fwrite(p, 1, bytes, file_) != bytes) throw std::runtime_error("cannot write query file " + path_ + ": " + std::strerror(errno));
+        }
+
+        std::string path_;
+        bool binary_;
+        int q_, written_ = 0;
+        std::FILE *file_ = nullptr;
+};
@@ -0,0 +1,69 @@
+#pragma once
+// The ring the shares live in: Z_2^w for w = 32, 64 or 128, picked per build with -DMPC_RING_BITS=w
+// (default 32). A ring element is an unsigned word, so every sum and product wraps mod 2^w with
+// well-defined behavior. The share arithmetic (common.hpp, kernels.hpp), the Share class, the
+// Du-Atallah routines and P2's generator are templates on the word type R; the binaries instantiate
+// them with Ring. On the wire and in the share and trace files an element takes sizeof(R) bytes.
+//
+// Index shares (alpha, the item index j, the rotation shift) are not ring elements: they stay int32
+// and are reduced mod n.
+
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+using u128 = unsigned __int128;
+
+template <typename R>
+concept RingWord = std::same_as<R, uint32_t> || std::same_as<R, uint64_t> || std::same_as<R, u128>;
+
+template <int Bits> struct ring_for_bits;
+template <> struct ring_for_bits<32> { using type = uint32_t; };
+template <> struct ring_for_bits<64> { using type = uint64_t; };
+template <> struct ring_for_bits<128> { using type = u128; };
+
+#ifndef MPC_RING_BITS
+#define MPC_RING_BITS 32
+#endif
+
+using Ring = typename ring_for_bits<MPC_RING_BITS>::type;
+constexpr int ring_bits = MPC_RING_BITS;
+
+// 32-bit words per ring element (PRG output and DPF leaves are produced in 32-bit words)
+template <RingWord R>
+constexpr size_t ring_words = sizeof(R) / sizeof(uint32_t);
+
+// element from ring_words<R> consecutive 32-bit words, least significant first
+template <RingWord R>
+inline R ring_from_words(const uint32_t *w) {
+    R v = 0;
+    for (size_t i = ring_words<R>; i-- > 0;) v = (v << 16 << 16) | w[i];
+    return v;
+}
+
+// The element as a signed decimal (two's complement of width w), as the text logs print it.
+template <RingWord R>
+inline std::string ring_to_string(R v) {
+    if constexpr (sizeof(R) == 4) return std::to_string(static_cast<int32_t>(v));
+    else if constexpr (sizeof(R) == 8) return std::to_string(static_cast<int64_t>(v));
+    else {
+        bool negative = (v >> 127) != 0;
+        if (negative) v = 0 - v;
+        std::string digits;
+        do {
+            digits.insert(digits.begin(), static_cast<char>('0' + static_cast<int>(v % 10)));
+            v /= 10;
+        } while (v != 0);
+        return negative ? "-" + digits : digits;
+    }
+}
+
+// The same, for a raw little-endian element of `bytes` bytes (4, 8 or 16), e.g. read back from a file.
+inline std::string ring_to_string(const void *p, size_t bytes) {
+    uint32_t w[4] = {};
+    std::memcpy(w, p, bytes);
+    if (bytes == 4) return ring_to_string(ring_from_words<uint32_t>(w));
+    if (bytes == 8) return ring_to_string(ring_from_words<uint64_t>(w));
+    return ring_to_string(ring_from_words<u128>(w));
+}
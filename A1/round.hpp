@@ -0,0 +1,83 @@
+#pragma once
+// Round coalescing: the messages of one protocol round are queued on a Round and go to the peer as a
+// single framed write, while the peer's matching frame is read in the same exchange. Each message is
+// paired with the buffer that receives the peer's counterpart. Both parties queue mirrored messages,
+// and the frame does not describe its parts, so they have to queue them in the same order with the
+// same sizes.
+//
+// Frame: uint64 payload bytes, then the queued messages back to back as raw bytes. Nothing is copied:
+// the Round keeps spans of the parts, the frame goes out as one gather write of the header and the
+// parts, and the peer's frame is read header first, checked, then scattered straight into the
+// destinations. So a layout mismatch between the parties fails loudly rather than misreading shares,
+// and every part (and destination) has to stay valid until flush().
+//
+// A round costs one round trip however many messages it carries, which is what counts on a
+// high-latency link; see party.hpp for how the per-query flow is grouped into rounds.
+
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "common.hpp"
+
+class Round {
+    public:
+        // queue `out` for the peer; the peer's counterpart (same size) lands in `in` at flush()
+        template <typename T>
+        void add(std::span<const T> out, std::span<T> in) {
+            if (out.size() != in.size()) throw std::invalid_argument("Round: message and destination sizes differ");
+            send(out);
+            receive(in);
+        }
+        template <typename T>
+        void add(const std::vector<T>& out, std::vector<T>& in) { add(std::span<const T>(out), std::span<T>(in)); }
+        template <typename T>
+        void add(const Matrix<T>& out, Matrix<T>& in) { add(out.flat(), in.flat()); }
+
+        // One-directional parts, for a step where the parties say different amounts (one party's
+        // send() is the other's receive(), in the same position): the frames then differ in length,
+        // and each party checks the peer's frame against the bytes it expects to receive.
+        template <typename T>
+        void send(std::span<const T> out) {
+            out_parts_.emplace_back(out.data(), out.size_bytes());
+            out_bytes_ += out.size_bytes();
+        }
+        template <typename T>
+        void receive(std::span<T> in) {
+            in_parts_.emplace_back(in.data(), in.size_bytes());
+            in_bytes_ += in.size_bytes();
+        }
+
+        size_t messages() const { return in_parts_.size(); }
+        size_t payload_bytes() const { return out_bytes_; }
+
+        // One exchange with the peer (nothing at all for an empty round), then the Round is empty again.
+        template <typename Stream>
+        awaitable<void> flush(Stream& sock) {
+            if (in_parts_.empty() && out_parts_.empty()) co_return;
+            header_ = out_bytes_;
+            out_parts_.insert(out_parts_.begin(), boost::asio::buffer(&header_, sizeof(header_)));
+            co_await exchange(sock, out_parts_, read_frame(sock));
+            out_parts_.clear();
+            in_parts_.clear();
+            out_bytes_ = in_bytes_ = 0;
+            co_return;
+        }
+
+    private:
+        template <typename Stream>
+        awaitable<void> read_frame(Stream& sock) {
+            co_await boost::asio::async_read(sock, boost::asio::buffer(&peer_header_, sizeof(peer_header_)), use_awaitable);
+            if (peer_header_ != in_bytes_) {
+                throw std::runtime_error("Round: peer sent a frame of " + std::to_string(peer_header_) + " bytes, expected " + std::to_string(in_bytes_));
+            }
+            if (in_bytes_ > 0) co_await boost::asio::async_read(sock, in_parts_, use_awaitable);
+            co_return;
+        }
+
+        std::vector<boost::asio::const_buffer> out_parts_;
+        std::vector<boost::asio::mutable_buffer> in_parts_;
+        uint64_t out_bytes_ = 0, in_bytes_ = 0;
+        uint64_t header_ = 0, peer_header_ = 0;
+};
@@ -0,0 +1,62 @@
+// Round budget of the online phase: runs the three parties in one process (inprocess.hpp) and checks
+// P0's rounds on the peer link against fixed per-query counts, so a change that adds a round (or a
+// change to the round accounting that would hide one from bench_protocol's check) fails here.
+// The queries are on distinct users, so every batch is one wave (party.hpp):
+//   plain, --dpf       4 rounds per batch (rounds 1-4)
+//   --update-items     the same, plus one round for the last batch's item writes
+//   --local-preproc    plus 2 rounds per batch for the OTs, and 2 for the base OTs before the first query
+//
+// Usage: ./rounds_test [--transport shm|unix|tcp]
+// Prints one line per case and exits with 1 if any of them is off.
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "inprocess.hpp"
+
+struct RoundCase {
+    std::string name;
+    int batch;
+    bool dpf, update_items, local_preproc;
+    uint64_t rounds; // expected for q queries
+};
+
+int main(int argc, char *argv[]) {
+    std::string transport = argc == 3 && std::string(argv[1]) == "--transport" ? argv[2] : "shm";
+    constexpr int q = 12;
+    const BenchConfig base{16, 32, 4, q, 1};
+    const std::vector<RoundCase> cases = {
+        {"batch 1", 1, false, false, false, 4 * q},
+        {"batch 4", 4, false, false, false, 4 * (q / 4)},
+        {"dpf batch 1", 1, true, false, false, 4 * q},
+        {"dpf batch 4", 4, true, false, false, 4 * (q / 4)},
+        {"update-items batch 1", 1, false, true, false, 4 * q + 1},
+        {"update-items batch 4", 4, false, true, false, 4 * (q / 4) + 1},
+        {"local-preproc batch 1", 1, false, false, true, 2 + 6 * q},
+        {"local-preproc batch 4", 4, false, false, true, 2 + 6 * (q / 4)},
+    };
+
+    int failed = 0;
+    for (const auto &rc : cases) {
+        Options opt;
+        opt.dpf = rc.dpf;
+        opt.update_items = rc.update_items;
+        opt.local_preproc = rc.local_preproc;
+        BenchConfig c = base;
+        c.batch = rc.batch;
+        std::stringstream f1, f2;
+        make_queries(c, f1, f2, true);
+        try {
+            RunResult r = run_in_process(transport, c, opt, f1, f2);
+            bool ok = r.rounds == rc.rounds && r.planned_rounds == rc.rounds;
+            std::cout << (ok ? "ok   " : "FAIL ") << rc.name << ": rounds_per_query " << double(r.rounds) / q
+                      << " (expected " << double(rc.rounds) / q << ", planned " << double(r.planned_rounds) / q << ")\n";
+            failed += !ok;
+        } catch (const std::exception &e) {
+            std::cout << "FAIL " << rc.name << ": " << e.what() << "\n";
+            failed++;
+        }
+    }
+    std::cout << (failed ? std::to_string(failed) + " of " + std::to_string(cases.size()) + " cases failed" : "all cases passed") << "\n";
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,117 @@
+#pragma once
+// Memory-mapped binary store for a party's long-lived shares (U, V and the blinding matrix r).
+//
+// File layout: a 64-byte header followed by u (m x k), v (n x k) and r (n x k) as row-major ring
+// elements of R (ring.hpp); the header records the element width, so a file from a build with another
+// ring width counts as mismatched.
+// Opening an existing file with matching dimensions maps it as is, so shares survive restarts and
+// updates to U written through the mapping are persisted. A missing file (or one with different
+// dimensions, or reset = true) is created and filled with fresh random shares; its header is written
+// only once the fill is on disk, so an interrupted fill is redone on the next start.
+// An empty path gives the same layout in anonymous memory, for runs that should not touch disk.
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include "common.hpp"
+
+template <RingWord R>
+class ShareStore {
+    public:
+        static constexpr char magic[8] = {'C', 'S', '6', '7', '0', 'S', 'H', 'R'};
+        static constexpr uint32_t version = 2;
+
+        struct Header {
+            char magic[8];
+            uint32_t version;
+            uint32_t m, n, k;
+            uint32_t ring_bytes; // sizeof(R)
+            uint8_t pad[36];     // keeps the matrices 64-byte aligned
+        };
+        static_assert(sizeof(Header) == 64);
+
+        ShareStore(const std::string& path, int m, int n, int k, bool reset = false) : m_(m), n_(n), k_(k) {
+            bytes_ = sizeof(Header) + (static_cast<size_t>(m) + 2 * static_cast<size_t>(n)) * k * sizeof(R);
+            bool fresh = true;
+            if (path.empty()) {
+                base_ = mmap(nullptr, bytes_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            } else {
+                fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+                if (fd_ < 0) throw std::runtime_error("ShareStore: cannot open " + path + ": " + std::strerror(errno));
+                struct stat st{};
+                fstat(fd_, &st);
+                if (!reset && static_cast<size_t>(st.st_size) == bytes_) {
+                    Header h{};
+                    if (pread(fd_, &h, sizeof(h), 0) == static_cast<ssize_t>(sizeof(h))) fresh = !matches(h);
+                }
+                if (fresh && ftruncate(fd_, static_cast<off_t>(bytes_)) != 0) {
+                    throw std::runtime_error("ShareStore: cannot size " + path + ": " + std::strerror(errno));
+                }
+                base_ = mmap(nullptr, bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+            }
+            if (base_ == MAP_FAILED) throw std::runtime_error(std::string("ShareStore: mmap failed: ") + std::strerror(errno));
+            created_ = fresh;
+            if (fresh) initialize();
+        }
+
+        ~ShareStore() {
+            if (base_ != MAP_FAILED) {
+                if (fd_ >= 0) msync(base_, bytes_, MS_SYNC);
+                munmap(base_, bytes_);
+            }
+            if (fd_ >= 0) ::close(fd_);
+        }
+
+        ShareStore(const ShareStore&) = delete;
+        ShareStore& operator=(const ShareStore&) = delete;
+
+        bool created() const { return created_; } // false when existing shares were mapped
+
+        MatrixView<R> u() { return {matrices(), static_cast<size_t>(m_), static_cast<size_t>(k_)}; }
+        MatrixView<R> v() { return {matrices() + static_cast<size_t>(m_) * k_, static_cast<size_t>(n_), static_cast<size_t>(k_)}; }
+        MatrixView<R> r() { return {matrices() + (static_cast<size_t>(m_) + n_) * k_, static_cast<size_t>(n_), static_cast<size_t>(k_)}; }
+
+        // push dirty pages of the mapping to the file
+        void sync() {
+            if (fd_ >= 0) msync(base_, bytes_, MS_SYNC);
+        }
+
+    private:
+        R* matrices() { return reinterpret_cast<R*>(static_cast<char*>(base_) + sizeof(Header)); }
+
+        bool matches(const Header& h) const {
+            return std::memcmp(h.magic, magic, sizeof(magic)) == 0 && h.version == version &&
+                   h.m == static_cast<uint32_t>(m_) && h.n == static_cast<uint32_t>(n_) && h.k == static_cast<uint32_t>(k_) &&
+                   h.ring_bytes == sizeof(R);
+        }
+
+        // The header goes in last: a run killed during the fill leaves a file that matches() rejects, so
+        // the next start fills it again instead of mapping partial shares. (A reset file may still carry a
+        // valid header, so that is cleared first.)
+        void initialize() {
+            std::memset(base_, 0, sizeof(Header));
+            sync();
+            fill_random(u().flat()); // small test values
+            fill_random(v().flat());
+            random_ring(r().flat()); // blinds
+            sync();
+            Header h{};
+            std::memcpy(h.magic, magic, sizeof(magic));
+            h.version = version;
+            h.m = m_; h.n = n_; h.k = k_;
+            h.ring_bytes = sizeof(R);
+            std::memcpy(base_, &h, sizeof(h));
+            sync();
+        }
+
+        int m_, n_, k_;
+        size_t bytes_ = 0;
+        int fd_ = -1;
+        void* base_ = MAP_FAILED;
+        bool created_ = true;
+};
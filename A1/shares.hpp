@@ -1,34 +1,108 @@
+#pragma once
 // Define a structure for shares in shares.h for easy initialization and randomization.
 
 #include "common.hpp"
+#include "share_store.hpp"
+#include "round.hpp"
+// Shares are elements of the ring R (ring.hpp).
+template <RingWord R>
 class Share {
     public:
         int n, m, k; // number of items, users, features
-        std::vector<std::vector<int>> u, v, r, v_dash, v_masked, x_n, y_n;
-        std::vector<int> x_k, y_k, e_alpha, scaler_x, scaler_y, scaler_gamma, gamma_n;
-        int gamma_k;
-        int alpha;
-
-    Share(int n, int m, int k) : n(n), m(m), k(k) {
-        u.resize(m, std::vector<int>(k));
-        v.resize(n, std::vector<int>(k));
-        r.resize(n, std::vector<int>(k));
-        x_n.resize(n, std::vector<int>(k));
-        y_n.resize(n, std::vector<int>(k));
-        fill_random(u);
-        fill_random(v);
-        fill_random(r);
-        x_k.resize(k);
-        y_k.resize(k);
-        scaler_x.resize(k);
-        scaler_y.resize(k);
-        scaler_gamma.resize(k);
-        gamma_n.resize(k);
-        v_dash.resize(n, std::vector<int>(k));
-        v_masked.resize(n, std::vector<int>(k));
-        for (int i = 0; i < n; i++) {
-            for (int j = 0; j < k; j++) v_dash[i][j] = v[i][j] + r[i][j];
+        ShareStore<R> store; // backing storage of u, v and r (memory-mapped share file)
+        MatrixView<R> u, v, r; // long-lived shares, live for the whole session (u is m x k, v and r are n x k)
+        Matrix<R> v_dash, v_dash_peer, v_masked; // own blinded share v + r, the peer's, and the blinded database V + r0 + r1
+
+    // path: share file to map (created with fresh random shares if missing), "" keeps the shares in memory only
+    Share(int n, int m, int k, const std::string& path = "", bool reset = false)
+        : n(n), m(m), k(k), store(path, m, n, k, reset), u(store.u()), v(store.v()), r(store.r()) {
+        v_dash.resize(n, k);
+        v_dash_peer.resize(n, k);
+        v_masked.resize(n, k);
+        for (size_t i = 0; i < v.size(); i++) v_dash.data()[i] = v.data()[i] + r.data()[i];
+    }
+
+    // Blinded database for an epoch: draw fresh blinds r, exchange the whole v_dash = v + r with the
+    // peer and build v_masked = V + r0 + r1. Every read of the epoch uses this v_masked.
+    // The O(nk) passes run on the pool, row range by row range.
+    template <typename Stream>
+    awaitable<void> rebuild_blinded(Stream& peer_sock, ThreadPool& pool) {
+        Round round;
+        co_await post_rebuild(round, pool);
+        co_await round.flush(peer_sock);
+        co_await complete_rebuild(pool);
+        co_return;
+    }
+
+    // The same in two steps, so that v_dash can share a round with other messages (round.hpp): the new
+    // blinds are in r once post_rebuild returns, v_masked once complete_rebuild (after the flush) does.
+    awaitable<void> post_rebuild(Round& round, ThreadPool& pool) {
+        random_ring(r.flat());
+        co_await offload(pool, [&] {
+            pool.parallel_for(0, n, row_grain(k), [&](size_t lo, size_t hi) {
+                for (size_t i = lo * k; i < hi * k; i++) v_dash.data()[i] = v.data()[i] + r.data()[i];
+            });
+        });
+        round.add(v_dash, v_dash_peer);
+        co_return;
+    }
+    awaitable<void> complete_rebuild(ThreadPool& pool) {
+        co_await offload(pool, [&] {
+            pool.parallel_for(0, n, row_grain(k), [&](size_t lo, size_t hi) {
+                for (size_t i = lo * k; i < hi * k; i++) v_masked.data()[i] = v_dash_peer.data()[i] + r.data()[i] + v.data()[i];
+            });
+        });
+        co_return;
+    }
+
+    // Row-level update of the blinded database: re-draw the blinds of the given rows (which both parties
+    // must agree on) and exchange only those rows of v_dash. This is also how a change to rows of V
+    // is propagated: update v first, then refresh the touched rows.
+    template <typename Stream>
+    awaitable<void> refresh_rows(Stream& peer_sock, const std::vector<int>& rows) {
+        Round round;
+        post_refresh(round, rows);
+        co_await round.flush(peer_sock);
+        complete_refresh();
+        co_return;
+    }
+
+    // Two-step form, as for the rebuild: post_refresh redraws the rows' blinds and queues their v_dash.
+    void post_refresh(Round& round, const std::vector<int>& rows) {
+        refresh_pending = rows;
+        refresh_out.assign(rows.size() * k, 0);
+        refresh_peer.assign(rows.size() * k, 0);
+        for (size_t i = 0; i < rows.size(); i++) {
+            random_ring(r[rows[i]]);
+            for (int c = 0; c < k; c++) v_dash(rows[i], c) = v(rows[i], c) + r(rows[i], c);
+            std::copy(v_dash[rows[i]].begin(), v_dash[rows[i]].end(), refresh_out.begin() + i * k);
+        }
+        round.add(refresh_out, refresh_peer);
+    }
+    void complete_refresh() {
+        for (size_t i = 0; i < refresh_pending.size(); i++) {
+            int row = refresh_pending[i];
+            for (int c = 0; c < k; c++) {
+                v_dash_peer(row, c) = refresh_peer[i * k + c];
+                v_masked(row, c) = refresh_peer[i * k + c] + r(row, c) + v(row, c);
+            }
         }
-        e_alpha.resize(n);
+        refresh_pending.clear();
     }
-};
\ No newline at end of file
+
+    // Next `count` rows of the round-robin blind refresh schedule (the same on both parties).
+    std::vector<int> next_refresh_rows(int count) {
+        std::vector<int> rows;
+        for (int i = 0; i < std::min(count, n); i++) {
+            rows.push_back(refresh_cursor);
+            refresh_cursor = (refresh_cursor + 1) % n;
+        }
+        return rows;
+    }
+
+    private:
+        int refresh_cursor = 0;
+        std::vector<int> refresh_pending; // rows of a posted refresh
+        std::vector<R> refresh_out;       // their v_dash, queued until the flush
+        std::vector<R> refresh_peer;      // the peer's v_dash of those rows
+};
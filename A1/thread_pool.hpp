@@ -0,0 +1,203 @@
+#pragma once
+// Work-stealing thread pool for the parties' local O(nk) computation.
+//
+// Every thread owns a task deque: it pops its own tasks from the back and, when it runs dry, steals
+// from the front of the others'. Queue 0 belongs to the thread that drives the pool (the network
+// thread), which helps with the work while it waits for a parallel_for, so a pool of size 1 has no
+// worker threads at all and runs everything inline, exactly like the code did before the pool.
+//
+// Work is split by row ranges of a fixed grain, so the partition (and therefore the order in which
+// per-chunk partial results are combined) depends only on the problem size, never on the number of
+// threads or on which thread ran what: reductions are deterministic.
+//
+// offload() runs a function on the pool from a coroutine and resumes the coroutine on its own
+// executor afterwards, so other coroutines on the io_context keep making progress meanwhile.
+
+#include <pthread.h>
+#include <sched.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+
+class ThreadPool {
+    public:
+        using Task = std::function<void()>;
+
+        // threads: total threads including the caller; first_cpu >= 0 pins the calling thread to CPU first_cpu
+        // and worker w to CPU first_cpu + w
+        explicit ThreadPool(int threads = 1, int first_cpu = -1) : queues_(std::max(threads, 1)) {
+            for (int w = 1; w < threads; ++w) {
+                workers_.emplace_back([this, w, first_cpu] {
+                    self_index() = w;
+                    if (first_cpu >= 0) pin_to_cpu(first_cpu + w);
+                    worker_loop();
+                });
+            }
+            if (first_cpu >= 0) pin_to_cpu(first_cpu);
+        }
+
+        ~ThreadPool() {
+            {
+                std::lock_guard<std::mutex> lock(sleep_mu_);
+                stop_ = true;
+            }
+            sleep_cv_.notify_all();
+            for (auto &t : workers_) t.join();
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        int size() const { return static_cast<int>(queues_.size()); }
+
+        // Queue a task on the deque of thread `hint % size()`.
+        void submit(Task task, size_t hint = 0) {
+            Queue &q = queues_[hint % queues_.size()];
+            {
+                std::lock_guard<std::mutex> lock(q.mu);
+                q.tasks.push_back(std::move(task));
+            }
+            {
+                std::lock_guard<std::mutex> lock(sleep_mu_);
+                ++pending_;
+            }
+            sleep_cv_.notify_one();
+        }
+
+        // number of chunks [begin, end) is cut into for a given grain (independent of the pool size)
+        static size_t chunk_count(size_t begin, size_t end, size_t grain) {
+            return end <= begin ? 0 : (end - begin + grain - 1) / grain;
+        }
+
+        // Run f(chunk, lo, hi) for every grain-sized chunk of [begin, end) and wait for all of them.
+        // The calling thread works on chunks too.
+        template <typename F>
+        void parallel_for_chunks(size_t begin, size_t end, size_t grain, F&& f) {
+            grain = std::max<size_t>(grain, 1);
+            size_t chunks = chunk_count(begin, end, grain);
+            auto run_chunk = [&](size_t c) { f(c, begin + c * grain, std::min(end, begin + (c + 1) * grain)); };
+            if (queues_.size() == 1 || chunks <= 1) {
+                for (size_t c = 0; c < chunks; ++c) run_chunk(c);
+                return;
+            }
+            std::atomic<size_t> left(chunks);
+            std::exception_ptr error;
+            std::mutex error_mu;
+            for (size_t c = 0; c < chunks; ++c) {
+                submit([&, c] {
+                    try {
+                        run_chunk(c);
+                    } catch (...) {
+                        std::lock_guard<std::mutex> lock(error_mu);
+                        if (!error) error = std::current_exception();
+                    }
+                    left.fetch_sub(1, std::memory_order_release);
+                }, self_index() + c);
+            }
+            help_until([&] { return left.load(std::memory_order_acquire) == 0; });
+            if (error) std::rethrow_exception(error);
+        }
+
+        // Run f(lo, hi) over grain-sized row ranges of [begin, end).
+        template <typename F>
+        void parallel_for(size_t begin, size_t end, size_t grain, F&& f) {
+            parallel_for_chunks(begin, end, grain, [&](size_t, size_t lo, size_t hi) { f(lo, hi); });
+        }
+
+    private:
+        struct Queue {
+            std::mutex mu;
+            std::deque<Task> tasks;
+        };
+
+        static int& self_index() {
+            thread_local int index = 0; // threads outside the pool use queue 0
+            return index;
+        }
+
+        static void pin_to_cpu(int cpu) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu % CPU_SETSIZE, &set);
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set); // best effort
+        }
+
+        // own deque from the back, then steal from the front of the others
+        bool try_pop(Task &out) {
+            size_t self = static_cast<size_t>(self_index()), nq = queues_.size();
+            for (size_t i = 0; i < nq; ++i) {
+                Queue &q = queues_[(self + i) % nq];
+                std::lock_guard<std::mutex> lock(q.mu);
+                if (q.tasks.empty()) continue;
+                if (i == 0) { out = std::move(q.tasks.back()); q.tasks.pop_back(); }
+                else { out = std::move(q.tasks.front()); q.tasks.pop_front(); }
+                std::lock_guard<std::mutex> sleep_lock(sleep_mu_);
+                --pending_;
+                return true;
+            }
+            return false;
+        }
+
+        template <typename Done>
+        void help_until(Done&& done) {
+            while (!done()) {
+                Task task;
+                if (try_pop(task)) task();
+                else std::this_thread::yield();
+            }
+        }
+
+        void worker_loop() {
+            for (;;) {
+                Task task;
+                if (try_pop(task)) {
+                    task();
+                    continue;
+                }
+                std::unique_lock<std::mutex> lock(sleep_mu_);
+                sleep_cv_.wait(lock, [&] { return stop_ || pending_ > 0; });
+                if (stop_) return;
+            }
+        }
+
+        std::vector<Queue> queues_;
+        std::vector<std::thread> workers_;
+        std::mutex sleep_mu_;
+        std::condition_variable sleep_cv_;
+        size_t pending_ = 0; // queued, not yet started tasks (guarded by sleep_mu_)
+        bool stop_ = false;
+};
+
+// Run f() on the pool and resume the calling coroutine on its executor when it is done.
+// With a single-thread pool f() simply runs inline.
+template <typename F>
+boost::asio::awaitable<void> offload(ThreadPool &pool, F f) {
+    if (pool.size() == 1) {
+        f();
+        co_return;
+    }
+    auto ex = co_await boost::asio::this_coro::executor;
+    std::exception_ptr error;
+    co_await boost::asio::async_initiate<const boost::asio::use_awaitable_t<>, void()>(
+        [&pool, &f, &error, ex](auto handler) {
+            auto h = std::make_shared<decltype(handler)>(std::move(handler));
+            pool.submit([&f, &error, ex, h] {
+                try {
+                    f();
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                boost::asio::post(ex, std::move(*h));
+            }, 1);
+        },
+        boost::asio::use_awaitable);
+    if (error) std::rethrow_exception(error);
+}
@@ -0,0 +1,200 @@
+#pragma once
+// Compile-time gated tracing of the parties' shares.
+//
+// The per-query dump used to format every n x k matrix as text and flush after each one, on the
+// network thread. Now the protocol only appends compact binary records (a tag, the name and the raw
+// ring elements) to an in-memory buffer; full buffers are written out by a background thread, and
+// trace_decode.cpp turns the file back into the o1.txt / o2.txt text; checker.cpp reads it directly.
+//
+// MPC_TRACE_LEVEL picks what is compiled in:
+//   0  nothing: every TRACE_* statement expands to ((void)0), its arguments are never evaluated and no
+//      file or thread is created
+//   1  info: the per-query header and the O(k) values (read result, Du-Atallah terms, inner product)
+//   2  debug (default): additionally the O(nk) / O(mk) matrices and the length-n vectors, i.e. the full
+//      dump of the old text log
+//
+// File layout: 8-byte magic "CS670TRC", uint32 version, uint32 ring element bytes (sizeof(R)), then records
+//   uint8 tag, uint8 name length, name bytes, payload
+// with the payload per tag (R = a ring element, ring.hpp)
+//   Query     int32 role, int32 query index (no name)
+//   Scalar    R value
+//   Vector    uint32 length, R[length]
+//   Matrix    uint32 rows, uint32 cols, R[rows * cols]
+//   Broadcast uint32 rows, uint32 cols, R[rows]   (row i is the value i repeated cols times)
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "matrix.hpp"
+#include "ring.hpp"
+
+#ifndef MPC_TRACE_LEVEL
+#define MPC_TRACE_LEVEL 2
+#endif
+
+#if MPC_TRACE_LEVEL >= 1
+#define TRACE_INFO(...) __VA_ARGS__
+#else
+#define TRACE_INFO(...) ((void)0)
+#endif
+
+#if MPC_TRACE_LEVEL >= 2
+#define TRACE_DEBUG(...) __VA_ARGS__
+#else
+#define TRACE_DEBUG(...) ((void)0)
+#endif
+
+constexpr int trace_level = MPC_TRACE_LEVEL;
+constexpr char trace_magic[8] = {'C', 'S', '6', '7', '0', 'T', 'R', 'C'};
+constexpr uint32_t trace_version = 2;
+
+enum class TraceTag : uint8_t { Query = 1, Scalar = 2, Vector = 3, Matrix = 4, Broadcast = 5 };
+
+template <RingWord R>
+class TraceLog {
+    public:
+        // With MPC_TRACE_LEVEL 0 or an empty path the log is inert: no file, no writer thread.
+        explicit TraceLog(const std::string &path) {
+            if (trace_level == 0 || path.empty()) return;
+            file_ = std::fopen(path.c_str(), "wb");
+            if (!file_) throw std::runtime_error("cannot open trace file " + path);
+            put(trace_magic, sizeof(trace_magic));
+            put_u32(trace_version);
+            put_u32(sizeof(R));
+            writer_ = std::thread([this] { writer_loop(); });
+        }
+
+        ~TraceLog() {
+            if (!file_) return;
+            hand_off();
+            {
+                std::lock_guard<std::mutex> lock(mu_);
+                stop_ = true;
+            }
+            cv_.notify_all();
+            writer_.join();
+            std::fclose(file_);
+        }
+
+        TraceLog(const TraceLog&) = delete;
+        TraceLog& operator=(const TraceLog&) = delete;
+
+        void query(int role, int index) {
+            if (!file_) return;
+            put_u8(static_cast<uint8_t>(TraceTag::Query));
+            put_u8(0);
+            put_i32(role);
+            put_i32(index);
+            maybe_hand_off();
+        }
+
+        // index shares (alpha, shift) are logged as ring elements too
+        void scalar(std::string_view name, R value) {
+            if (!file_) return;
+            header(TraceTag::Scalar, name);
+            put(&value, sizeof(value));
+            maybe_hand_off();
+        }
+
+        void vector(std::string_view name, std::span<const R> values) {
+            if (!file_) return;
+            header(TraceTag::Vector, name);
+            put_u32(static_cast<uint32_t>(values.size()));
+            put(values.data(), values.size_bytes());
+            maybe_hand_off();
+        }
+
+        void matrix(std::string_view name, MatrixView<const R> mat) {
+            if (!file_) return;
+            header(TraceTag::Matrix, name);
+            put_u32(static_cast<uint32_t>(mat.rows()));
+            put_u32(static_cast<uint32_t>(mat.cols()));
+            for (size_t i = 0; i < mat.rows(); i++) put(mat[i].data(), mat.cols() * sizeof(R));
+            maybe_hand_off();
+        }
+
+        // rows x cols matrix whose row i is values[i] everywhere (the e_j "matrix" of the column-wise dot)
+        void broadcast(std::string_view name, std::span<const R> values, size_t cols) {
+            if (!file_) return;
+            header(TraceTag::Broadcast, name);
+            put_u32(static_cast<uint32_t>(values.size()));
+            put_u32(static_cast<uint32_t>(cols));
+            put(values.data(), values.size_bytes());
+            maybe_hand_off();
+        }
+
+    private:
+        static constexpr size_t buffer_bytes = size_t(1) << 20;
+        static constexpr size_t max_pending = 8; // full buffers queued before the protocol waits for the disk
+
+        void header(TraceTag tag, std::string_view name) {
+            size_t len = std::min<size_t>(name.size(), 255);
+            put_u8(static_cast<uint8_t>(tag));
+            put_u8(static_cast<uint8_t>(len));
+            put(name.data(), len);
+        }
+
+        void put(const void *p, size_t bytes) {
+            const char *c = static_cast<const char*>(p);
+            cur_.insert(cur_.end(), c, c + bytes);
+        }
+        void put_u8(uint8_t v) { cur_.push_back(static_cast<char>(v)); }
+        void put_u32(uint32_t v) { put(&v, sizeof(v)); }
+        void put_i32(int32_t v) { put(&v, sizeof(v)); }
+
+        void maybe_hand_off() {
+            if (cur_.size() >= buffer_bytes) hand_off();
+        }
+
+        // queue the current buffer for the writer thread and continue in a recycled one
+        void hand_off() {
+            if (cur_.empty()) return;
+            std::unique_lock<std::mutex> lock(mu_);
+            space_cv_.wait(lock, [&] { return full_.size() < max_pending; });
+            full_.push_back(std::move(cur_));
+            if (!free_.empty()) {
+                cur_ = std::move(free_.back());
+                free_.pop_back();
+            } else {
+                cur_ = std::vector<char>();
+            }
+            cur_.clear();
+            lock.unlock();
+            cv_.notify_one();
+        }
+
+        void writer_loop() {
+            for (;;) {
+                std::vector<char> buf;
+                {
+                    std::unique_lock<std::mutex> lock(mu_);
+                    cv_.wait(lock, [&] { return stop_ || !full_.empty(); });
+                    if (full_.empty()) return; // stop_ and drained
+                    buf = std::move(full_.front());
+                    full_.pop_front();
+                }
+                space_cv_.notify_one();
+                std::fwrite(buf.data(), 1, buf.size(), file_);
+                std::lock_guard<std::mutex> lock(mu_);
+                free_.push_back(std::move(buf));
+            }
+        }
+
+        std::FILE *file_ = nullptr;
+        std::vector<char> cur_;                  // owned by the protocol thread
+        std::deque<std::vector<char>> full_;     // waiting for the writer (guarded by mu_)
+        std::vector<std::vector<char>> free_;    // written, ready for reuse (guarded by mu_)
+        std::mutex mu_;
+        std::condition_variable cv_, space_cv_;
+        bool stop_ = false;
+        std::thread writer_;
+};
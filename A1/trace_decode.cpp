@@ -0,0 +1,133 @@
+// Offline decoder for the binary trace written by the parties (trace.hpp): prints it in the text
+// format of the old o1.txt / o2.txt log. The ring width is read from the file, so one decoder handles the
+// traces of every -DMPC_RING_BITS build.
+// Usage: ./trace_decode o1.trace [o1.txt]   (writes to stdout without an output file)
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "trace.hpp"
+
+// Reads the trace file; every read past the end throws.
+class Reader {
+    public:
+        explicit Reader(std::vector<char> data) : data_(std::move(data)) {}
+        bool done() const { return pos_ == data_.size(); }
+        const char *take(size_t bytes) {
+            if (data_.size() - pos_ < bytes) throw std::runtime_error("truncated trace record");
+            const char *p = data_.data() + pos_;
+            pos_ += bytes;
+            return p;
+        }
+        uint8_t u8() { return static_cast<uint8_t>(*take(1)); }
+        uint32_t u32() { uint32_t v; std::memcpy(&v, take(4), 4); return v; }
+        int32_t i32() { int32_t v; std::memcpy(&v, take(4), 4); return v; }
+        const char *elems(size_t count, size_t bytes) { return take(count * bytes); }
+    private:
+        std::vector<char> data_;
+        size_t pos_ = 0;
+};
+
+// Buffered text output, integers via to_chars.
+class Writer {
+    public:
+        explicit Writer(std::FILE *f) : f_(f) {}
+        ~Writer() { flush(); }
+        void str(std::string_view s) { reserve(s.size()); buf_.append(s); }
+        void num(long long v) {
+            char tmp[24];
+            auto res = std::to_chars(tmp, tmp + sizeof(tmp), v);
+            str(std::string_view(tmp, res.ptr - tmp));
+        }
+        // a ring element of `bytes` bytes, as a signed decimal
+        void elem(const char *p, size_t bytes) {
+            if (bytes == 4) { int32_t v; std::memcpy(&v, p, 4); num(v); }
+            else if (bytes == 8) { int64_t v; std::memcpy(&v, p, 8); num(v); }
+            else str(ring_to_string(p, bytes));
+        }
+        void flush() {
+            std::fwrite(buf_.data(), 1, buf_.size(), f_);
+            buf_.clear();
+        }
+    private:
+        void reserve(size_t bytes) { if (buf_.size() + bytes > (1 << 20)) flush(); }
+        std::FILE *f_;
+        std::string buf_;
+};
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <trace_file> [output_file]\n";
+        return 1;
+    }
+    std::ifstream fin(argv[1], std::ios::binary);
+    if (!fin) {
+        std::cerr << "Error: cannot open file " << argv[1] << std::endl;
+        return 1;
+    }
+    std::FILE *out = argc > 2 ? std::fopen(argv[2], "w") : stdout;
+    if (!out) {
+        std::cerr << "Error: cannot open file " << argv[2] << std::endl;
+        return 1;
+    }
+
+    try {
+        Reader in(std::vector<char>(std::istreambuf_iterator<char>(fin), {}));
+        if (std::memcmp(in.take(sizeof(trace_magic)), trace_magic, sizeof(trace_magic)) != 0)
+            throw std::runtime_error("not a trace file");
+        if (uint32_t version = in.u32(); version != trace_version)
+            throw std::runtime_error("unsupported trace version " + std::to_string(version));
+        size_t eb = in.u32();
+        if (eb != 4 && eb != 8 && eb != 16) throw std::runtime_error("unsupported ring element size " + std::to_string(eb));
+
+        Writer w(out);
+        while (!in.done()) {
+            auto tag = static_cast<TraceTag>(in.u8());
+            size_t name_len = in.u8();
+            std::string_view name(in.take(name_len), name_len);
+            switch (tag) {
+                case TraceTag::Query: {
+                    int32_t role = in.i32(), index = in.i32();
+                    w.str("=== Role: P"); w.num(role); w.str(" | Query "); w.num(index); w.str(" ===\n");
+                    break;
+                }
+                case TraceTag::Scalar:
+                    w.str(name); w.str(": "); w.elem(in.elems(1, eb), eb); w.str("\n");
+                    break;
+                case TraceTag::Vector: {
+                    uint32_t len = in.u32();
+                    const char *v = in.elems(len, eb);
+                    w.str(name); w.str(": ");
+                    for (uint32_t i = 0; i < len; i++) { w.elem(v + i * eb, eb); w.str(" "); }
+                    w.str("\n");
+                    break;
+                }
+                case TraceTag::Matrix:
+                case TraceTag::Broadcast: {
+                    uint32_t rows = in.u32(), cols = in.u32();
+                    bool bcast = tag == TraceTag::Broadcast;
+                    const char *v = in.elems(bcast ? rows : size_t(rows) * cols, eb);
+                    w.str(name); w.str(" ("); w.num(rows); w.str("x"); w.num(cols); w.str("):\n");
+                    for (uint32_t i = 0; i < rows; i++) {
+                        for (uint32_t c = 0; c < cols; c++) { w.elem(v + (bcast ? i : size_t(i) * cols + c) * eb, eb); w.str(" "); }
+                        w.str("\n");
+                    }
+                    break;
+                }
+                default:
+                    throw std::runtime_error("unknown trace record tag " + std::to_string(static_cast<int>(tag)));
+            }
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        if (out != stdout) std::fclose(out);
+        return 1;
+    }
+    if (out != stdout) std::fclose(out);
+    return 0;
+}